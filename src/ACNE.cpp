@@ -73,11 +73,11 @@ struct ACNE : BidooModule {
 	bool links[8] = {0,0,0,0,0,0,0,0};
 	bool shifted = false;
 	bool solo = false;
-	float_4 ramp = 0.0f;
-	float_4 rampMin = 0.0f;
-	float_4 rampMax = 0.01f;
-	float_4 in = 0.0f;
-	float_4 out = 0.0f;
+	bool polyphonic = false;
+	float ramp = 0.0f;
+	float rampMax = 0.01f;
+	alignas(16) float gains[ACNE_NB_OUTS][ACNE_NB_TRACKS] = {{0.0f}};
+	alignas(16) float ins[ACNE_NB_TRACKS] = {0.0f};
 
 	ACNE() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -119,10 +119,13 @@ struct ACNE : BidooModule {
 	}
 
 	void process(const ProcessArgs &args) override;
+	void mixMono();
+	void mixPoly();
 
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "autosave", json_boolean(autosave));
+		json_object_set_new(rootJ, "polyphonic", json_boolean(polyphonic));
 		json_t *snapShotsJ = json_array();
 		for (int i = 0; i < ACNE_NB_SNAPSHOTS; i++) {
 			json_t *snapshotJ = json_array();
@@ -149,6 +152,8 @@ struct ACNE : BidooModule {
 		BidooModule::dataFromJson(rootJ);
 		json_t *autosaveJ = json_object_get(rootJ, "autosave");
 		if (autosaveJ) autosave = json_is_true(autosaveJ);
+		json_t *polyphonicJ = json_object_get(rootJ, "polyphonic");
+		if (polyphonicJ) polyphonic = json_is_true(polyphonicJ);
 		json_t *snapShotsJ = json_object_get(rootJ, "snapshots");
 		if (snapShotsJ) {
 			for (int i = 0; i < ACNE_NB_SNAPSHOTS; i++) {
@@ -320,51 +325,96 @@ void ACNE::process(const ProcessArgs &args) {
 		solo = solo || inSolo[i];
 	}
 
+	float_4 mutesNSolo[ACNE_NB_TRACKS/4];
+	for (int j = 0; j < ACNE_NB_TRACKS; j++) {
+		mutesNSolo[j/4][j%4] = (inMutes[j] || (solo && !inSolo[j])) ? 0.0f : 1.0f;
+	}
+
+	float fade = ramp > 0.0f ? ramp / rampMax : 0.0f;
+
 	for (int i = 0; i < ACNE_NB_OUTS; i++) {
-		outputs[TRACKS_OUTPUTS + i].setVoltage(0.0f);
 		if (outMutesTriggers[i].process(params[OUT_MUTE_PARAMS + i].getValue())) {
 			outMutes[i] = !outMutes[i];
 		}
 		lights[OUT_MUTE_LIGHTS + i].setBrightness(outMutes[i] == true ? 1 : 0);
 
-		if (!outMutes[i]) {
-			for (int j = 0; j < ACNE_NB_TRACKS/4; j++) {
-				if (autosave || save) {
-					snapshots[currentSnapshot][i][j][0] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4].getValue();
-					snapshots[currentSnapshot][i][j][1] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+1].getValue();
-					snapshots[currentSnapshot][i][j][2] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+2].getValue();
-					snapshots[currentSnapshot][i][j][3] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+3].getValue();
-				}
+		float outGain = i < 2 ? params[MAIN_OUT_GAIN_PARAM].getValue() : 1.0f;
+		for (int j = 0; j < ACNE_NB_TRACKS/4; j++) {
+			if (outMutes[i]) {
+				float_4::zero().store(&gains[i][j*4]);
+				continue;
+			}
 
-				float_4 mutesNSolo;
-				mutesNSolo[0] = inMutes[j*4] ? 0 : ((solo&&!inSolo[j*4]) ? 0 : 1);
-				mutesNSolo[1] = inMutes[j*4+1] ? 0 : ((solo&&!inSolo[j*4+1]) ? 0 : 1);
-				mutesNSolo[2] = inMutes[j*4+2] ? 0 : ((solo&&!inSolo[j*4+2]) ? 0 : 1);
-				mutesNSolo[3] = inMutes[j*4+3] ? 0 : ((solo&&!inSolo[j*4+3]) ? 0 : 1);
+			if (autosave || save) {
+				snapshots[currentSnapshot][i][j][0] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4].getValue();
+				snapshots[currentSnapshot][i][j][1] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+1].getValue();
+				snapshots[currentSnapshot][i][j][2] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+2].getValue();
+				snapshots[currentSnapshot][i][j][3] = params[FADERS_PARAMS+i*ACNE_NB_TRACKS+j*4+3].getValue();
+			}
 
-				in = {inputs[TRACKS_INPUTS + j*4].getVoltage(), inputs[TRACKS_INPUTS + j*4+1].getVoltage(), inputs[TRACKS_INPUTS + j*4+2].getVoltage(), inputs[TRACKS_INPUTS + j*4+3].getVoltage()};
-				if (ramp[0]>0) {
-					out = simd::rescale(ramp,rampMin,rampMax,snapshots[currentSnapshot][i][j],snapshots[previousSnapshot][i][j])*mutesNSolo*in;
-				}
-				else {
-					out = snapshots[currentSnapshot][i][j]*mutesNSolo*in;
-				}
+			float_4 gain = snapshots[currentSnapshot][i][j];
+			if (fade > 0.0f) {
+				gain += (snapshots[previousSnapshot][i][j] - gain) * fade;
+			}
+			(gain * mutesNSolo[j] * outGain).store(&gains[i][j*4]);
+		}
+	}
 
-				outputs[TRACKS_OUTPUTS + i].setVoltage(outputs[TRACKS_OUTPUTS + i].getVoltage() + out[0] + out[1]	+ out[2] + out[3]);
+	if (polyphonic) {
+		mixPoly();
+	}
+	else {
+		mixMono();
+	}
 
-			}
-			outputs[TRACKS_OUTPUTS + i].setVoltage(outputs[TRACKS_OUTPUTS + i].getVoltage());
+	ramp = std::max(ramp-args.sampleTime,0.f);
+}
+
+// Each output is the dot product of its row of the gain matrix with the
+// channel 0 voltages of the 16 inputs.
+void ACNE::mixMono() {
+	for (int j = 0; j < ACNE_NB_TRACKS; j++) {
+		ins[j] = inputs[TRACKS_INPUTS + j].getVoltage();
+	}
+
+	for (int i = 0; i < ACNE_NB_OUTS; i++) {
+		float_4 out = 0.0f;
+		for (int j = 0; j < ACNE_NB_TRACKS; j += 4) {
+			out += float_4::load(&gains[i][j]) * float_4::load(&ins[j]);
 		}
+		outputs[TRACKS_OUTPUTS + i].setChannels(1);
+		outputs[TRACKS_OUTPUTS + i].setVoltage(out[0] + out[1] + out[2] + out[3]);
 	}
+}
 
-	outputs[TRACKS_OUTPUTS].setVoltage(outputs[TRACKS_OUTPUTS].getVoltage() * params[MAIN_OUT_GAIN_PARAM].value);
-	outputs[TRACKS_OUTPUTS + 1].setVoltage(outputs[TRACKS_OUTPUTS + 1].getVoltage() * params[MAIN_OUT_GAIN_PARAM].value);
+// Each poly channel is mixed on its own: channel c of an output sums channel c
+// of every input, four channels per float_4. Unpatched inputs are skipped.
+void ACNE::mixPoly() {
+	float_4 outs[ACNE_NB_OUTS][4] = {};
+	int channels = 1;
+
+	for (int j = 0; j < ACNE_NB_TRACKS; j++) {
+		int inChannels = inputs[TRACKS_INPUTS + j].getChannels();
+		channels = std::max(channels, inChannels);
+		for (int c = 0; c < inChannels; c += 4) {
+			float_4 in = inputs[TRACKS_INPUTS + j].getVoltageSimd<float_4>(c);
+			for (int i = 0; i < ACNE_NB_OUTS; i++) {
+				outs[i][c/4] += gains[i][j] * in;
+			}
+		}
+	}
 
-	ramp = simd::fmax(ramp-args.sampleTime,0.f);
+	for (int i = 0; i < ACNE_NB_OUTS; i++) {
+		outputs[TRACKS_OUTPUTS + i].setChannels(channels);
+		for (int c = 0; c < channels; c += 4) {
+			outputs[TRACKS_OUTPUTS + i].setVoltageSimd(outs[i][c/4], c);
+		}
+	}
 }
 
 struct ACNEWidget : BidooWidget {
 	ACNEWidget(ACNE *module);
+	void appendContextMenu(Menu *menu) override;
 };
 
 struct AcneBidooColoredTrimpot : BidooColoredTrimpot {
@@ -455,4 +505,20 @@ ACNEWidget::ACNEWidget(ACNE *module) {
 	addChild(createLight<SmallLight<BlueLight>>(Vec(466.0f, 9.0f), module, ACNE::SAVE_LIGHT));
 }
 
+void ACNEWidget::appendContextMenu(Menu *menu) {
+	BidooWidget::appendContextMenu(menu);
+	ACNE *module = dynamic_cast<ACNE*>(this->module);
+	menu->addChild(new MenuSeparator());
+	menu->addChild(createSubmenuItem("Mixing", module->polyphonic ? "Polyphonic" : "Mono", [=](ui::Menu* menu) {
+		menu->addChild(createCheckMenuItem("Mono", "",
+			[=]() {return !module->polyphonic;},
+			[=]() {module->polyphonic = false;}
+		));
+		menu->addChild(createCheckMenuItem("Polyphonic", "",
+			[=]() {return module->polyphonic;},
+			[=]() {module->polyphonic = true;}
+		));
+	}));
+}
+
 Model *modelACNE = createModel<ACNE, ACNEWidget>("ACnE");
@@ -1,33 +1,13 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/resampler.hpp"
+#include "dep/filters/svf.h"
+#include "dep/filters/halfband.h"
+#include "dep/filters/pade.h"
 
 using namespace std;
 
-#define pi 3.14159265359
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi * freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
+using simd::float_4;
 
 struct BAFIS : BidooModule {
 	enum ParamIds {
@@ -57,7 +37,13 @@ struct BAFIS : BidooModule {
 		NUM_LIGHTS
 	};
 
-	MultiFilter filter0, filter1,filter2, filter3, filter4, filter5;
+	SVF<float_4> filters[6][4];
+	Oversampler<float_4> oversamplers[4][4];
+	int oversampling = 1;
+	int appliedOversampling = 1;
+	bool pre[4] = {true, true, true, true};
+	int types[4] = {0, 0, 0, 0};
+	dsp::ClockDivider modeDivider;
 
 	///Tooltip
 	struct tpType : ParamQuantity {
@@ -94,155 +80,118 @@ struct BAFIS : BidooModule {
       configParam<tpPrePost>(PREPOST_PARAM+i, 0.f, 1.f, 0.f, "Pre/Post");
       configParam(VOLUME_PARAM+i, 0.f, 1.f, 0.5f, "Volume", "%", 0.f, 100.f);
     }
-	}
 
-	void process(const ProcessArgs &args) override {
-    float in = inputs[IN].getVoltage() * 0.2f; //normalise to -1/+1 we consider VCV Rack standard is #+5/-5V on VCO1
-    float out = 0.f;
-		float c0freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM].getValue() + inputs[FREQ_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float c1freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM+1].getValue() + inputs[FREQ_INPUT+1].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float c2freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM+2].getValue() + inputs[FREQ_INPUT+2].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
+		modeDivider.setDivision(16);
+	}
 
-    float q0 = 10.0f * clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q1 = 10.0f * clamp(params[Q_PARAM+1].getValue() + inputs[Q_INPUT+1].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q2 = 10.0f * clamp(params[Q_PARAM+2].getValue() + inputs[Q_INPUT+2].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q3 = 10.0f * clamp(params[Q_PARAM+3].getValue() + inputs[Q_INPUT+3].getVoltage() / 10.f, 0.1f, 1.0f);
+	json_t *dataToJson() override {
+		json_t *rootJ = BidooModule::dataToJson();
+		json_object_set_new(rootJ, "oversampling", json_integer(oversampling));
+		return rootJ;
+	}
 
-    float g0 = clamp(params[GAIN_PARAM].getValue() + inputs[GAIN_INPUT].getVoltage(), 1.f, 10.0f);
-    float g1 = clamp(params[GAIN_PARAM+1].getValue() + inputs[GAIN_INPUT+1].getVoltage(), 1.f, 10.0f);
-    float g2 = clamp(params[GAIN_PARAM+2].getValue() + inputs[GAIN_INPUT+2].getVoltage(), 1.f, 10.0f);
-    float g3 = clamp(params[GAIN_PARAM+3].getValue() + inputs[GAIN_INPUT+3].getVoltage(), 1.f, 10.0f);
+	void dataFromJson(json_t *rootJ) override {
+		BidooModule::dataFromJson(rootJ);
+		json_t *oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ)
+			oversampling = json_integer_value(oversamplingJ);
+		if ((oversampling != 2) && (oversampling != 4))
+			oversampling = 1;
+		updateModes();
+	}
 
-		float v0 = clamp(params[VOLUME_PARAM].getValue() + inputs[VOLUME_INPUT].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v1 = clamp(params[VOLUME_PARAM+1].getValue() + inputs[VOLUME_INPUT+1].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v2 = clamp(params[VOLUME_PARAM+2].getValue() + inputs[VOLUME_INPUT+2].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v3 = clamp(params[VOLUME_PARAM+3].getValue() + inputs[VOLUME_INPUT+3].getVoltage() * 0.1f, 0.f, 1.0f);
+	// shaper placement and type only change with the switches, they are
+	// looked up every 16 samples rather than per sample and per band
+	void updateModes() {
+		for (int i = 0; i < 4; i++) {
+			pre[i] = (params[PREPOST_PARAM+i].getValue() == 0.f) || (inputs[PREPOST_INPUT+i].isConnected() && (inputs[PREPOST_INPUT+i].getVoltage()<1.f));
+			if ((params[TYPE_PARAM+i].getValue() == 0.f) || (inputs[TYPE_INPUT+i].isConnected() && (inputs[TYPE_INPUT+i].getVoltage() == 0.f)))
+				types[i] = 0;
+			else if ((params[TYPE_PARAM+i].getValue() == 1.f) || (inputs[TYPE_INPUT+i].isConnected() && (inputs[TYPE_INPUT+i].getVoltage() == 1.f)))
+				types[i] = 1;
+			else
+				types[i] = 2;
+		}
+	}
 
-    if ((params[PREPOST_PARAM].getValue() == 0.f) || (inputs[PREPOST_INPUT].isConnected() && (inputs[PREPOST_INPUT].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM].getValue() == 0.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 0.f))) {
-        dIn = tanh(g0*in);
-      }
-      else if ((params[TYPE_PARAM].getValue() == 1.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 1.f))) {
-        dIn = sin(g0*in);
-      }
-      else {
-        dIn = clamp(g0*in,-1.0f,1.0f);
-      }
-      filter0.setParams(c0freq, q0, args.sampleRate);
-    	filter0.calcOutput(dIn);
-  		out = filter0.lp * v0 * 30517578125e-15f;
-    }
-    else {
-      filter0.setParams(c0freq, q0, args.sampleRate);
-    	filter0.calcOutput(in);
-      if ((params[TYPE_PARAM].getValue() == 0.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 0.f))) {
-        out = tanh(g0*filter0.lp) * v0 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM].getValue() == 1.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 1.f))) {
-        out = sin(g0*filter0.lp) * v0 * 30517578125e-15f;
-      }
-      else {
-        out = clamp(g0*filter0.lp,-1.f,1.f) * v0 * 30517578125e-15f;
-      }
-    }
+	// the shaper alone runs at the oversampled rate
+	float_4 distort(int band, int group, float_4 x, float_4 gain, int factor) {
+		float_4 buf[4];
+		oversamplers[band][group].upsample(x * gain, buf, factor);
+		if (types[band] == 0) {
+			for (int i = 0; i < factor; i++) buf[i] = fastTanh(buf[i]);
+		}
+		else if (types[band] == 1) {
+			for (int i = 0; i < factor; i++) buf[i] = simd::sin(buf[i]);
+		}
+		else {
+			for (int i = 0; i < factor; i++) buf[i] = simd::clamp(buf[i], -1.f, 1.f);
+		}
+		return oversamplers[band][group].downsample(buf, factor);
+	}
 
-    if ((params[PREPOST_PARAM+1].getValue() == 0.f) || (inputs[PREPOST_INPUT+1].isConnected() && (inputs[PREPOST_INPUT+1].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+1].getValue() == 0.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 0.f))) {
-        dIn = tanh(g1*in);
-      }
-      else if ((params[TYPE_PARAM+1].getValue() == 1.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 1.f))) {
-        dIn = sin(g1*in);
-      }
-      else {
-        dIn = clamp(g1*in,-1.0f,1.0f);
-      }
-      filter1.setParams(c0freq, q1, args.sampleRate);
-    	filter1.calcOutput(dIn);
-      filter2.setParams(c1freq, q1, args.sampleRate);
-    	filter2.calcOutput(filter1.hp);
-      out += filter2.lp * v1 * 30517578125e-15f;
-    }
-    else {
-      filter1.setParams(c0freq, q1, args.sampleRate);
-    	filter1.calcOutput(in);
-      filter2.setParams(c1freq, q1, args.sampleRate);
-    	filter2.calcOutput(filter1.hp);
-      if ((params[TYPE_PARAM+1].getValue() == 0.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 0.f))) {
-        out += tanh(g1*filter2.lp) * v1 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+1].getValue() == 1.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 1.f))) {
-        out += sin(g1*filter2.lp) * v1 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g1*filter2.lp,-1.f,1.f) * v1 * 30517578125e-15f;
-      }
-    }
+	// band 0 is lowpassed at c0, bands 1 and 2 are bandpassed between two
+	// crossovers and band 3 is highpassed at c2
+	float_4 split(int band, int group, float_4 x, const float_4 *freqs, float_4 q, float sampleTime) {
+		if (band == 0) {
+			filters[0][group].setParams(freqs[0], q, sampleTime);
+			filters[0][group].process(x);
+			return filters[0][group].lp;
+		}
+		else if (band == 3) {
+			filters[5][group].setParams(freqs[2], q, sampleTime);
+			filters[5][group].process(x);
+			return filters[5][group].hp;
+		}
+		SVF<float_4> &hp = filters[2*band-1][group];
+		SVF<float_4> &lp = filters[2*band][group];
+		hp.setParams(freqs[band-1], q, sampleTime);
+		hp.process(x);
+		lp.setParams(freqs[band], q, sampleTime);
+		lp.process(hp.hp);
+		return lp.lp;
+	}
 
-    if ((params[PREPOST_PARAM+2].getValue() == 0.f) || (inputs[PREPOST_INPUT+2].isConnected() && (inputs[PREPOST_INPUT+2].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+2].getValue() == 0.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 0.f))) {
-        dIn = tanh(g2*in);
-      }
-      else if ((params[TYPE_PARAM+2].getValue() == 1.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 1.f))) {
-        dIn = sin(g2*in);
-      }
-      else {
-        dIn = clamp(g2*in,-1.0f,1.0f);
-      }
-      filter3.setParams(c1freq, q2, args.sampleRate);
-    	filter3.calcOutput(dIn);
-      filter4.setParams(c2freq, q2, args.sampleRate);
-    	filter4.calcOutput(filter3.hp);
-      out += filter4.lp * v2 * 30517578125e-15f;
-    }
-    else {
-      filter3.setParams(c1freq, q2, args.sampleRate);
-    	filter3.calcOutput(in);
-      filter4.setParams(c2freq, q2, args.sampleRate);
-    	filter4.calcOutput(filter1.hp);
-      if ((params[TYPE_PARAM+2].getValue() == 0.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 0.f))) {
-        out += tanh(g2*filter4.lp) * v2 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+2].getValue() == 1.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 1.f))) {
-        out += sin(g2*filter4.lp) * v2 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g2*filter4.lp,-1.f,1.f) * v2 * 30517578125e-15f;
-      }
-    }
+	void process(const ProcessArgs &args) override {
+		if (modeDivider.process())
+			updateModes();
+
+		int channels = std::max(inputs[IN].getChannels(), 1);
+		int factor = oversampling;
+		// the halfband stages a factor leaves idle hold what they had when it
+		// was last used, start them from silence on a change
+		if (factor != appliedOversampling) {
+			for (int band = 0; band < 4; band++) {
+				for (int g = 0; g < 4; g++) {
+					oversamplers[band][g].reset();
+				}
+			}
+			appliedOversampling = factor;
+		}
 
-    if ((params[PREPOST_PARAM+3].getValue() == 0.f) || (inputs[PREPOST_INPUT+3].isConnected() && (inputs[PREPOST_INPUT+3].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+3].getValue() == 0.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 0.f))) {
-        dIn = tanh(g3*in);
-      }
-      else if ((params[TYPE_PARAM+3].getValue() == 1.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 1.f))) {
-        dIn = sin(g3*in);
-      }
-      else {
-        dIn = clamp(g3*in,-1.0f,1.0f);
-      }
-      filter5.setParams(c2freq, q3, args.sampleRate);
-    	filter5.calcOutput(dIn);
-      out += filter5.hp * v3 * 30517578125e-15f;
-    }
-    else {
-      filter5.setParams(c2freq, q3, args.sampleRate);
-    	filter5.calcOutput(in);
-      if ((params[TYPE_PARAM+3].getValue() == 0.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 0.f))) {
-        out += tanh(g3*filter5.hp) * v3 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+3].getValue() == 1.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 1.f))) {
-        out += sin(g3*filter5.hp) * v3 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g3*filter5.hp,-1.f,1.f) * v3 * 30517578125e-15f;
-      }
-    }
+		for (int c = 0; c < channels; c += 4) {
+			float_4 in = inputs[IN].getPolyVoltageSimd<float_4>(c) * 0.2f; //normalise to -1/+1 we consider VCV Rack standard is #+5/-5V on VCO1
+			float_4 out = 0.f;
+			float_4 freqs[3];
+			for (int i = 0; i < 3; i++) {
+				freqs[i] = simd::pow(2.0f, 4.5f + 9.5f * simd::clamp(params[FREQ_PARAM+i].getValue() + inputs[FREQ_INPUT+i].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f));
+			}
+
+			for (int i = 0; i < 4; i++) {
+				float_4 q = 10.0f * simd::clamp(params[Q_PARAM+i].getValue() + inputs[Q_INPUT+i].getPolyVoltageSimd<float_4>(c) / 10.f, 0.1f, 1.0f);
+				float_4 gain = simd::clamp(params[GAIN_PARAM+i].getValue() + inputs[GAIN_INPUT+i].getPolyVoltageSimd<float_4>(c), 1.f, 10.0f);
+				float_4 volume = simd::clamp(params[VOLUME_PARAM+i].getValue() + inputs[VOLUME_INPUT+i].getPolyVoltageSimd<float_4>(c) * 0.1f, 0.f, 1.0f);
+				float_4 x = pre[i] ? distort(i, c/4, in, gain, factor) : in;
+				x = split(i, c/4, x, freqs, q, args.sampleTime);
+				if (!pre[i])
+					x = distort(i, c/4, x, gain, factor);
+				out += x * volume;
+			}
+
+			outputs[OUT].setVoltageSimd(out * 5.0f, c);
+		}
 
-    outputs[OUT].setVoltage(out * 32768.0f * 5.0f);
+		outputs[OUT].setChannels(channels);
 	}
 
 };
@@ -281,6 +230,20 @@ struct BAFISWidget : BidooWidget {
 		addInput(createInput<PJ301MPort>(Vec(6.8f, 330), module, BAFIS::IN));
 		addOutput(createOutput<PJ301MPort>(Vec(118.4f, 330), module, BAFIS::OUT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		BidooWidget::appendContextMenu(menu);
+		BAFIS *module = dynamic_cast<BAFIS*>(this->module);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createSubmenuItem("Oversampling", std::to_string(module->oversampling) + "x", [=](ui::Menu* menu) {
+			for (int factor : {1, 2, 4}) {
+				menu->addChild(createCheckMenuItem(std::to_string(factor) + "x", "",
+					[=]() {return module->oversampling == factor;},
+					[=]() {module->oversampling = factor;}
+				));
+			}
+		}));
+	}
 };
 
 Model *modelBAFIS = createModel<BAFIS, BAFISWidget>("BAFIS");
@@ -2,6 +2,7 @@
 #include "BidooComponents.hpp"
 #include "dsp/ringbuffer.hpp"
 #include "dsp/digital.hpp"
+#include "dep/meter.hpp"
 
 using namespace std;
 
@@ -35,28 +36,36 @@ struct BAR : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float,16384> vu_L_Buffer, vu_R_Buffer;
-	dsp::DoubleRingBuffer<float,512> rms_L_Buffer, rms_R_Buffer;
-	float runningVU_L_Sum = 1e-6f, runningRMS_L_Sum = 1e-6f, rms_L = -96.3f, vu_L = -96.3f, peakL = -96.3f;
-	float runningVU_R_Sum = 1e-6f, runningRMS_R_Sum = 1e-6f, rms_R = -96.3f, vu_R = -96.3f, peakR = -96.3f;
+	static const int LOOKAHEAD_SIZE = 16384;
 
-	float in_L_dBFS = 1e-6f;
-	float in_R_dBFS = 1e-6f;
+	meter::Meter meterL, meterR, SC_meterL, SC_meterR;
 
-	dsp::DoubleRingBuffer<float,16384> SC_vu_L_Buffer, SC_vu_R_Buffer;
-	dsp::DoubleRingBuffer<float,512> SC_rms_L_Buffer, SC_rms_R_Buffer;
-	float SC_runningVU_L_Sum = 1e-6f, SC_runningRMS_L_Sum = 1e-6f, SC_rms_L = -96.3f, SC_vu_L = -96.3f, SC_peakL = -96.3f;
-	float SC_runningVU_R_Sum = 1e-6f, SC_runningRMS_R_Sum = 1e-6f, SC_rms_R = -96.3f, SC_vu_R = -96.3f, SC_peakR = -96.3f;
-
-	float SC_in_L_dBFS = 1e-6f;
-	float SC_in_R_dBFS = 1e-6f;
-
-	float dist = 0.0f, gain = 1.0f, gaindB = 1.0f, ratio = 1.0f, threshold = 1.0f, knee = 0.0f;
-	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, previousPostGain = 1.0f, mix = 1.0f;
-	int indexVU = 0, indexRMS = 0, lookAheadWriteIndex=0;
-	int maxIndexVU = 0, maxIndexRMS = 0, maxLookAheadWriteIndex=0;
+	float gain = 1.0f, gaindB = 1.0f, ratio = 1.0f, threshold = 1.0f, knee = 0.0f;
+	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, mix = 1.0f;
+	float cAtt = 0.0f, cRel = 0.0f, coefsAttack = 0.0f, coefsRelease = 0.0f, coefsSampleRate = 0.0f;
+	int lookAheadWriteIndex=0;
 	int lookAhead;
-	float buffL[20000] = {0.0f}, buffR[20000] = {0.0f};
+
+	// delay lines and detector state of one channel, about 256 KB
+	struct Channel {
+		float delayL[LOOKAHEAD_SIZE] = {}, delayR[LOOKAHEAD_SIZE] = {};
+		meter::SlidingMax<LOOKAHEAD_SIZE> peak;
+		float previousPostGain = 1.0f;
+
+		void reset() {
+			std::fill(delayL, delayL + LOOKAHEAD_SIZE, 0.0f);
+			std::fill(delayR, delayR + LOOKAHEAD_SIZE, 0.0f);
+			peak.reset();
+			previousPostGain = 1.0f;
+		}
+	};
+	// channel 0 is always there, the 15 others are only allocated the first
+	// time the module goes polyphonic, from the UI thread
+	Channel stereo;
+	Channel *voices[16] = {};
+	Channel *polyVoices = NULL;
+	std::atomic<bool> polyphonic{false};
+	int activeChannels = 1;
 	dsp::SchmittTrigger bypassTrigger;
 	bool bypass = false;
 
@@ -71,151 +80,61 @@ struct BAR : BidooModule {
 		configParam(MIX_PARAM, 0.0f, 1.0f, 1.0f, "Mix");
 		configParam(LOOKAHEAD_PARAM, 0.0f, 200.0f, 0.0f, "Lookahead");
 		configParam(BYPASS_PARAM, 0.0f, 1.0f, 0.0f, "Bypass");
+		voices[0] = &stereo;
 	}
 
-	void process(const ProcessArgs &args) override;
-
-};
-
-void BAR::process(const ProcessArgs &args) {
-	if (bypassTrigger.process(params[BYPASS_PARAM].getValue())) {
-		bypass = !bypass;
-	}
-	lights[BYPASS_LIGHT].setBrightness(bypass ? 1.0f : 0.0f);
-
-	if (indexVU>=16384) {
-		runningVU_L_Sum -= *vu_L_Buffer.startData();
-		runningVU_R_Sum -= *vu_R_Buffer.startData();
-		vu_L_Buffer.startIncr(1);
-		vu_R_Buffer.startIncr(1);
-		SC_runningVU_L_Sum -= *SC_vu_L_Buffer.startData();
-		SC_runningVU_R_Sum -= *SC_vu_R_Buffer.startData();
-		SC_vu_L_Buffer.startIncr(1);
-		SC_vu_R_Buffer.startIncr(1);
-		indexVU--;
+	~BAR() {
+		delete[] polyVoices;
 	}
 
-	if (indexRMS>=512) {
-		runningRMS_L_Sum -= *rms_L_Buffer.startData();
-		runningRMS_R_Sum -= *rms_R_Buffer.startData();
-		rms_L_Buffer.startIncr(1);
-		rms_R_Buffer.startIncr(1);
-		SC_runningRMS_L_Sum -= *SC_rms_L_Buffer.startData();
-		SC_runningRMS_R_Sum -= *SC_rms_R_Buffer.startData();
-		SC_rms_L_Buffer.startIncr(1);
-		SC_rms_R_Buffer.startIncr(1);
-		indexRMS--;
+	void setPolyphonic(bool poly) {
+		if (poly && !polyVoices) {
+			polyVoices = new Channel[15];
+			for (int c = 1; c < 16; c++) {
+				voices[c] = &polyVoices[c-1];
+			}
+		}
+		polyphonic = poly;
 	}
 
-	indexVU++;
-	indexRMS++;
-
-	buffL[lookAheadWriteIndex]=inputs[IN_L_INPUT].getVoltage();
-	buffR[lookAheadWriteIndex]=inputs[IN_R_INPUT].getVoltage();
-
-	if (inputs[IN_L_INPUT].isConnected())
-		in_L_dBFS = max(20.0f*log10((abs(inputs[IN_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_L_dBFS = -96.3f;
-
-	if (inputs[SC_L_INPUT].isConnected())
-		SC_in_L_dBFS = max(20.0f*log10((abs(inputs[SC_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_L_dBFS = -96.3f;
-
-	if (inputs[IN_R_INPUT].isConnected())
-		in_R_dBFS = max(20.0f*log10((abs(inputs[IN_R_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_R_dBFS = -96.3f;
-
-	if (inputs[SC_R_INPUT].isConnected())
-		SC_in_R_dBFS = max(20.0f*log10((abs(inputs[SC_R_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_R_dBFS = -96.3f;
-
-	float data_L = in_L_dBFS*in_L_dBFS;
-	float data_R = in_R_dBFS*in_R_dBFS;
-
-	float SC_data_L = SC_in_L_dBFS*SC_in_L_dBFS;
-	float SC_data_R = SC_in_R_dBFS*SC_in_R_dBFS;
-
-	if (!vu_L_Buffer.full()) {
-		vu_L_Buffer.push(data_L);
-		vu_R_Buffer.push(data_R);
-		SC_vu_L_Buffer.push(SC_data_L);
-		SC_vu_R_Buffer.push(SC_data_R);
+	json_t *dataToJson() override {
+		json_t *rootJ = BidooModule::dataToJson();
+		json_object_set_new(rootJ, "polyphonic", json_boolean(polyphonic));
+		return rootJ;
 	}
 
-	if (!rms_L_Buffer.full()) {
-		rms_L_Buffer.push(data_L);
-		rms_R_Buffer.push(data_R);
-		SC_rms_L_Buffer.push(SC_data_L);
-		SC_rms_R_Buffer.push(SC_data_R);
+	void dataFromJson(json_t *rootJ) override {
+		BidooModule::dataFromJson(rootJ);
+		json_t *polyphonicJ = json_object_get(rootJ, "polyphonic");
+		if (polyphonicJ)
+			setPolyphonic(json_is_true(polyphonicJ));
 	}
 
-	runningVU_L_Sum += data_L;
-	runningRMS_L_Sum += data_L;
-	runningVU_R_Sum += data_R;
-	runningRMS_R_Sum += data_R;
-	rms_L = clamp(-1 * sqrtf(runningRMS_L_Sum/512), -96.3f,0.0f);
-	vu_L = clamp(-1 * sqrtf(runningVU_L_Sum/16384), -96.3f,0.0f);
-	rms_R = clamp(-1 * sqrtf(runningRMS_R_Sum/512), -96.3f,0.0f);
-	vu_R = clamp(-1 * sqrtf(runningVU_R_Sum/16384), -96.3f,0.0f);
-
-	SC_runningVU_L_Sum += SC_data_L;
-	SC_runningRMS_L_Sum += SC_data_L;
-	SC_runningVU_R_Sum += SC_data_R;
-	SC_runningRMS_R_Sum += SC_data_R;
-	SC_rms_L = clamp(-1 * sqrtf(SC_runningRMS_L_Sum/512), -96.3f,0.0f);
-	SC_vu_L = clamp(-1 * sqrtf(SC_runningVU_L_Sum/16384), -96.3f,0.0f);
-	SC_rms_R = clamp(-1 * sqrtf(SC_runningRMS_R_Sum/512), -96.3f,0.0f);
-	SC_vu_R = clamp(-1 * sqrtf(SC_runningVU_R_Sum/16384), -96.3f,0.0f);
-
-	threshold = params[THRESHOLD_PARAM].getValue();
-	attackTime = params[ATTACK_PARAM].getValue();
-	releaseTime = params[RELEASE_PARAM].getValue();
-	ratio = params[RATIO_PARAM].getValue();
-	knee = params[KNEE_PARAM].getValue();
-	makeup = params[MAKEUP_PARAM].getValue();
-
-	if (in_L_dBFS>peakL)
-		peakL=in_L_dBFS;
-	else
-		peakL -= 50.0f / args.sampleRate;
+	float compress(int c, float level);
 
-	if (in_R_dBFS>peakR)
-		peakR=in_R_dBFS;
-	else
-		peakR -= 50.0f / args.sampleRate;
-
-	if (SC_in_L_dBFS>SC_peakL)
-		SC_peakL=SC_in_L_dBFS;
-	else
-		SC_peakL -= 50.0f / args.sampleRate;
+	void process(const ProcessArgs &args) override;
 
-	if (SC_in_R_dBFS>SC_peakR)
-		SC_peakR=SC_in_R_dBFS;
-	else
-		SC_peakR -= 50.0f / args.sampleRate;
+};
 
+// Gain in dB for one channel: the knee curve applied to the detector level
+// then smoothed with the attack or release coefficient.
+float BAR::compress(int c, float level) {
 	float slope = 1.0f/ratio-1.0f;
-	float maxIn = (inputs[SC_L_INPUT].isConnected() || inputs[SC_R_INPUT].isConnected()) ? max(SC_in_L_dBFS,SC_in_R_dBFS) : max(in_L_dBFS,in_R_dBFS);
-	float dist = maxIn-threshold;
+	float dist = level-threshold;
 	float gcurve = 0.0f;
 
 	if (dist<-1.0f*knee/2.0f)
-		gcurve = maxIn;
+		gcurve = level;
 	else if ((dist > -1.0f * knee * 0.5f) && (dist < knee * 0.5f)) {
-		gcurve = maxIn + slope * pow(dist + knee *0.5f, 2.0f) / (2.0f * knee);
+		gcurve = level + slope * pow(dist + knee *0.5f, 2.0f) / (2.0f * knee);
 	} else {
-		gcurve = maxIn + slope * dist;
+		gcurve = level + slope * dist;
 	}
 
-	float preGain = gcurve - maxIn;
+	float preGain = gcurve - level;
 	float postGain = 0.0f;
-	float cAtt = exp(-1.0f/(attackTime * args.sampleRate * 0.001f));
-	float cRel = exp(-1.0f/(releaseTime * args.sampleRate * 0.001f));
 
+	float &previousPostGain = voices[c]->previousPostGain;
 	if (preGain<previousPostGain) {
 		postGain = cAtt * previousPostGain + (1.0f-cAtt) * preGain;
 	} else {
@@ -223,24 +142,75 @@ void BAR::process(const ProcessArgs &args) {
 	}
 
 	previousPostGain = postGain;
-	gaindB = makeup + postGain;
-	gain = pow(10.0f, gaindB/20.0f);
+	return makeup + postGain;
+}
+
+// The detector holds the loudest sample of the lookahead window, so the gain
+// is already down when that sample leaves the delay line. In stereo mode L and
+// R share one detector, in polyphonic mode each channel has its own, keyed by
+// the matching sidechain channel (a mono input or sidechain feeds all of them).
+void BAR::process(const ProcessArgs &args) {
+	if (bypassTrigger.process(params[BYPASS_PARAM].getValue())) {
+		bypass = !bypass;
+	}
+	lights[BYPASS_LIGHT].setBrightness(bypass ? 1.0f : 0.0f);
+
+	meterL.process(inputs[IN_L_INPUT].getVoltage(), args.sampleTime);
+	meterR.process(inputs[IN_R_INPUT].getVoltage(), args.sampleTime);
+	SC_meterL.process(inputs[SC_L_INPUT].getVoltage(), args.sampleTime);
+	SC_meterR.process(inputs[SC_R_INPUT].getVoltage(), args.sampleTime);
 
+	threshold = params[THRESHOLD_PARAM].getValue();
+	attackTime = params[ATTACK_PARAM].getValue();
+	releaseTime = params[RELEASE_PARAM].getValue();
+	ratio = params[RATIO_PARAM].getValue();
+	knee = params[KNEE_PARAM].getValue();
+	makeup = params[MAKEUP_PARAM].getValue();
 	mix = params[MIX_PARAM].getValue();
 	lookAhead = params[LOOKAHEAD_PARAM].getValue();
 
-	int nbSamples = clamp(floor(lookAhead * attackTime * args.sampleRate * 0.000001f),0.0f,19999.0f);
-	int readIndex;
-	if (lookAheadWriteIndex-nbSamples>=0)
-	  readIndex = (lookAheadWriteIndex-nbSamples)%20000;
-	else {
-		readIndex = 20000 - abs(lookAheadWriteIndex-nbSamples);
+	if ((attackTime != coefsAttack) || (releaseTime != coefsRelease) || (args.sampleRate != coefsSampleRate)) {
+		cAtt = exp(-1.0f/(attackTime * args.sampleRate * 0.001f));
+		cRel = exp(-1.0f/(releaseTime * args.sampleRate * 0.001f));
+		coefsAttack = attackTime;
+		coefsRelease = releaseTime;
+		coefsSampleRate = args.sampleRate;
+	}
+
+	int nbSamples = clamp(floor(lookAhead * attackTime * args.sampleRate * 0.000001f),0.0f,(float)(LOOKAHEAD_SIZE-2));
+	int readIndex = (lookAheadWriteIndex-nbSamples) & (LOOKAHEAD_SIZE-1);
+	bool sc = inputs[SC_L_INPUT].isConnected() || inputs[SC_R_INPUT].isConnected();
+	int channels = polyphonic ? max(max(inputs[IN_L_INPUT].getChannels(), inputs[IN_R_INPUT].getChannels()), 1) : 1;
+
+	// channels above the previous count were frozen, their delay lines and
+	// detector must not replay what they held when they stopped
+	for (int c = activeChannels; c < channels; c++) {
+		voices[c]->reset();
 	}
+	activeChannels = channels;
+
+	for (int c = 0; c < channels; c++) {
+		Channel &channel = *voices[c];
+		float inL = inputs[IN_L_INPUT].getPolyVoltage(c);
+		float inR = inputs[IN_R_INPUT].getPolyVoltage(c);
+		float level = sc ? max(abs(inputs[SC_L_INPUT].getPolyVoltage(c)), abs(inputs[SC_R_INPUT].getPolyVoltage(c))) : max(abs(inL), abs(inR));
+		float channelGaindB = compress(c, meter::Meter::toDb(channel.peak.process(level, nbSamples+1)));
+		float channelGain = pow(10.0f, channelGaindB/20.0f);
+		if (c == 0) {
+			gaindB = channelGaindB;
+			gain = channelGain;
+		}
 
-	outputs[OUT_L_OUTPUT].setVoltage(buffL[readIndex] * (bypass ? 1.0f : (gain*mix + (1.0f - mix))));
-	outputs[OUT_R_OUTPUT].setVoltage(buffR[readIndex] * (bypass ? 1.0f : (gain*mix + (1.0f - mix))));
+		channel.delayL[lookAheadWriteIndex] = inL;
+		channel.delayR[lookAheadWriteIndex] = inR;
 
-	lookAheadWriteIndex = (lookAheadWriteIndex+1)%20000;
+		outputs[OUT_L_OUTPUT].setVoltage(channel.delayL[readIndex] * (bypass ? 1.0f : (channelGain*mix + (1.0f - mix))), c);
+		outputs[OUT_R_OUTPUT].setVoltage(channel.delayR[readIndex] * (bypass ? 1.0f : (channelGain*mix + (1.0f - mix))), c);
+	}
+	outputs[OUT_L_OUTPUT].setChannels(channels);
+	outputs[OUT_R_OUTPUT].setChannels(channels);
+
+	lookAheadWriteIndex = (lookAheadWriteIndex+1) & (LOOKAHEAD_SIZE-1);
 }
 
 struct BARDisplay : TransparentWidget {
@@ -258,29 +228,29 @@ struct BARDisplay : TransparentWidget {
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
-			float vuL = rescale(module->vu_L,-97.0f,0.0f,0.0f,height);
-			float rmsL = rescale(module->rms_L,-97.0f,0.0f,0.0f,height);
-			float vuR = rescale(module->vu_R,-97.0f,0.0f,0.0f,height);
-			float rmsR = rescale(module->rms_R,-97.0f,0.0f,0.0f,height);
+			float vuL = rescale(module->meterL.vuDb(),-97.0f,0.0f,0.0f,height);
+			float rmsL = rescale(module->meterL.rmsDb(),-97.0f,0.0f,0.0f,height);
+			float vuR = rescale(module->meterR.vuDb(),-97.0f,0.0f,0.0f,height);
+			float rmsR = rescale(module->meterR.rmsDb(),-97.0f,0.0f,0.0f,height);
 
-			float SC_vuL = rescale(module->SC_vu_L,-97.0f,0.0f,0.0f,height);
-			float SC_rmsL = rescale(module->SC_rms_L,-97.0f,0.0f,0.0f,height);
-			float SC_vuR = rescale(module->SC_vu_R,-97.0f,0.0f,0.0f,height);
-			float SC_rmsR = rescale(module->SC_rms_R,-97.0f,0.0f,0.0f,height);
+			float SC_vuL = rescale(module->SC_meterL.vuDb(),-97.0f,0.0f,0.0f,height);
+			float SC_rmsL = rescale(module->SC_meterL.rmsDb(),-97.0f,0.0f,0.0f,height);
+			float SC_vuR = rescale(module->SC_meterR.vuDb(),-97.0f,0.0f,0.0f,height);
+			float SC_rmsR = rescale(module->SC_meterR.rmsDb(),-97.0f,0.0f,0.0f,height);
 
 			float threshold = rescale(module->threshold,0.0f,-97.0f,0.0f,height);
 			float gain = rescale(1-(module->gaindB-module->makeup),-97.0f,0.0f,97.0f,0.0f);
 			float makeup = rescale(module->makeup,0.0f,60.0f,0.0f,60.0f);
 
-			float peakL = clamp(rescale(module->peakL,0.0f,-97.0f,0.0f,height),0.f,height);
-			float peakR = clamp(rescale(module->peakR,0.0f,-97.0f,0.0f,height),0.f,height);
-			float inL = rescale(module->in_L_dBFS,-97.0f,0.0f,0.0f,height);
-			float inR = rescale(module->in_R_dBFS,-97.0f,0.0f,0.0f,height);
+			float peakL = clamp(rescale(module->meterL.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float peakR = clamp(rescale(module->meterR.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float inL = rescale(module->meterL.inDb(),-97.0f,0.0f,0.0f,height);
+			float inR = rescale(module->meterR.inDb(),-97.0f,0.0f,0.0f,height);
 
-			float SC_peakL = clamp(rescale(module->SC_peakL,0.0f,-97.0f,0.0f,height),0.f,height);
-			float SC_peakR = clamp(rescale(module->SC_peakR,0.0f,-97.0f,0.0f,height),0.f,height);
-			float SC_inL = rescale(module->SC_in_L_dBFS,-97.0f,0.0f,0.0f,height);
-			float SC_inR = rescale(module->SC_in_R_dBFS,-97.0f,0.0f,0.0f,height);
+			float SC_peakL = clamp(rescale(module->SC_meterL.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float SC_peakR = clamp(rescale(module->SC_meterR.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float SC_inL = rescale(module->SC_meterL.inDb(),-97.0f,0.0f,0.0f,height);
+			float SC_inR = rescale(module->SC_meterR.inDb(),-97.0f,0.0f,0.0f,height);
 
 			bool sc = module->inputs[BAR::SC_L_INPUT].isConnected() || module->inputs[BAR::SC_R_INPUT].isConnected();
 
@@ -501,6 +471,22 @@ struct BARWidget : BidooWidget {
 		addOutput(createOutput<TinyPJ301MPort>(Vec(93.0f, 340.0f), module, BAR::OUT_L_OUTPUT));
 		addOutput(createOutput<TinyPJ301MPort>(Vec(93.0f+22.0f, 340.0f), module, BAR::OUT_R_OUTPUT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		BidooWidget::appendContextMenu(menu);
+		BAR *module = dynamic_cast<BAR*>(this->module);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createSubmenuItem("Detection", module->polyphonic ? "Polyphonic" : "Stereo linked", [=](ui::Menu* menu) {
+			menu->addChild(createCheckMenuItem("Stereo linked", "",
+				[=]() {return !module->polyphonic;},
+				[=]() {module->setPolyphonic(false);}
+			));
+			menu->addChild(createCheckMenuItem("Polyphonic", "",
+				[=]() {return module->polyphonic;},
+				[=]() {module->setPolyphonic(true);}
+			));
+		}));
+	}
 };
 
 Model *modelBAR = createModel<BAR, BARWidget>("baR");
@@ -8,7 +8,13 @@
 #include <sstream>
 #include <algorithm>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include "dep/waves.hpp"
+#include "dep/rcu.hpp"
 
 using namespace std;
 
@@ -51,39 +57,62 @@ struct CANARD : BidooModule {
 		REC_LIGHT,
 		NUM_LIGHTS
 	};
+	enum EditIds {
+		CLEAR_EDIT,
+		RECORD_EDIT,
+		APPEND_RECORD_EDIT
+	};
+	enum SampleReaderIds {
+		AUDIO_READER,
+		UI_READER,
+		NUM_READERS
+	};
+
+	// Published sample, never modified once process() can see it. Frames are
+	// shared between versions, and with the sample cache, so slice edits don't
+	// copy the audio.
+	struct CANARDSample {
+		std::shared_ptr<const vector<dsp::Frame<2>>> frames = std::make_shared<const vector<dsp::Frame<2>>>();
+		std::vector<int> slices;
+		int channels = 2;
+		int sampleRate = 0;
+	};
 
 	bool play = false;
 	bool record = false;
-	bool save = false;
-	int channels = 2;
-	int sampleRate = 0;
+	bool stopRecord = false;
   int totalSampleCount = 0;
-	vector<dsp::Frame<2>> playBuffer, recordBuffer;
+	vector<dsp::Frame<2>> recordBuffer;
 	float samplePos = 0.0f, sampleStart = 0.0f, loopLength = 0.0f, fadeLenght = 0.0f, fadeCoeff = 1.0f, speedFactor = 1.0f;
 	size_t prevPlayedSlice = 0;
 	size_t playedSlice = 0;
 	bool changedSlice = false;
 	int readMode = 0; // 0 formward, 1 backward, 2 repeat
 	float speed;
-	std::vector<int> slices;
 	int selected = -1;
-	bool deleteFlag = false;
 	int addSliceMarker = -1;
-	bool addSliceMarkerFlag = false;
 	int deleteSliceMarker = -1;
-	bool deleteSliceMarkerFlag = false;
 	size_t index = 0;
 	float prevGateState = 0.0f;
 	float prevTrigState = 0.0f;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
-	bool loading = false;
+	std::atomic<bool> loading{false};
 	dsp::SchmittTrigger trigTrigger;
 	dsp::SchmittTrigger recordTrigger;
 	dsp::SchmittTrigger clearTrigger;
 	dsp::PulseGenerator eocPulse;
+	rcu::Pointer<CANARDSample, NUM_READERS> sample{new CANARDSample()};
+	dsp::RingBuffer<int, 16> audioEdits;
+	std::deque<std::function<void(CANARDSample&)>> uiEdits;
 	std::mutex mylock;
+	std::mutex editLock;
+	std::condition_variable editCondition;
+	std::atomic<bool> recordPending{false};
+	std::atomic<bool> running{true};
+	std::thread worker;
+	bool audioOnline = false;
 	bool newStop = false;
 	bool first=true;
 
@@ -100,23 +129,48 @@ struct CANARD : BidooModule {
 		configParam(THRESHOLD_PARAM, 0.01f, 10.0f, 1.0f);
 		configSwitch(MODE_PARAM, 0, 1, 0, "Slice mode", {"Off", "On"});
 
-		playBuffer.resize(0);
 		recordBuffer.resize(0);
+		// the UI reader goes online with the widget
+		sample.offline(UI_READER);
+		worker = thread(&CANARD::runEdits, this);
+	}
+
+	~CANARD() {
+		running = false;
+		editCondition.notify_one();
+		worker.join();
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void calcLoop();
+	// process() is not called while bypassed, so the audio reader leaves the
+	// sample readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		sample.offline(AUDIO_READER);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
+	void runEdits();
+	void applyEdit(CANARDSample &s, int id);
+	void postEdit(std::function<void(CANARDSample&)> edit);
+	void calcLoop(const std::vector<int> &slices);
 	void initPos();
-	void loadSample();
-	void saveSample();
+	void loadSample(std::vector<int> restoredSlices = std::vector<int>());
+	void saveSample(std::string path);
 	void calcTransients();
+	void deleteSlice();
+	void insertSliceMarker();
+	void removeSliceMarker();
 
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		// lastPath
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
 		json_t *slicesJ = json_array();
+		// may run without a UI, keep the writer from freeing the sample meanwhile
+		std::lock_guard<std::mutex> lock(editLock);
+		std::vector<int> &slices = sample.acquire()->slices;
 		for (size_t i = 0; i<slices.size() ; i++) {
 			json_t *sliceJ = json_integer(slices[i]);
 			json_array_append_new(slicesJ, sliceJ);
@@ -133,18 +187,17 @@ struct CANARD : BidooModule {
 			lastPath = json_string_value(lastPathJ);
 			waveFileName = rack::system::getFilename(lastPath);
 			waveExtension = rack::system::getExtension(lastPath);
-			if (!lastPath.empty()) loadSample();
-			if (totalSampleCount>0) {
-				json_t *slicesJ = json_object_get(rootJ, "slices");
-				if (slicesJ) {
-					size_t i;
-					json_t *sliceJ;
-					json_array_foreach(slicesJ, i, sliceJ) {
-							if (i != 0)
-								slices.push_back(json_integer_value(sliceJ));
-					}
+			std::vector<int> slices;
+			json_t *slicesJ = json_object_get(rootJ, "slices");
+			if (slicesJ) {
+				size_t i;
+				json_t *sliceJ;
+				json_array_foreach(slicesJ, i, sliceJ) {
+						if (i != 0)
+							slices.push_back(json_integer_value(sliceJ));
 				}
 			}
+			if (!lastPath.empty()) loadSample(slices);
 		}
 	}
 
@@ -153,25 +206,22 @@ struct CANARD : BidooModule {
 	}
 };
 
-void CANARD::calcTransients() {
-	slices.clear();
-	slices.push_back(0);
+void tCalcTransients(CANARD::CANARDSample &s, float threshold) {
+	const vector<dsp::Frame<2>> &playBuffer = *s.frames;
+	int totalSampleCount = playBuffer.size();
+	s.slices.clear();
+	s.slices.push_back(0);
 	int i = 0;
 	int size = 256;
-	vector<dsp::Frame<2>>::const_iterator first;
-	vector<dsp::Frame<2>>::const_iterator last;
 	float prevNrgy = 0.0f;
 	while (i+size<totalSampleCount) {
-		first = playBuffer.begin() + i;
-		last = playBuffer.begin() + i + size;
-		vector<dsp::Frame<2>> newVec(first, last);
 		float nrgy = 0.0f;
 		float zcRate = 0.0f;
 		unsigned int zcIdx = 0;
 		bool first = true;
 		for (int k = 0; k < size; k++) {
-			nrgy += 100*newVec[k].samples[0]*newVec[k].samples[0]/size;
-			if (newVec[k].samples[0]==0.0f) {
+			nrgy += 100*playBuffer[i+k].samples[0]*playBuffer[i+k].samples[0]/size;
+			if (playBuffer[i+k].samples[0]==0.0f) {
 				zcRate += 1;
 				if (first) {
 					zcIdx = k;
@@ -179,31 +229,164 @@ void CANARD::calcTransients() {
 				}
 			}
 		}
-		if ((nrgy > params[CANARD::THRESHOLD_PARAM].getValue()) && (nrgy > 10*prevNrgy))
-			slices.push_back(i+zcIdx);
+		if ((nrgy > threshold) && (nrgy > 10*prevNrgy))
+			s.slices.push_back(i+zcIdx);
 		i+=size;
 		prevNrgy = nrgy;
 	}
 }
 
-void CANARD::loadSample() {
-	APP->engine->yieldWorkers();
-	mylock.lock();
-	playBuffer = waves::getStereoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
-	mylock.unlock();
-	slices.clear();
-	loading = false;
+void tLoadSample(CANARD::CANARDSample &s, std::string path, float sampleRate) {
+	std::string waveFileName, waveExtension;
+	int sampleCount = 0;
+	s.frames = waves::getSharedStereoWav(path, sampleRate, waveFileName, waveExtension, s.channels, s.sampleRate, sampleCount).frames;
+	s.slices.clear();
+}
+
+void tDeleteSlice(CANARD::CANARDSample &s, int selected) {
+	if ((selected<0) || ((size_t)selected>=s.slices.size())) return;
+	int totalSampleCount = s.frames->size();
+	auto playBuffer = std::make_shared<vector<dsp::Frame<2>>>(*s.frames);
+	int nbSample=0;
+	if ((size_t)selected<(s.slices.size()-1)) {
+		nbSample = s.slices[selected + 1] - s.slices[selected] - 1;
+		playBuffer->erase(playBuffer->begin() + s.slices[selected], playBuffer->begin() + s.slices[selected + 1]-1);
+	}
+	else {
+		nbSample = totalSampleCount - s.slices[selected];
+		playBuffer->erase(playBuffer->begin() + s.slices[selected], playBuffer->end());
+	}
+	s.frames = std::move(playBuffer);
+	s.slices.erase(s.slices.begin()+selected);
+	for (size_t i = selected; i < s.slices.size(); i++)
+	{
+		s.slices[i] = s.slices[i]-nbSample;
+	}
+}
+
+void tInsertSliceMarker(CANARD::CANARDSample &s, int marker) {
+	if (std::find(s.slices.begin(), s.slices.end(), marker) == s.slices.end()) {
+		auto it = std::upper_bound(s.slices.begin(), s.slices.end(), marker);
+		s.slices.insert(it, marker);
+	}
+}
+
+void tRemoveSliceMarker(CANARD::CANARDSample &s, int marker) {
+	auto it = std::find(s.slices.begin(), s.slices.end(), marker);
+	if (it != s.slices.end()) {
+		s.slices.erase(it);
+	}
 }
 
-void CANARD::saveSample() {
-	APP->engine->yieldWorkers();
-	mylock.lock();
-	waves::saveWave(playBuffer, APP->engine->getSampleRate(), lastPath);
-	mylock.unlock();
-	save = false;
+void CANARD::runEdits() {
+	while (running) {
+		std::deque<std::function<void(CANARDSample&)>> edits;
+		{
+			std::unique_lock<std::mutex> lock(mylock);
+			editCondition.wait_for(lock, std::chrono::milliseconds(10));
+			edits.swap(uiEdits);
+		}
+
+		std::lock_guard<std::mutex> lock(editLock);
+		CANARDSample *s = NULL;
+		while (!audioEdits.empty()) {
+			if (!s) s = new CANARDSample(*sample.acquire());
+			applyEdit(*s, audioEdits.shift());
+		}
+		for (auto &edit : edits) {
+			if (!s) s = new CANARDSample(*sample.acquire());
+			edit(*s);
+		}
+		if (s) {
+			sample.publish(s);
+		}
+		else {
+			sample.collect();
+		}
+	}
+}
+
+void CANARD::applyEdit(CANARDSample &s, int id) {
+	switch (id) {
+		case CLEAR_EDIT:
+			s.frames = std::make_shared<const vector<dsp::Frame<2>>>();
+			s.slices.clear();
+			break;
+		case RECORD_EDIT:
+			s.slices.clear();
+			s.slices.push_back(0);
+			s.frames = std::make_shared<const vector<dsp::Frame<2>>>(recordBuffer);
+			recordBuffer.resize(0);
+			recordPending = false;
+			break;
+		case APPEND_RECORD_EDIT: {
+			auto playBuffer = std::make_shared<vector<dsp::Frame<2>>>(*s.frames);
+			s.slices.push_back(playBuffer->size() > 0 ? (playBuffer->size()-1) : 0);
+			playBuffer->insert(playBuffer->end(), recordBuffer.begin(), recordBuffer.end());
+			s.frames = std::move(playBuffer);
+			recordBuffer.resize(0);
+			recordPending = false;
+			break;
+		}
+	}
+}
+
+void CANARD::postEdit(std::function<void(CANARDSample&)> edit) {
+	{
+		std::lock_guard<std::mutex> lock(mylock);
+		uiEdits.push_back(edit);
+	}
+	editCondition.notify_one();
+}
+
+void CANARD::calcTransients() {
+	float threshold = params[CANARD::THRESHOLD_PARAM].getValue();
+	postEdit([threshold](CANARDSample &s) { tCalcTransients(s, threshold); });
 }
 
-void CANARD::calcLoop() {
+void CANARD::loadSample(std::vector<int> restoredSlices) {
+	std::string path = lastPath;
+	float sampleRate = APP->engine->getSampleRate();
+	loading = true;
+	postEdit([this, path, sampleRate, restoredSlices](CANARDSample &s) {
+		tLoadSample(s, path, sampleRate);
+		if (s.frames->size()>0) {
+			s.slices.insert(s.slices.end(), restoredSlices.begin(), restoredSlices.end());
+		}
+		loading = false;
+	});
+}
+
+void CANARD::saveSample(std::string path) {
+	float sampleRate = APP->engine->getSampleRate();
+	postEdit([path, sampleRate](CANARDSample &s) {
+		waves::saveWave(*s.frames, sampleRate, path);
+	});
+}
+
+void CANARD::deleteSlice() {
+	int sel = selected;
+	postEdit([sel](CANARDSample &s) { tDeleteSlice(s, sel); });
+	selected = -1;
+}
+
+void CANARD::insertSliceMarker() {
+	int marker = addSliceMarker;
+	if (marker>=0) {
+		postEdit([marker](CANARDSample &s) { tInsertSliceMarker(s, marker); });
+	}
+	addSliceMarker = -1;
+}
+
+void CANARD::removeSliceMarker() {
+	int marker = deleteSliceMarker;
+	if (marker>=0) {
+		postEdit([marker](CANARDSample &s) { tRemoveSliceMarker(s, marker); });
+		deleteSliceMarker = -1;
+	}
+}
+
+void CANARD::calcLoop(const std::vector<int> &slices) {
 	prevPlayedSlice = index;
 	index = 0;
 	int sliceStart = 0;;
@@ -241,131 +424,69 @@ void CANARD::initPos() {
 }
 
 void CANARD::process(const ProcessArgs &args) {
-	if (loading) {
-		loadSample();
-	}
-
-	if (save) {
-		saveSample();
+	if (!audioOnline) {
+		sample.online(AUDIO_READER);
+		audioOnline = true;
 	}
+	CANARDSample *s = sample.acquire();
+	const vector<dsp::Frame<2>> &playBuffer = *s->frames;
+	totalSampleCount = playBuffer.size();
 
 	if (clearTrigger.process(inputs[CLEAR_INPUT].getVoltage() + params[CLEAR_PARAM].getValue()))
 	{
-		mylock.lock();
-		playBuffer.clear();
-		totalSampleCount = 0;
-		slices.clear();
-		mylock.unlock();
+		if (!audioEdits.full()) audioEdits.push(CLEAR_EDIT);
 		lastPath = "";
 		waveFileName = "";
 		waveExtension = "";
 	}
 
-	if ((selected>=0) && (deleteFlag)) {
-		int nbSample=0;
-		if ((size_t)selected<(slices.size()-1)) {
-			nbSample = slices[selected + 1] - slices[selected] - 1;
-			mylock.lock();
-			playBuffer.erase(playBuffer.begin() + slices[selected], playBuffer.begin() + slices[selected + 1]-1);
-			mylock.unlock();
+	if (recordTrigger.process(inputs[RECORD_INPUT].getVoltage() + params[RECORD_PARAM].getValue()))
+	{
+		if(record) {
+			stopRecord = true;
 		}
-		else {
-			nbSample = totalSampleCount - slices[selected];
-			mylock.lock();
-			playBuffer.erase(playBuffer.begin() + slices[selected], playBuffer.end());
-			mylock.unlock();
-		}
-		slices.erase(slices.begin()+selected);
-		totalSampleCount = playBuffer.size();
-		for (size_t i = selected; i < slices.size(); i++)
-		{
-			slices[i] = slices[i]-nbSample;
+		else if (!recordPending && !audioEdits.full()) {
+			record = true;
 		}
-		selected = -1;
-		deleteFlag = false;
-		calcLoop();
 	}
 
-	if ((addSliceMarker>=0) && (addSliceMarkerFlag)) {
-		if (std::find(slices.begin(), slices.end(), addSliceMarker) != slices.end()) {
-			addSliceMarker = -1;
-			addSliceMarkerFlag = false;
+	// if the worker stalled and the edit ring is full, keep recording and
+	// retry on the next sample
+	if (stopRecord && !audioEdits.full()) {
+		// the worker owns recordBuffer until it has merged it
+		recordPending = true;
+		if (floor(params[MODE_PARAM].getValue()) == 0) {
+			audioEdits.push(RECORD_EDIT);
+			lastPath = "";
+			waveFileName = "";
+			waveExtension = "";
 		}
 		else {
-			auto it = std::upper_bound(slices.begin(), slices.end(), addSliceMarker);
-			mylock.lock();
-			slices.insert(it, addSliceMarker);
-			mylock.unlock();
-			addSliceMarker = -1;
-			addSliceMarkerFlag = false;
-			calcLoop();
-		}
-	}
-
-	if ((deleteSliceMarker>=0) && (deleteSliceMarkerFlag)) {
-		if (std::find(slices.begin(), slices.end(), deleteSliceMarker) != slices.end()) {
-			mylock.lock();
-			slices.erase(std::find(slices.begin(), slices.end(), deleteSliceMarker));
-			mylock.unlock();
-			deleteSliceMarker = -1;
-			deleteSliceMarkerFlag = false;
-			calcLoop();
-		}
-	}
-
-	if (recordTrigger.process(inputs[RECORD_INPUT].getVoltage() + params[RECORD_PARAM].getValue()))
-	{
-		if(record) {
-			if (floor(params[MODE_PARAM].getValue()) == 0) {
-				mylock.lock();
-				slices.clear();
-				slices.push_back(0);
-				playBuffer.resize(0);
-				for (int i = 0; i < (int)recordBuffer.size(); i++) {
-					dsp::Frame<2> frame = recordBuffer[i];
-					playBuffer.push_back(frame);
-				}
-				totalSampleCount = playBuffer.size();
-				mylock.unlock();
-				lastPath = "";
-				waveFileName = "";
-				waveExtension = "";
-			}
-			else {
-				mylock.lock();
-				slices.push_back(totalSampleCount > 0 ? (totalSampleCount-1) : 0);
-				playBuffer.insert(playBuffer.end(), recordBuffer.begin(), recordBuffer.end());
-				totalSampleCount = playBuffer.size();
-				mylock.unlock();
-			}
-			mylock.lock();
-			recordBuffer.resize(0);
-			mylock.unlock();
-			lights[REC_LIGHT].setBrightness(0.0f);
+			audioEdits.push(APPEND_RECORD_EDIT);
 		}
-		record = !record;
+		lights[REC_LIGHT].setBrightness(0.0f);
+		record = false;
+		stopRecord = false;
 	}
 
 	if (record) {
 		lights[REC_LIGHT].setBrightness(10.0f);
-		mylock.lock();
 		dsp::Frame<2> frame;
 		frame.samples[0] = inputs[INL_INPUT].getVoltage()/10.0f;
 		frame.samples[1] = inputs[INR_INPUT].getVoltage()/10.0f;
 		recordBuffer.push_back(frame);
-		mylock.unlock();
 	}
 
 	int trigMode = inputs[TRIG_INPUT].isConnected() ? 1 : (inputs[GATE_INPUT].isConnected() ? 2 : 0);
 	int readMode = round(clamp(inputs[READ_MODE_INPUT].getVoltage() + params[READ_MODE_PARAM].getValue(),0.0f,2.0f));
 	speed = inputs[SPEED_INPUT].getVoltage() + params[SPEED_PARAM].getValue();
-	calcLoop();
+	calcLoop(s->slices);
 
 	if (trigMode == 1) {
 		if (trigTrigger.process(inputs[TRIG_INPUT].getVoltage()) && (prevTrigState == 0.0f))
 		{
 			initPos();
-			if ((slices.size() == 1) && (inputs[SLICE_INPUT].isConnected())) {
+			if ((s->slices.size() == 1) && (inputs[SLICE_INPUT].isConnected())) {
 				samplePos = sampleStart + loopLength * rescale(clamp(params[SLICE_PARAM].getValue() + inputs[SLICE_INPUT].getVoltage(), 0.0f,10.0f),0.0f,10.0f,0.0f,1.0f);
 			}
 			play = true;
@@ -479,6 +600,8 @@ void CANARD::process(const ProcessArgs &args) {
 	}
 
 	outputs[EOC_OUTPUT].setVoltage(eocPulse.process(1 / args.sampleRate) ? 10.0f : 0.0f);
+
+	sample.quiescent(AUDIO_READER);
 }
 
 struct BidooTransientsBlueTrimpot : BidooBlueTrimpot {
@@ -506,12 +629,13 @@ struct CANARDDisplay : OpaqueWidget {
 	}
 
 	void onButton(const event::Button &e) override {
-		if (module->slices.size()>0) {
+		CANARD::CANARDSample *sample = module->sample.acquire();
+		if (sample->slices.size()>0) {
 			refX = e.pos.x;
-			refIdx = ((e.pos.x - zoomLeftAnchor)/zoomWidth)*(float)module->totalSampleCount;
+			refIdx = ((e.pos.x - zoomLeftAnchor)/zoomWidth)*(float)sample->frames->size();
 			module->addSliceMarker = refIdx;
-			auto lower = std::lower_bound(module->slices.begin(), module->slices.end(), refIdx);
-			module->selected = distance(module->slices.begin(),lower-1);
+			auto lower = std::lower_bound(sample->slices.begin(), sample->slices.end(), refIdx);
+			module->selected = distance(sample->slices.begin(),lower-1);
 			module->deleteSliceMarker = *(lower-1);
 		}
 		if (e.button == 0)
@@ -550,17 +674,11 @@ struct CANARDDisplay : OpaqueWidget {
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
-			if (module && (module->playBuffer.size()>0)) {
-				module->mylock.lock();
-				std::vector<float> vL;
-				std::vector<float> vR;
-				for (int i=0;i<module->totalSampleCount;i++) {
-					vL.push_back(module->playBuffer[i].samples[0]);
-					vR.push_back(module->playBuffer[i].samples[1]);
-				}
-				std::vector<int> s(module->slices);
-				module->mylock.unlock();
-				size_t nbSample = vL.size();
+			if (module && (module->sample.acquire()->frames->size()>0)) {
+				CANARD::CANARDSample *sample = module->sample.acquire();
+				const vector<dsp::Frame<2>> &frames = *sample->frames;
+				const std::vector<int> &s = sample->slices;
+				size_t nbSample = frames.size();
 
 				// Draw play line
 				if (!module->loading) {
@@ -602,14 +720,14 @@ struct CANARDDisplay : OpaqueWidget {
 				}
 				nvgStroke(args.vg);
 
-				if ((!module->loading) && (vL.size()>0)) {
+				if ((!module->loading) && (nbSample>0)) {
 					// Draw loop
 					nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 60));
 					nvgStrokeWidth(args.vg, 1);
 					{
 						nvgBeginPath(args.vg);
 						nvgMoveTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
-						nvgLineTo(args.vg, module->sampleStart * zoomWidth / vL.size() + zoomLeftAnchor, 2*height+10);
+						nvgLineTo(args.vg, module->sampleStart * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
 						nvgLineTo(args.vg, (module->sampleStart + module->loopLength) * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
 						nvgLineTo(args.vg, (module->sampleStart + module->loopLength - module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
 						nvgLineTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
@@ -643,12 +761,12 @@ struct CANARDDisplay : OpaqueWidget {
 					Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, height));
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					float invNbSample = 1.0f / nbSample;
-					size_t inc = std::max(vL.size()/zoomWidth/4,1.f);
+					size_t inc = std::max(nbSample/zoomWidth/4,1.f);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < vL.size(); i+=inc) {
+					for (size_t i = 0; i < nbSample; i+=inc) {
 						float x, y;
 						x = (float)i * invNbSample ;
-						y = (-1.f)*vL[i] * 0.5f + 0.5f;
+						y = (-1.f)*frames[i].samples[0] * 0.5f + 0.5f;
 						Vec p;
 						p.x = b.pos.x + b.size.x * x;
 						p.y = b.pos.y + b.size.y * (1.0f - y);
@@ -668,10 +786,10 @@ struct CANARDDisplay : OpaqueWidget {
 					b = Rect(Vec(zoomLeftAnchor, height+10), Vec(zoomWidth, height));
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < vR.size(); i+=inc) {
+					for (size_t i = 0; i < nbSample; i+=inc) {
 						float x, y;
 						x = (float)i * invNbSample;
-						y = (-1.f)*vR[i] * 0.5f + 0.5f;
+						y = (-1.f)*frames[i].samples[1] * 0.5f + 0.5f;
 						Vec p;
 						p.x = b.pos.x + b.size.x * x;
 						p.y = b.pos.y + b.size.y * (1.0f - y);
@@ -721,9 +839,19 @@ struct CANARDDisplay : OpaqueWidget {
 };
 
 struct CANARDWidget : BidooWidget {
+	// the UI only reads the sample while this widget exists
+	~CANARDWidget() {
+		CANARD *module = dynamic_cast<CANARD*>(this->module);
+		if (module) {
+			module->sample.offline(CANARD::UI_READER);
+		}
+	}
 
 	CANARDWidget(CANARD *module) {
 		setModule(module);
+		if (module) {
+			module->sample.online(CANARD::UI_READER);
+		}
 		prepareThemes(asset::plugin(pluginInstance, "res/CANARD.svg"));
 
 		addChild(createWidget<ScrewSilver>(Vec(15, 0)));
@@ -781,28 +909,27 @@ struct CANARDWidget : BidooWidget {
 	struct CANARDDeleteSlice : MenuItem {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
-			module->deleteFlag = true;
+			module->deleteSlice();
 		}
 	};
 
 	struct CANARDDeleteSliceMarker : MenuItem {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
-			module->deleteSliceMarkerFlag = true;
+			module->removeSliceMarker();
 		}
 	};
 
 	struct CANARDAddSliceMarker : MenuItem {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
-			module->addSliceMarkerFlag = true;
+			module->insertSliceMarker();
 		}
 	};
 
 	struct CANARDTransientDetect : MenuItem {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
-			APP->engine->yieldWorkers();
 			module->calcTransients();
 		}
 	};
@@ -825,7 +952,9 @@ struct CANARDWidget : BidooWidget {
 		static void pathSelected(CANARD *module, char* path) {
 			if (path) {
 				module->lastPath = path;
-				module->loading=true;
+				module->waveFileName = rack::system::getFilename(module->lastPath);
+				module->waveExtension = rack::system::getExtension(module->lastPath);
+				module->loadSample();
 				free(path);
 			}
 		}
@@ -835,7 +964,17 @@ struct CANARDWidget : BidooWidget {
 		Widget::onPathDrop(e);
 		CANARD *module = dynamic_cast<CANARD*>(this->module);
 		module->lastPath = e.paths[0];
-		module->loading=true;
+		module->waveFileName = rack::system::getFilename(module->lastPath);
+		module->waveExtension = rack::system::getExtension(module->lastPath);
+		module->loadSample();
+	}
+
+	void step() override {
+		CANARD *module = dynamic_cast<CANARD*>(this->module);
+		if (module) {
+			module->sample.quiescent(CANARD::UI_READER);
+		}
+		BidooWidget::step();
 	}
 
 	struct CANARDSaveSample : MenuItem {
@@ -857,7 +996,7 @@ struct CANARDWidget : BidooWidget {
 		static void pathSelected(CANARD *module, char* path) {
 			if (path) {
 				module->lastPath = path;
-				if (!module->save) module->save = true;
+				module->saveSample(module->lastPath);
 				free(path);
 			}
 		}
@@ -13,8 +13,10 @@ Based on Laurent de Soras resampler for pitch shifting
 #include "cmath"
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
 #include <mutex>
 #include "dep/waves.hpp"
+#include "dep/rcu.hpp"
 
 #include	"dep/resampler/def.h"
 #include	"dep/resampler/Downsampler2Flt.h"
@@ -92,23 +94,39 @@ struct EDSAROS : BidooModule {
     ZEROCROSSING_LIGHT,
 		NUM_LIGHTS
 	};
+	enum BankReaderIds {
+		AUDIO_READER,
+		UI_READER,
+		NUM_READERS
+	};
+
+	// Loaded sample and the mipmaps the voices read from, built outside of
+	// process() and swapped in whole.
+	struct EDSAROSBank {
+		waves::Sample<1> source;
+		std::vector<float> sample;
+		std::vector<int> zeroCrossings;
+		rspl::MipMapFlt	mip_map;
+		rspl::MipMapFlt	rev_mip_map;
+		int totalSampleCount = 0;
+		unsigned long serial = 0;
+	};
 
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
-	vector<dsp::Frame<1>> loadingBuffer;
 	int channels=0;
   int sampleRate=0;
   int totalSampleCount=0;
 	rspl::InterpPack interp_pack;
-	rspl::MipMapFlt	mip_map;
-	rspl::MipMapFlt	rev_mip_map;
+	rcu::Pointer<EDSAROSBank, NUM_READERS> bank{new EDSAROSBank()};
+	EDSAROSBank *playingBank = NULL;
+	unsigned long bankSerial = 0;
+	unsigned long playingSerial = 0;
 	rspl::ResamplerFlt voices[16];
 	rspl::ResamplerFlt rev_voices[16];
-	float *sample = NULL;
-	float *rev_sample = NULL;
-	bool loading = false;
 	std::mutex mylock;
+	bool audioOnline = false;
 	int pos = 0;
 	dsp::DoubleRingBuffer<float,SIZE> audio[16];
 	bool play[16] = {false};
@@ -123,6 +141,11 @@ struct EDSAROS : BidooModule {
 	int loopStart=0;
 	int loopEnd=0;
 	int releaseStart=0;
+	float pointsStart = -1.0f;
+	float pointsInputs[4] = {-1.0f, -1.0f, -1.0f, -1.0f};
+	float pointsLinkType = -1.0f;
+	bool pointsZeroCrossing = false;
+	unsigned long pointsSerial = 0;
 	int loopMode=0;
 	int releaseMode=0;
 	bool snap = true;
@@ -136,6 +159,31 @@ struct EDSAROS : BidooModule {
 	float releaseSlope = 0.0f;
 	float init = 0.0f;
 	float peak = 0.0f;
+	// Bezier envelope segment expanded to a cubic in u = (t - start) / length
+	struct EnvSegment {
+		float start = 0.0f;
+		float invLength = 0.0f;
+		float c0 = 0.0f, c1 = 0.0f, c2 = 0.0f, c3 = 0.0f;
+
+		void set(const float s, const float length, const float y1, const float y2, const float y3) {
+			start = s;
+			invLength = length>0 ? 1.0f/length : 0.0f;
+			c0 = y1;
+			c1 = 3.0f*(y2-y1);
+			c2 = 3.0f*(y1-y2);
+			c3 = y3-y1;
+		}
+
+		template <typename T>
+		T eval(const T t) const {
+			T u = (t-start)*invLength;
+			return ((c3*u + c2)*u + c1)*u + c0;
+		}
+	};
+
+	EnvSegment attackSegment;
+	EnvSegment decaySegment;
+	EnvSegment releaseSegment;
 	float voiceTime[16] = {0.0f};
 	bool rel[16] = {false};
 	float gain[16] = {0.0f};
@@ -167,15 +215,21 @@ struct EDSAROS : BidooModule {
 
     configParam(GAIN_PARAM, 1.0f, 10.0f, 1.0f, "Sample gain");
     configParam(ZEROCROSSING_PARAM, 0.0f, 1.0f, 0.0f, "Zero crossing");
-	}
 
-	~EDSAROS() {
-		free(sample);
-		free(rev_sample);
+		// the UI reader goes online with the widget
+		bank.offline(UI_READER);
 	}
 
 	void process(const ProcessArgs &args) override;
 
+	// process() is not called while bypassed, so the audio reader leaves the
+	// bank readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		bank.offline(AUDIO_READER);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
 	void loadSample();
 
 	json_t *dataToJson() override {
@@ -207,33 +261,43 @@ struct EDSAROS : BidooModule {
 		return t3*x3 + (A+B)*x2 + C*x1;
 	}
 
-	float getYBez(const float t, const float y1, const float y2, const float y3) {
-		float t2 = t * t;
-		float t3 = t * t * t;
-
-		float A = (3*t2 - 3*t3);
-		float B = (3*t3 - 6*t2 + 3*t);
-		float C = (3*t2 - t3 - 3*t + 1);
-
-		return t3*y3 + (A+B)*y2 + C*y1;
+	void updateEnvelope() {
+		attackSegment.set(0.0f, attack, init, attackSlope*(peak-init)+init, peak);
+		decaySegment.set(attack, decay, peak, decaySlope*(sustain-peak)+peak, sustain);
+		releaseSegment.set(0.0f, release, sustain, releaseSlope*sustain, 0.0f);
 	}
 
 	float getEnv(const float t,const bool r) {
 		if (attack>0 && t>=0.0f && t<=attack && !r) {
-			return getYBez(t/attack,init,attackSlope*(peak-init)+init,peak);
+			return attackSegment.eval(t);
 		}
 		else if (decay>0 && t>attack && t<=(attack+decay) && !r) {
-			return getYBez((t-attack)/decay,peak,decaySlope*(sustain-peak)+peak,sustain);
+			return decaySegment.eval(t);
 		}
-		else if (r && t<=release) {
-			return getYBez(t/release,sustain,releaseSlope*sustain,0.0f);
+		else if (r && release>0 && t<=release) {
+			return releaseSegment.eval(t);
 		}
-		else if (r && t>release) {
+		else if (r) {
 			return 0.0f;
 		}
 		return sustain;
 	}
 
+	// same as above for four voices, r is a lane mask
+	simd::float_4 getEnv(const simd::float_4 t, const simd::float_4 r) {
+		simd::float_4 env = simd::ifelse(r, simd::float_4::zero(), simd::float_4(sustain));
+		if (release>0) {
+			env = simd::ifelse(r & (t <= release), releaseSegment.eval(t), env);
+		}
+		if (decay>0) {
+			env = simd::ifelse(~r & (t > attack) & (t <= (attack+decay)), decaySegment.eval(t), env);
+		}
+		if (attack>0) {
+			env = simd::ifelse(~r & (t >= 0.0f) & (t <= attack), attackSegment.eval(t), env);
+		}
+		return env;
+	}
+
 	void onSampleRateChange() override {
 		if (!lastPath.empty()) loadSample();
 	}
@@ -241,17 +305,15 @@ struct EDSAROS : BidooModule {
 	int getSnappedIndex(float p, bool forward, bool zercoCross) {
 		int idx = p*(totalSampleCount-1)*0.1f;
     if (!zeroCrossing) return idx;
+		const std::vector<int> &crossings = playingBank->zeroCrossings;
 		if (forward) {
-			while ((sample[idx]*sample[idx+1])>0 && (idx<totalSampleCount-1)) {
-				idx=idx+1;
-			}
+			auto it = std::lower_bound(crossings.begin(), crossings.end(), idx);
+			return it != crossings.end() ? *it : totalSampleCount-1;
 		}
 		else {
-			while ((sample[idx]*sample[idx+1])>0 && (idx>=0)) {
-				idx=idx-1;
-			}
+			auto it = std::upper_bound(crossings.begin(), crossings.end(), idx);
+			return it != crossings.begin() ? *(it-1) : 0;
 		}
-		return idx;
 	}
 
 	int revIndex(const int i) {
@@ -260,55 +322,69 @@ struct EDSAROS : BidooModule {
 
 	void updatePoints() {
     if (totalSampleCount>0) {
-        sampleStart = getSnappedIndex(clamp(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage(),0.0f,10.0f), true, zeroCrossing);
-        if (params[LINKTYPE_PARAM].getValue()==0.0f) {
-          sampleEnd = std::max(getSnappedIndex(clamp(params[SAMPLEEND_PARAM].getValue()+inputs[SAMPLEEND_INPUT].getVoltage(),0.0f,10.0f), false, zeroCrossing), sampleStart);
-          loopStart = std::min(std::max(getSnappedIndex(clamp(params[LOOPSTART_PARAM].getValue()+inputs[LOOPSTART_INPUT].getVoltage(),0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-          loopEnd = std::min(std::max(getSnappedIndex(clamp(params[LOOPEND_PARAM].getValue()+inputs[LOOPEND_INPUT].getVoltage(),0.0f,10.0f), false, zeroCrossing), loopStart), sampleEnd);
-          releaseStart = std::min(std::max(getSnappedIndex(clamp(params[RELEASESTART_PARAM].getValue()+inputs[RELEASESTART_INPUT].getVoltage(),0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-        }
-        else if (params[LINKTYPE_PARAM].getValue()==1.0f) {
-          sampleEnd = std::max(getSnappedIndex(clamp(params[SAMPLEEND_PARAM].getValue()+inputs[SAMPLEEND_INPUT].getVoltage()+params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage(),0.0f,10.0f), false, zeroCrossing), sampleStart);
-          loopStart = std::min(std::max(getSnappedIndex(clamp(params[LOOPSTART_PARAM].getValue()+inputs[LOOPSTART_INPUT].getVoltage()+params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage(),0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-          loopEnd = std::min(std::max(getSnappedIndex(clamp(params[LOOPEND_PARAM].getValue()+inputs[LOOPEND_INPUT].getVoltage()+params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage(),0.0f,10.0f), false, zeroCrossing), loopStart), sampleEnd);
-          releaseStart = std::min(std::max(getSnappedIndex(clamp(params[RELEASESTART_PARAM].getValue()+inputs[RELEASESTART_INPUT].getVoltage()+params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage(),0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-        }
-        else if (params[LINKTYPE_PARAM].getValue()==2.0f) {
-          float coef = 1+(float)sampleStart/(float)totalSampleCount;
-          sampleEnd = std::max(getSnappedIndex(clamp(params[SAMPLEEND_PARAM].getValue()+inputs[SAMPLEEND_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), false, zeroCrossing), sampleStart);
-          loopStart = std::min(std::max(getSnappedIndex(clamp(params[LOOPSTART_PARAM].getValue()+inputs[LOOPSTART_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-          loopEnd = std::min(std::max(getSnappedIndex(clamp(params[LOOPEND_PARAM].getValue()+inputs[LOOPEND_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), false, zeroCrossing), loopStart), sampleEnd);
-          releaseStart = std::min(std::max(getSnappedIndex(clamp(params[RELEASESTART_PARAM].getValue()+inputs[RELEASESTART_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-        }
-        else {
-          float coef = 1-(float)sampleStart/(float)totalSampleCount;
-          sampleEnd = std::max(getSnappedIndex(clamp(params[SAMPLEEND_PARAM].getValue()+inputs[SAMPLEEND_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), false, zeroCrossing), sampleStart);
-          loopStart = std::min(std::max(getSnappedIndex(clamp(params[LOOPSTART_PARAM].getValue()+inputs[LOOPSTART_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-          loopEnd = std::min(std::max(getSnappedIndex(clamp(params[LOOPEND_PARAM].getValue()+inputs[LOOPEND_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), false, zeroCrossing), loopStart), sampleEnd);
-          releaseStart = std::min(std::max(getSnappedIndex(clamp(params[RELEASESTART_PARAM].getValue()+inputs[RELEASESTART_INPUT].getVoltage()+(params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage())*coef,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
-        }
+      float start = params[SAMPLESTART_PARAM].getValue()+inputs[SAMPLESTART_INPUT].getVoltage();
+      float point[4] = {
+        params[SAMPLEEND_PARAM].getValue()+inputs[SAMPLEEND_INPUT].getVoltage(),
+        params[LOOPSTART_PARAM].getValue()+inputs[LOOPSTART_INPUT].getVoltage(),
+        params[LOOPEND_PARAM].getValue()+inputs[LOOPEND_INPUT].getVoltage(),
+        params[RELEASESTART_PARAM].getValue()+inputs[RELEASESTART_INPUT].getVoltage()
+      };
+      float linkType = params[LINKTYPE_PARAM].getValue();
+
+      // points only move with their knobs, CVs, link mode or a new sample
+      if ((start == pointsStart) && std::equal(point, point+4, pointsInputs) && (linkType == pointsLinkType)
+        && (zeroCrossing == pointsZeroCrossing) && (playingSerial == pointsSerial)) return;
+      pointsStart = start;
+      std::copy(point, point+4, pointsInputs);
+      pointsLinkType = linkType;
+      pointsZeroCrossing = zeroCrossing;
+      pointsSerial = playingSerial;
+
+      sampleStart = getSnappedIndex(clamp(start,0.0f,10.0f), true, zeroCrossing);
+      float offset;
+      if (linkType==0.0f) {
+        offset = 0.0f;
+      }
+      else if (linkType==1.0f) {
+        offset = start;
+      }
+      else if (linkType==2.0f) {
+        offset = start*(1+(float)sampleStart/(float)totalSampleCount);
       }
+      else {
+        offset = start*(1-(float)sampleStart/(float)totalSampleCount);
+      }
+      sampleEnd = std::max(getSnappedIndex(clamp(point[0]+offset,0.0f,10.0f), false, zeroCrossing), sampleStart);
+      loopStart = std::min(std::max(getSnappedIndex(clamp(point[1]+offset,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
+      loopEnd = std::min(std::max(getSnappedIndex(clamp(point[2]+offset,0.0f,10.0f), false, zeroCrossing), loopStart), sampleEnd);
+      releaseStart = std::min(std::max(getSnappedIndex(clamp(point[3]+offset,0.0f,10.0f), true, zeroCrossing), sampleStart), sampleEnd);
     }
+  }
 
 };
 
 void EDSAROS::loadSample() {
-	APP->engine->yieldWorkers();
-	mylock.lock();
-	loadingBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
-	if (loadingBuffer.size()>0) {
-		sample = new float[2*totalSampleCount];
-		rev_sample = new float[2*totalSampleCount];
-
-		for (int i=0; i<totalSampleCount; i++) {
-			sample[i]=loadingBuffer[i].samples[0];
-			sample[i+totalSampleCount]=loadingBuffer[i].samples[0];
-			rev_sample[i]=loadingBuffer[totalSampleCount-i-1].samples[0];
-			rev_sample[i+totalSampleCount]=loadingBuffer[totalSampleCount-i-1].samples[0];
+	EDSAROSBank *b = new EDSAROSBank();
+	int count = 0;
+	b->source = waves::getSharedMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, count);
+	if (b->source.size()>0) {
+		b->totalSampleCount = count;
+		b->sample.resize(2*count);
+		std::vector<float> rev_sample(2*count);
+
+		for (int i=0; i<count; i++) {
+			b->sample[i]=b->source[i].samples[0];
+			b->sample[i+count]=b->source[i].samples[0];
+			rev_sample[i]=b->source[count-i-1].samples[0];
+			rev_sample[i+count]=b->source[count-i-1].samples[0];
 		}
 
-		mip_map.init_sample (
-			2*totalSampleCount,
+		for (int i=0; i<count; i++) {
+			if ((b->sample[i]*b->sample[i+1])<=0) b->zeroCrossings.push_back(i);
+		}
+
+		b->mip_map.init_sample (
+			2*count,
 			rspl::InterpPack::get_len_pre (),
 			rspl::InterpPack::get_len_post (),
 			12,
@@ -316,10 +392,10 @@ void EDSAROS::loadSample() {
 			rspl::ResamplerFlt::MIP_MAP_FIR_LEN
 		);
 
-		mip_map.fill_sample (&sample[0], 2*totalSampleCount);
+		b->mip_map.fill_sample (&b->sample[0], 2*count);
 
-		rev_mip_map.init_sample (
-			2*totalSampleCount,
+		b->rev_mip_map.init_sample (
+			2*count,
 			rspl::InterpPack::get_len_pre (),
 			rspl::InterpPack::get_len_post (),
 			12,
@@ -327,26 +403,36 @@ void EDSAROS::loadSample() {
 			rspl::ResamplerFlt::MIP_MAP_FIR_LEN
 		);
 
-		rev_mip_map.fill_sample (&rev_sample[0], 2*totalSampleCount);
-
-		for (int i=0; i<16; i++) {
-			voices[i].set_sample (mip_map);
-			voices[i].set_interp (interp_pack);
-			voices[i].clear_buffers ();
-			rev_voices[i].set_sample (rev_mip_map);
-			rev_voices[i].set_interp (interp_pack);
-			rev_voices[i].clear_buffers ();
-		}
-
+		b->rev_mip_map.fill_sample (&rev_sample[0], 2*count);
 	}
 
+	mylock.lock();
+	b->serial = ++bankSerial;
+	bank.publish(b);
 	mylock.unlock();
-	loading = false;
 }
 
 void EDSAROS::process(const ProcessArgs &args) {
-	if (loading) {
-		loadSample();
+	if (!audioOnline) {
+		bank.online(AUDIO_READER);
+		audioOnline = true;
+	}
+	// banks are compared by serial, a new one may reuse a freed address
+	EDSAROSBank *b = bank.acquire();
+	playingBank = b;
+	if (b->serial != playingSerial) {
+		playingSerial = b->serial;
+		totalSampleCount = b->totalSampleCount;
+		if (totalSampleCount>0) {
+			for (int i=0; i<16; i++) {
+				voices[i].set_sample (b->mip_map);
+				voices[i].set_interp (interp_pack);
+				voices[i].clear_buffers ();
+				rev_voices[i].set_sample (b->rev_mip_map);
+				rev_voices[i].set_interp (interp_pack);
+				rev_voices[i].clear_buffers ();
+			}
+		}
 	}
 
   if (zeroCrossingTrigger.process(params[ZEROCROSSING_PARAM].getValue())) {
@@ -365,10 +451,12 @@ void EDSAROS::process(const ProcessArgs &args) {
 	decaySlope = clamp(params[DECAYSLOPE_PARAM].getValue()+rescale(inputs[DECAYSLOPE_INPUT].getVoltage(),-10.0f,10.0f,-1.0f,1.0f),-1.0f,1.0f);
 	releaseSlope = clamp(params[RELEASESLOPE_PARAM].getValue()+rescale(inputs[RELEASESLOPE_INPUT].getVoltage(),-10.0f,10.0f,-1.0f,1.0f),-1.0f,1.0f);
 
+	updateEnvelope();
 	updatePoints();
 
 	if (totalSampleCount>0) {
-		for (int i=0; i<inputs[PITCH_INPUT].getChannels(); i++) {
+		int nbVoices = inputs[PITCH_INPUT].getChannels();
+		for (int i=0; i<nbVoices; i++) {
 			if (inputs[TRIG_INPUT].getVoltage(i)>0.5f) {
 				if (!play[i]) {
 					voiceTime[i]=0.0f;
@@ -393,9 +481,15 @@ void EDSAROS::process(const ProcessArgs &args) {
 					direction[i]=1;
 				}
 			}
+		}
 
-			gain[i] = getEnv(voiceTime[i],rel[i]);
+		for (int c=0; c<nbVoices; c+=4) {
+			simd::float_4 r = simd::float_4(rel[c], rel[c+1], rel[c+2], rel[c+3]) != simd::float_4::zero();
+			getEnv(simd::float_4::load(&voiceTime[c]), r).store(&gain[c]);
+		}
 
+		float voiceOut[16] = {0.0f};
+		for (int i=0; i<nbVoices; i++) {
 			if (audio[i].size()==0) { feed[i] = true;}
 
 			internalIntegerPosition[i] = voices[i].get_playback_pos() >> 32;
@@ -468,11 +562,7 @@ void EDSAROS::process(const ProcessArgs &args) {
               nbr_spl = SIZE;
             }
             if (nbr_spl>0) {
-              float *buff = new float[nbr_spl];
-  						voices[i].interpolate_block(buff, nbr_spl);
-              for (int j=0; j<nbr_spl; j++) {
-    						*(audio[i].endData()+j) = buff[j];
-    					}
+  						voices[i].interpolate_block(audio[i].endData(), nbr_spl);
     					audio[i].endIncr(nbr_spl);
             }
 					}
@@ -488,11 +578,7 @@ void EDSAROS::process(const ProcessArgs &args) {
               nbr_spl = SIZE;
             }
             if (nbr_spl>0) {
-              float *buff = new float[nbr_spl];
-              rev_voices[i].interpolate_block(buff, nbr_spl);
-              for (int j=0; j<nbr_spl; j++) {
-                *(audio[i].endData()+j) = buff[j];
-              }
+              rev_voices[i].interpolate_block(audio[i].endData(), nbr_spl);
               audio[i].endIncr(nbr_spl);
             }
 					}
@@ -511,22 +597,21 @@ void EDSAROS::process(const ProcessArgs &args) {
 			voiceTime[i]+= play[i] || rel[i] ? args.sampleTime : 0.0f;
 
 			if (audio[i].size()>=1) {
-				if (((loopStart==loopEnd) && (internalIntegerPosition[i]>=loopStart)) || ((releaseStart==sampleEnd) && (internalIntegerPosition[i]>=releaseStart))) {
-					outputs[OUT].setVoltage(0.0f);
-					audio[i].startIncr(1);
-				}
-				else {
-					outputs[OUT].setVoltage(*audio[i].startData()*5.0f*gain[i]*params[GAIN_PARAM].getValue(),i);
-					audio[i].startIncr(1);
+				if (!(((loopStart==loopEnd) && (internalIntegerPosition[i]>=loopStart)) || ((releaseStart==sampleEnd) && (internalIntegerPosition[i]>=releaseStart)))) {
+					voiceOut[i] = *audio[i].startData();
 				}
-			}
-			else {
-				outputs[OUT].setVoltage(0.0f,i);
+				audio[i].startIncr(1);
 			}
 		}
 
-		outputs[OUT].setChannels(inputs[PITCH_INPUT].getChannels());
+		float outGain = 5.0f*params[GAIN_PARAM].getValue();
+		for (int c=0; c<nbVoices; c+=4) {
+			outputs[OUT].setVoltageSimd(simd::float_4::load(&voiceOut[c])*simd::float_4::load(&gain[c])*outGain, c);
+		}
+		outputs[OUT].setChannels(nbVoices);
 	}
+
+	bank.quiescent(AUDIO_READER);
 }
 
 struct EDSAROSLoopDisplay : TransparentWidget {
@@ -699,19 +784,15 @@ struct EDSAROSDisplay : OpaqueWidget {
   }
 
 	void drawSample(const DrawArgs &args) {
-		if (module->loadingBuffer.size()>0) {
-			module->mylock.lock();
-  		std::vector<float> vL;
-			for (int i=0;i<module->totalSampleCount;i++) {
-				vL.push_back(module->loadingBuffer[i].samples[0]*module->params[EDSAROS::GAIN_PARAM].getValue());
-			}
-  		module->mylock.unlock();
-  		size_t nbSample = vL.size();
+		const waves::Sample<1> &source = module->bank.acquire()->source;
+		if (source.size()>0) {
+  		size_t nbSample = source.size();
+			float gain = module->params[EDSAROS::GAIN_PARAM].getValue();
 
   		if (nbSample>0) {
 				nvgSave(args.vg);
 				Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, height));
-				size_t inc = std::max(vL.size()/zoomWidth/4,1.f);
+				size_t inc = std::max(nbSample/zoomWidth/4,1.f);
   			nvgScissor(args.vg, -0.5f, b.pos.y-0.5f, width+1.0f, height+1.0f);
 
 				nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, 255));
@@ -724,10 +805,10 @@ struct EDSAROSDisplay : OpaqueWidget {
   			nvgStrokeColor(args.vg, nvgRGBA(164, 3, 111, 200));
 
   			nvgBeginPath(args.vg);
-  			for (size_t i = 0; i < vL.size(); i+=inc) {
+  			for (size_t i = 0; i < nbSample; i+=inc) {
   				float x, y;
-  				x = (float)i/vL.size();
-  				y = (-1.f)*vL[i] / 2.0f + 0.5f;
+  				x = (float)i/nbSample;
+  				y = (-1.f)*source[i].samples[0]*gain / 2.0f + 0.5f;
   				Vec p;
   				p.x = b.pos.x + b.size.x * x;
   				p.y = b.pos.y + b.size.y * (1.0f - y);
@@ -898,8 +979,19 @@ struct EDSAROSBidooSmallSnapBlueKnob : BidooSmallSnapBlueKnob {
 
 
 struct EDSAROSWidget : BidooWidget {
+	// the UI only reads the bank while this widget exists
+	~EDSAROSWidget() {
+		EDSAROS *module = dynamic_cast<EDSAROS*>(this->module);
+		if (module) {
+			module->bank.offline(EDSAROS::UI_READER);
+		}
+	}
+
 	EDSAROSWidget(EDSAROS *module) {
 		setModule(module);
+		if (module) {
+			module->bank.online(EDSAROS::UI_READER);
+		}
     prepareThemes(asset::plugin(pluginInstance, "res/EDSAROS.svg"));
 
 		addChild(createWidget<ScrewSilver>(Vec(15, 0)));
@@ -1048,7 +1140,7 @@ struct EDSAROSWidget : BidooWidget {
 	static void pathSelected(EDSAROS *module, char* path) {
   		if (path) {
   			module->lastPath = path;
-				module->loading=true;
+				module->loadSample();
   			free(path);
   		}
   	}
@@ -1066,7 +1158,19 @@ struct EDSAROSWidget : BidooWidget {
 		Widget::onPathDrop(e);
 		EDSAROS *module = dynamic_cast<EDSAROS*>(this->module);
 		module->lastPath = e.paths[0];
-		module->loading=true;
+		module->loadSample();
+	}
+
+	void step() override {
+		EDSAROS *module = dynamic_cast<EDSAROS*>(this->module);
+		if (module) {
+			module->bank.quiescent(EDSAROS::UI_READER);
+			if (module->mylock.try_lock()) {
+				module->bank.collect();
+				module->mylock.unlock();
+			}
+		}
+		BidooWidget::step();
 	}
 };
 
@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <sstream>
 #include "dep/quantizer.hpp"
+#include "dep/slidecurve.hpp"
 
 using namespace std;
 
@@ -427,7 +428,7 @@ struct ENCORE : BidooModule {
 
 	bool solo = false;
 
-	float powTable[100][10000] = {{0.0f}};
+	const float (*powTable)[slidecurve::curveLength] = slidecurve::acquire()->values;
 
   std::string labels[8] = {"Track 1","Track 2","Track 3","Track 4","Track 5","Track 6","Track 7","Track 8"};
 
@@ -488,15 +489,13 @@ struct ENCORE : BidooModule {
 			}
   	}
 
-		for(int i=0; i<100;i++) {
-      for(int j=0; j<10000;j++) {
-				powTable[i][j] = powf(j*0.0001f,i*0.01f);
-			}
-		}
-
 		onReset();
 	}
 
+	~ENCORE() {
+		slidecurve::release();
+	}
+
   unsigned int calc_GCD(unsigned int a, unsigned int b)
   {
     unsigned int shift, tmp;
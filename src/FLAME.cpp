@@ -41,10 +41,8 @@ struct FLAME : BidooModule {
 	int N = 1024;
 	int N2 = N/2;
 	int H = 256;
+	FfftAnalysis *processors[3];
 	FfftAnalysis *processor;
-	vector<vector<float>> fft;
-	vector<float> windowSum;
-	vector<float> inBuffer;
 	float xBox, yBox, wBox, hBox;
 	size_t xSampleWindow, nxSampleWindow, ySampleWindow, wSampleWindow, hSampleWindow;
 	float runningSum = 0.f;
@@ -56,13 +54,25 @@ struct FLAME : BidooModule {
 
 	FLAME() {
     config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
-		processor = new FfftAnalysis(N, H, 2, APP->engine->getSampleRate());
-		fft = vector<vector<float>>(H,vector<float>(N2,0));
-		windowSum = vector<float>(H,0);
+		for (int i = 0; i < 3; i++) {
+			processors[i] = new FfftAnalysis(512 << i, H, 2, APP->engine->getSampleRate());
+		}
+		processor = processors[1];
 	}
 
 	~FLAME() {
-		delete processor;
+		for (int i = 0; i < 3; i++) {
+			delete processors[i];
+		}
+	}
+
+	// 512, 1024 or 2048, the analyses are all built up front
+	void setFrameSize(int size) {
+		int index = size <= 512 ? 0 : (size >= 2048 ? 2 : 1);
+		processors[index]->clear();
+		N = 512 << index;
+		N2 = N/2;
+		processor = processors[index];
 	}
 
 	json_t *dataToJson() override {
@@ -89,11 +99,7 @@ struct FLAME : BidooModule {
 		json_t *colorSchemeJ = json_object_get(rootJ, "colorScheme");
 		if (colorSchemeJ) colorScheme = json_real_value(colorSchemeJ);
 		json_t *NJ = json_object_get(rootJ, "frameSize");
-		if (NJ) N = json_real_value(NJ);
-		N2=N/2;
-		processor = new FfftAnalysis(N, H, 2, APP->engine->getSampleRate());
-		fft = vector<vector<float>>(H,vector<float>(N2,0));
-		windowSum = vector<float>(H,0);
+		if (NJ) setFrameSize(json_real_value(NJ));
 	}
 
 	void process(const ProcessArgs &args) override;
@@ -101,33 +107,15 @@ struct FLAME : BidooModule {
 
 void FLAME::process(const ProcessArgs &args) {
 	if (minTrigger.process(params[MIN_PARAM].getValue())) {
-		N = 512;
-		N2 = N/2;
-		H = 256;
-		processor = new FfftAnalysis(N, H, 2, APP->engine->getSampleRate());
-		fft = vector<vector<float>>(H,vector<float>(N2,0));
-		windowSum = vector<float>(H,0);
-		inBuffer.clear();
+		setFrameSize(512);
 	}
 
-	if (minTrigger.process(params[MED_PARAM].getValue())) {
-		N = 1024;
-		N2 = N/2;
-		H = 256;
-		processor = new FfftAnalysis(N, H, 2, APP->engine->getSampleRate());
-		fft = vector<vector<float>>(H,vector<float>(N2,0));
-		windowSum = vector<float>(H,0);
-		inBuffer.clear();
+	if (medTrigger.process(params[MED_PARAM].getValue())) {
+		setFrameSize(1024);
 	}
 
-	if (minTrigger.process(params[MAX_PARAM].getValue())) {
-		N = 2048;
-		N2 = N/2;
-		H = 256;
-		processor = new FfftAnalysis(N, H, 2, APP->engine->getSampleRate());
-		fft = vector<vector<float>>(H,vector<float>(N2,0));
-		windowSum = vector<float>(H,0);
-		inBuffer.clear();
+	if (maxTrigger.process(params[MAX_PARAM].getValue())) {
+		setFrameSize(2048);
 	}
 
 	lights[MIN_LIGHT].setBrightness(N == 512 ? 1.0f : 0.0f);
@@ -151,27 +139,21 @@ void FLAME::process(const ProcessArgs &args) {
 	lights[GREEN_LIGHT].setBrightness(colorScheme == 2 ? 1.0f : 0.0f);
 
 	xSampleWindow = (1.0f-pow(1.0f-((wBox<0 ? xBox+wBox : xBox) / 130),0.1f))*N2;
-	ySampleWindow = ((hBox<0 ? H-yBox : H-yBox-hBox) / H) * fft.size();
+	ySampleWindow = hBox<0 ? H-yBox : H-yBox-hBox;
 	wSampleWindow = (abs(wBox) / 130)*N2;
 	nxSampleWindow = (1.0f-pow(1.0f-((wBox<0 ? xBox : xBox+wBox) / 130),0.1f))*N2;
-	hSampleWindow = abs(hBox) * fft.size() / H;
+	hSampleWindow = abs(hBox);
 
-	inBuffer.push_back(inputs[INPUT].getVoltage()/10.0f);
+	bool newFrame = processor->process(inputs[INPUT].getVoltage()/10.0f, xSampleWindow, nxSampleWindow);
 
-	if ((wSampleWindow>0) && (hSampleWindow>0) && initRunninSum) {
+	// the history only moves once per hop, summing the box then costs nothing
+	if ((newFrame || initRunninSum) && (wSampleWindow>0) && (hSampleWindow>0)) {
 		runningSum = 0.0f;
-		for (size_t i = ySampleWindow; i < ySampleWindow+hSampleWindow; i++)  runningSum += windowSum[i];
+		for (size_t i = ySampleWindow; i < min(ySampleWindow+hSampleWindow, (size_t)H); i++)  runningSum += processor->sum(i);
 		runningSum = runningSum/(wSampleWindow*hSampleWindow);
 		initRunninSum = false;
 	}
 
-	if (inBuffer.size()==(long long unsigned int)N) {
-		processor->process(&inBuffer[0], &fft, &windowSum, xSampleWindow, nxSampleWindow);
-		inBuffer.clear();
-		runningSum -= windowSum[ySampleWindow+hSampleWindow+1]/(wSampleWindow*hSampleWindow);
-		runningSum += windowSum[ySampleWindow]/(wSampleWindow*hSampleWindow);
-	}
-
 	outputs[OUTPUT].setVoltage(clamp(runningSum,0.0f,10.0f));
 }
 
@@ -225,12 +207,13 @@ struct FLAMEDisplay : OpaqueWidget {
 				nvgStrokeWidth(args.vg, 1);
 
 				if (module->inputs[FLAME::INPUT].isConnected()) {
-					for (size_t j=module->fft.size()-1; j>0; j--) {
+					FfftAnalysis *analysis = module->processor;
+					for (size_t j=module->H-1; j>0; j--) {
 						nvgBeginPath(args.vg);
 						float y = box.size.y*(1.0f - (float)j/(float)module->H);
 						nvgMoveTo(args.vg, 0, y);
 						for (size_t i = 0; i < width; i++) {
-							float magn = interpolateLinear(&module->fft[j][0], (1.0f-pow(1.0f-i*iWidth,0.1f))*module->N2)*5e-4f;
+							float magn = interpolateLinear(analysis->row(j), (1.0f-pow(1.0f-i*iWidth,0.1f))*analysis->fftFrameSize2)*5e-4f;
 							nvgLineTo(args.vg, i, y-(magn*box.size.y));
 						}
 						nvgLineTo(args.vg, width, y);
@@ -255,9 +238,9 @@ struct FLAMEDisplay : OpaqueWidget {
 
 					nvgBeginPath(args.vg);
 					nvgMoveTo(args.vg, width, 0);
-					for (size_t j=module->fft.size()-1; j>0; j--) {
+					for (size_t j=module->H-1; j>0; j--) {
 						float y = box.size.y*(1.0f - (float)j/(float)module->H);
-						nvgLineTo(args.vg, width - module->windowSum[j]*5e-3f, y);
+						nvgLineTo(args.vg, width - analysis->sum(j)*5e-3f, y);
 					}
 					nvgLineTo(args.vg, width, box.size.y);
 					nvgLineTo(args.vg, width, 0);
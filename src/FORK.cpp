@@ -2,19 +2,19 @@
 #include "BidooComponents.hpp"
 
 using namespace std;
+using simd::float_4;
 
 //Approximates cos(pi*x) for x in [-1,1].
-inline float fast_cos(const float x)
+template <typename T>
+inline T fast_cos(const T x)
 {
-  float x2=x*x;
+  T x2=x*x;
   return 1.0f+x2*(-4.0f+2.0f*x2);
 }
 //Length of the table
 #define L_TABLE (256+1) //The last entry of the table equals the first (to avoid a modulo)
 //Maximal formant width
 #define I_MAX 64
-//Table of formants
-float TF[L_TABLE*I_MAX];
 //Formantic function of width I (used to fill the table of formants)
 float fonc_formant(float p,const float I)
 {
@@ -32,43 +32,86 @@ float fonc_formant(float p,const float I)
    }
   return a;
 }
-//Initialisation of the table TF with the fonction fonc_formant.
-void init_formant(void)
-{ float coef=2.0f/(L_TABLE-1);
-  for(int I=0;I<I_MAX;I++)
-    for(int P=0;P<L_TABLE;P++)
-      TF[P+I*L_TABLE]=fonc_formant(-1+P*coef,float(I));
-}
+//Table of formants, filled once with fonc_formant when the plugin is loaded
+//and only read afterwards. One spare entry past the end for the
+//interpolation at p=1 on the widest formant.
+struct FormantTable {
+  float TF[L_TABLE*I_MAX+1];
+
+  FormantTable()
+  { float coef=2.0f/(L_TABLE-1);
+    for(int I=0;I<I_MAX;I++)
+      for(int P=0;P<L_TABLE;P++)
+        TF[P+I*L_TABLE]=fonc_formant(-1+P*coef,float(I));
+    TF[L_TABLE*I_MAX]=TF[L_TABLE*(I_MAX-1)];
+  }
+};
+
+static const FormantTable formants;
+
 //This function emulates the function fonc_formant
 // thanks to the table TF. A bilinear interpolation is
-// performed
+// performed.
 float formant(float p,float i)
 {
-  i=i<0?0:i>I_MAX-2?I_MAX-2:i;    // width limitation
+ i=clamp(i,0.0f,float(I_MAX-2));    // width limitation
  float P=(L_TABLE-1)*(p+1)*0.5f; // phase normalisation
  int P0=(int)P;
  float fP=P-P0;  // Integer and fractional
  int I0=(int)i;
  float fI=i-I0;  // parts of the phase (p) and width (i).
- int i00=P0+L_TABLE*I0;
- int i10=i00+L_TABLE;
+ const float *tf=formants.TF+P0+L_TABLE*I0;
  //bilinear interpolation.
- return (1-fI)*(TF[i00] + fP*(TF[i00+1]-TF[i00])) + fI*(TF[i10] + fP*(TF[i10+1]-TF[i10]));
+ return (1-fI)*(tf[0] + fP*(tf[1]-tf[0])) + fI*(tf[L_TABLE] + fP*(tf[L_TABLE+1]-tf[L_TABLE]));
+}
+
+//Same, one voice per lane.
+float_4 formant(float_4 p,float_4 i)
+{
+ i=simd::clamp(i,0.0f,float(I_MAX-2));    // width limitation
+ float_4 P=(L_TABLE-1)*(p+1)*0.5f; // phase normalisation
+ float_4 P0=simd::floor(P);
+ float_4 fP=P-P0;  // Integer and fractional
+ float_4 I0=simd::floor(i);
+ float_4 fI=i-I0;  // parts of the phase (p) and width (i).
+ alignas(16) float i00[4];
+ (P0+L_TABLE*I0).store(i00);
+ alignas(16) float t[4][4]; // the four corners of each lane
+ for(int k=0;k<4;k++)
+ {
+   const float *tf=formants.TF+(int)i00[k];
+   t[0][k]=tf[0];
+   t[1][k]=tf[1];
+   t[2][k]=tf[L_TABLE];
+   t[3][k]=tf[L_TABLE+1];
+ }
+ float_4 t00=float_4::load(t[0]),t01=float_4::load(t[1]);
+ float_4 t10=float_4::load(t[2]),t11=float_4::load(t[3]);
+ //bilinear interpolation.
+ return (1-fI)*(t00 + fP*(t01-t00)) + fI*(t10 + fP*(t11-t10));
+}
+
+//Brings x back into [-1,1) without fmodf.
+template <typename T>
+inline T wrap(T x)
+{
+  return x-2.0f*simd::floor((x+1.0f)*0.5f);
 }
 
 // Double carrier.
 // h : position (float harmonic number)
 // p : phase
-float porteuse(const float h,const float p)
+template <typename T>
+T porteuse(const T h,const T p)
 {
-  float h0=floor(h);  //integer and
-  float hf=h-h0;      //decimal part of harmonic number.
-  // modulos pour ramener p*h0 et p*(h0+1) dans [-1,1]
-  float phi0=fmodf(p* h0   +1+1000,2.0f)-1.0f;
-  float phi1=fmodf(p*(h0+1)+1+1000,2.0f)-1.0f;
+  T h0=simd::floor(h);  //integer and
+  T hf=h-h0;      //decimal part of harmonic number.
+  // p*h0 and p*(h0+1) brought back into [-1,1]
+  T phi0=wrap(p* h0   );
+  T phi1=wrap(p*(h0+1));
   // two carriers.
-  float Porteuse0=fast_cos(phi0);
-  float Porteuse1=fast_cos(phi1);
+  T Porteuse0=fast_cos(phi0);
+  T Porteuse1=fast_cos(phi1);
   // crossfade between the two carriers.
   return Porteuse0+hf*(Porteuse1-Porteuse0);
 }
@@ -105,9 +148,15 @@ struct FORK : BidooModule {
 	float A3[9]={ 0.3f,0.15f, 0.2f, 0.4f, 0.1f, 0.3f, 0.7f, 0.2f, 0.2f};
 	float F4[9]={ 3400.0f, 4700.0f, 3000.0f, 3300.0f, 3400.0f, 3700.0f, 3200.0f, 3000.0f, 3000.0f};
 	float A4[9]={ 0.2f, 0.1f, 0.2f, 0.3f, 0.1f, 0.1f, 0.3f, 0.2f, 0.3f};
+	const float fMin[4]={ 190.0f, 800.0f, 1500.0f, 3000.0f};
+	const float fMax[4]={ 730.0f, 2100.0f, 3100.0f, 4700.0f};
+	const float aMax[4]={ 1.0f, 2.0f, 0.7f, 0.3f};
+	const float widths[4]={ 100.0f, 120.0f, 150.0f, 300.0f};
+	const float levels[4]={ 1.0f, 0.7f, 1.0f, 1.0f};
 	int preset=0;
-	float f0,dp0,p0=0.0f;
-	float f1,f2,f3,f4,a1,a2,a3,a4;
+	// one float_4 per group of four voices, a lone voice uses the first lane
+	float_4 p0[4]={};
+	float_4 f[4][4],a[4][4];
   dsp::SchmittTrigger presets;
 
 	FORK() {
@@ -123,8 +172,12 @@ struct FORK : BidooModule {
     configParam(F_PARAM + 3, 3000.0f, 4700.0f, 3400.0f);
     configParam(A_PARAM + 3, 0.0f, 0.3f, 0.2f);
 
-		init_formant();
-		f1=f2=f3=f4=100.0f;a1=a2=a3=a4=0.0f;
+		for (int c = 0; c < 4; c++) {
+			for (int k = 0; k < 4; k++) {
+				f[k][c] = 100.0f;
+				a[k][c] = 0.0f;
+			}
+		}
 	}
 
 	void process(const ProcessArgs &args) override;
@@ -144,28 +197,47 @@ void FORK::process(const ProcessArgs &args) {
     params[A_PARAM+3].setValue(A4[preset]);
   }
 
-	f0=261.626f * powf(2.0f, clamp(params[PITCH_PARAM].getValue() + 12.0f * inputs[PITCH_INPUT].getVoltage(),-54.0f,54.0f) / 12.0f);
-	dp0=f0*(2/args.sampleRate);
-	float un_f0=1.0f/f0;
-	p0+=dp0;
-	p0-=2.0f*(p0>1.0f);
-	{
-		float r=0.001f;
-		f1+=r*(clamp(params[F_PARAM].getValue() + rescale(inputs[F_INPUT].getVoltage(),0.0f,10.0f,190.0f,730.0f),190.0f,730.0f)-f1);
-		f2+=r*(clamp(params[F_PARAM+1].getValue() + rescale(inputs[F_INPUT+1].getVoltage(),0.0f,10.0f,800.0f,2100.0f),800.0f,2100.0f)-f2);
-		f3+=r*(clamp(params[F_PARAM+2].getValue() + rescale(inputs[F_INPUT+2].getVoltage(),0.0f,10.0f,1500.0f,3100.0f),1500.0f,3100.0f)-f3);
-		f4+=r*(clamp(params[F_PARAM+3].getValue() + rescale(inputs[F_INPUT+3].getVoltage(),0.0f,10.0f,3000.0f,4700.0f),3000.0f,4700.0f)-f4);
-		a1+=r*(clamp(params[A_PARAM].getValue() + rescale(inputs[A_INPUT].getVoltage(),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f)-a1);
-		a2+=r*(clamp(params[A_PARAM+1].getValue() + rescale(inputs[A_INPUT+1].getVoltage(),0.0f,10.0f,0.0f,2.0f),0.0f,2.0f)-a2);
-		a3+=r*(clamp(params[A_PARAM+2].getValue() + rescale(inputs[A_INPUT+2].getVoltage(),0.0f,10.0f,0.0f,0.7f),0.0f,0.7f)-a3);
-		a4+=r*(clamp(params[A_PARAM+3].getValue() + rescale(inputs[A_INPUT+3].getVoltage(),0.0f,10.0f,0.0f,0.3f),0.0f,0.3f)-a4);
+	int channels = max(inputs[PITCH_INPUT].getChannels(), 1);
+	float r=0.001f;
+
+	// a single voice runs in scalar, without the per lane table gathers of
+	// the float_4 formant()
+	if (channels == 1) {
+		float f0=261.626f * powf(2.0f, clamp(params[PITCH_PARAM].getValue() + 12.0f * inputs[PITCH_INPUT].getVoltage(),-54.0f,54.0f) / 12.0f);
+		float un_f0=1.0f/f0;
+		float &p=p0[0][0];
+		p+=f0*(2/args.sampleRate);
+		if (p>1.0f) p-=2.0f;
+
+		float out=0.0f;
+		for (int k = 0; k < 4; k++) {
+			float &fk=f[k][0][0];
+			float &ak=a[k][0][0];
+			fk+=r*(clamp(params[F_PARAM+k].getValue() + inputs[F_INPUT+k].getVoltage()*(0.1f*(fMax[k]-fMin[k]))+fMin[k],fMin[k],fMax[k])-fk);
+			ak+=r*(clamp(params[A_PARAM+k].getValue() + inputs[A_INPUT+k].getVoltage()*(0.1f*aMax[k]),0.0f,aMax[k])-ak);
+			out+=levels[k]*ak*(f0/fk)*formant(p,widths[k]*un_f0)*porteuse(fk*un_f0,p);
+		}
+		outputs[SIGNAL_OUTPUT].setVoltage(5.0f*out);
+		outputs[SIGNAL_OUTPUT].setChannels(1);
+		return;
 	}
 
-	float out= a1*(f0/f1)*formant(p0,100.0f*un_f0)*porteuse(f1*un_f0,p0)
-	 + 0.7f*a2*(f0/f2)*formant(p0,120.0f*un_f0)*porteuse(f2*un_f0,p0)
-	 +     a3*(f0/f3)*formant(p0,150.0f*un_f0)*porteuse(f3*un_f0,p0)
-	 +     a4*(f0/f4)*formant(p0,300.0f*un_f0)*porteuse(f4*un_f0,p0);
-	outputs[SIGNAL_OUTPUT].setVoltage(5.0f*out);
+	for (int c = 0; c < channels; c += 4) {
+		float_4 f0=261.626f * simd::pow(2.0f, simd::clamp(params[PITCH_PARAM].getValue() + 12.0f * inputs[PITCH_INPUT].getVoltageSimd<float_4>(c),-54.0f,54.0f) / 12.0f);
+		float_4 dp0=f0*(2/args.sampleRate);
+		float_4 un_f0=1.0f/f0;
+		p0[c/4]+=dp0;
+		p0[c/4]=simd::ifelse(p0[c/4]>1.0f,p0[c/4]-2.0f,p0[c/4]);
+
+		float_4 out=0.0f;
+		for (int k = 0; k < 4; k++) {
+			f[k][c/4]+=r*(simd::clamp(params[F_PARAM+k].getValue() + inputs[F_INPUT+k].getPolyVoltageSimd<float_4>(c)*(0.1f*(fMax[k]-fMin[k]))+fMin[k],fMin[k],fMax[k])-f[k][c/4]);
+			a[k][c/4]+=r*(simd::clamp(params[A_PARAM+k].getValue() + inputs[A_INPUT+k].getPolyVoltageSimd<float_4>(c)*(0.1f*aMax[k]),0.0f,aMax[k])-a[k][c/4]);
+			out+=levels[k]*a[k][c/4]*(f0/f[k][c/4])*formant(p0[c/4],widths[k]*un_f0)*porteuse(f[k][c/4]*un_f0,p0[c/4]);
+		}
+		outputs[SIGNAL_OUTPUT].setVoltageSimd(5.0f*out, c);
+	}
+	outputs[SIGNAL_OUTPUT].setChannels(channels);
 }
 
 struct FORKWidget : BidooWidget {
@@ -1,7 +1,6 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/digital.hpp"
-#include "dsp/ringbuffer.hpp"
 #include "dep/filters/pitchshifter.h"
 
 #define BUFF_SIZE 2048
@@ -26,8 +25,6 @@ struct HCTIP : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float, BUFF_SIZE> in_Buffer;
-	dsp::DoubleRingBuffer<float, BUFF_SIZE> out_Buffer;
 	PitchShifter *pShifter = nullptr;
 
 	HCTIP() {
@@ -42,18 +39,8 @@ struct HCTIP : BidooModule {
 	}
 
 	void process(const ProcessArgs &args) override {
-		in_Buffer.push(inputs[INPUT].getVoltage() / 10.0f);
-
-		if (in_Buffer.full()) {
-			pShifter->process(clamp(params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage(), 0.5f, 2.0f), in_Buffer.startData(), out_Buffer.endData());
-			out_Buffer.endIncr(BUFF_SIZE);
-			in_Buffer.clear();
-		}
-
-		if (out_Buffer.size() > 0) {
-			outputs[OUTPUT].setVoltage(*out_Buffer.startData() * 5.0f);
-			out_Buffer.startIncr(1);
-		}
+		float out = pShifter->process(clamp(params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage(), 0.5f, 2.0f), inputs[INPUT].getVoltage() / 10.0f);
+		outputs[OUTPUT].setVoltage(out * 5.0f);
 	}
 
 	~HCTIP() {
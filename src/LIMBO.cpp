@@ -3,58 +3,43 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/resampler.hpp"
+#include "dep/filters/halfband.h"
+#include "dep/filters/pade.h"
 
 using namespace std;
 
-#define pi 3.14159265359
+using simd::float_4;
 
-struct FilterStage {
-	float mem = 0.0;
-
-	float Filter(float sample, float freq, float smpRate, float gain, int mode) {
-		float g = std::tan(pi*freq / smpRate);
-		float G = g / (1.0 + g);
-		float out;
+// Four one pole stages in a resonant feedback loop, four voices per float_4.
+// The cutoff derived coefficients are shared by the stages, tan and tanh are
+// the Pade approximants of pade.h.
+template <typename T>
+struct LadderFilter {
+	T mem[4] = {};
+
+	T process(T sample, T freq, T q, T gain, int mode, float sampleTime) {
+		T g = fastTan(simd::fmin(T(M_PI * sampleTime) * freq, T(1.5f)));
+		T gInv = 1.0f / (1.0f + g);
+		T G = g * gInv;
+		T G4 = G*G*G*G;
+		T S = (G4*G4*G4*mem[0] + G4*G4*mem[1] + G4*mem[2] + mem[3]) * gInv;
+		T x = (sample - q * S) / (1.0f + q * G4);
 		if (mode == 0) {
-			out = (sample - mem) * G + mem;
-		} else {
-			out = (std::tanh(sample*gain) / std::tanh(gain) - mem) * G + mem;
+			for (int i = 0; i < 4; i++) {
+				T out = (x - mem[i]) * G + mem[i];
+				mem[i] = out + (x - mem[i]) * G;
+				x = out;
+			}
 		}
-		mem = out + (sample - mem) * G;
-		return out;
-	}
-};
-
-struct LadderFilter {
-	FilterStage stage1;
-	FilterStage stage2;
-	FilterStage stage3;
-	FilterStage stage4;
-	float q;
-	float freq;
-	float smpRate;
-	int mode = 0;
-	float gain = 1.0f;
-
-	void setParams(float freq, float q, float smpRate, float gain, int mode) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-		this->mode = mode;
-		this->gain = gain;
-	}
-
-	float calcOutput(float sample) {
-		float g = std::tan(pi*freq / smpRate);
-		float G = g / (1.0f + g);
-		G = G*G*G*G;
-		float S1 = stage1.mem / (1.0f + g);
-		float S2 = stage2.mem / (1.0f + g);
-		float S3 = stage3.mem / (1.0f + g);
-		float S4 = stage4.mem / (1.0f + g);
-		float S = G*G*G*S1 + G*G*S2 + G*S3 + S4;
-		return stage4.Filter(stage3.Filter(stage2.Filter(stage1.Filter((sample - q * S) / (1.0f + q * G),
-			freq, smpRate, gain, mode), freq, smpRate, gain, mode), freq, smpRate, gain, mode), freq, smpRate, gain, mode);
+		else {
+			T norm = 1.0f / fastTanh(gain);
+			for (int i = 0; i < 4; i++) {
+				T out = (fastTanh(x * gain) * norm - mem[i]) * G + mem[i];
+				mem[i] = out + (x - mem[i]) * G;
+				x = out;
+			}
+		}
+		return x;
 	}
 };
 
@@ -85,7 +70,10 @@ struct LIMBO : BidooModule {
 		NUM_LIGHTS
 	};
 
-	LadderFilter lFilter, rFilter;
+	LadderFilter<float_4> lFilters[4], rFilters[4];
+	Oversampler<float_4> lOversamplers[4], rOversamplers[4];
+	int oversampling = 1;
+	int appliedOversampling = 1;
 
 	///Tooltip
 	struct tpOnOff : ParamQuantity {
@@ -107,19 +95,57 @@ struct LIMBO : BidooModule {
 		configParam<tpOnOff>(MODE_PARAM, 0.0f, 1.0f, 0.0f, "Linear");
 	}
 
+	json_t *dataToJson() override {
+		json_t *rootJ = BidooModule::dataToJson();
+		json_object_set_new(rootJ, "oversampling", json_integer(oversampling));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		BidooModule::dataFromJson(rootJ);
+		json_t *oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ)
+			oversampling = json_integer_value(oversamplingJ);
+		if ((oversampling != 2) && (oversampling != 4))
+			oversampling = 1;
+	}
+
 	void process(const ProcessArgs &args) override {
-		float cfreq = std::pow(2.0f, rescale(clamp(params[CUTOFF_PARAM].getValue() + params[CMOD_PARAM].getValue() * inputs[CUTOFF_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float q = 3.5f * clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f);
-		float g = pow(2.0f, rescale(clamp(params[MUG_PARAM].getValue() + inputs[MUG_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 0.0f, 3.0f));
+		int channels = std::max(std::max(inputs[IN_L].getChannels(), inputs[IN_R].getChannels()), 1);
 		int mode = (int)params[MODE_PARAM].getValue();
-		lFilter.setParams(cfreq, q, args.sampleRate, g / 3, mode);
-		rFilter.setParams(cfreq, q, args.sampleRate, g / 3, mode);
-		float inL = inputs[IN_L].getVoltage() * 0.2f;
-		float inR = inputs[IN_R].getVoltage() * 0.2f;
-		inL = lFilter.calcOutput(inL)*5.0f*(mode == 0 ? g : 1);
-		inR = rFilter.calcOutput(inR)*5.0f*(mode == 0 ? g : 1);
-		outputs[OUT_L].setVoltage(inL);
-		outputs[OUT_R].setVoltage(inR);
+		int factor = oversampling;
+		// the halfband stages a factor leaves idle hold what they had when it
+		// was last used, start them from silence on a change
+		if (factor != appliedOversampling) {
+			for (int g = 0; g < 4; g++) {
+				lOversamplers[g].reset();
+				rOversamplers[g].reset();
+			}
+			appliedOversampling = factor;
+		}
+		float sampleTime = args.sampleTime / factor;
+
+		outputs[OUT_L].setChannels(channels);
+		outputs[OUT_R].setChannels(channels);
+
+		for (int c = 0; c < channels; c += 4) {
+			float_4 cutoff = simd::clamp(params[CUTOFF_PARAM].getValue() + params[CMOD_PARAM].getValue() * inputs[CUTOFF_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f);
+			float_4 cfreq = simd::pow(2.0f, 4.5f + cutoff * 9.5f);
+			float_4 q = 3.5f * simd::clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f);
+			float_4 g = simd::pow(2.0f, 3.0f * simd::clamp(params[MUG_PARAM].getValue() + inputs[MUG_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f));
+			float_4 gain = g / 3.0f;
+			float_4 makeUp = (mode == 0 ? g : 1.0f) * 5.0f;
+
+			float_4 bufL[4], bufR[4];
+			lOversamplers[c/4].upsample(inputs[IN_L].getPolyVoltageSimd<float_4>(c) * 0.2f, bufL, factor);
+			rOversamplers[c/4].upsample(inputs[IN_R].getPolyVoltageSimd<float_4>(c) * 0.2f, bufR, factor);
+			for (int i = 0; i < factor; i++) {
+				bufL[i] = lFilters[c/4].process(bufL[i], cfreq, q, gain, mode, sampleTime);
+				bufR[i] = rFilters[c/4].process(bufR[i], cfreq, q, gain, mode, sampleTime);
+			}
+			outputs[OUT_L].setVoltageSimd(lOversamplers[c/4].downsample(bufL, factor) * makeUp, c);
+			outputs[OUT_R].setVoltageSimd(rOversamplers[c/4].downsample(bufR, factor) * makeUp, c);
+		}
 	}
 
 };
@@ -150,6 +176,20 @@ struct LIMBOWidget : BidooWidget {
 		addOutput(createOutput<TinyPJ301MPort>(Vec(75.f, 340), module, LIMBO::OUT_L));
 		addOutput(createOutput<TinyPJ301MPort>(Vec(75.f+22.f, 340), module, LIMBO::OUT_R));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		BidooWidget::appendContextMenu(menu);
+		LIMBO *module = dynamic_cast<LIMBO*>(this->module);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createSubmenuItem("Oversampling", std::to_string(module->oversampling) + "x", [=](ui::Menu* menu) {
+			for (int factor : {1, 2, 4}) {
+				menu->addChild(createCheckMenuItem(std::to_string(factor) + "x", "",
+					[=]() {return module->oversampling == factor;},
+					[=]() {module->oversampling = factor;}
+				));
+			}
+		}));
+	}
 };
 
 Model *modelLIMBO = createModel<LIMBO, LIMBOWidget>("lIMbO");
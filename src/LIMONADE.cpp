@@ -2,11 +2,16 @@
 #include "dsp/digital.hpp"
 #include "BidooComponents.hpp"
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include "dsp/resampler.hpp"
 #include "dsp/fir.hpp"
 #include "osdialog.h"
 #include "dep/dr_wav/dr_wav.h"
 #include "dep/osc/wtOsc.h"
+#include "dep/rcu.hpp"
 #include "../pffft/pffft.h"
 #include <iostream>
 #include <fstream>
@@ -18,9 +23,17 @@ using namespace std;
 static const char WAV_FILTERS[] = "wav:wav";
 static const char PNG_FILTERS[] = "png:png";
 
-void tUpdateWaveTable(wtTable &table, float index) {
+void tEditBin(wtTable &table, float index, size_t bin, bool magnitude, bool reset, float delta) {
 	size_t i = index*(table.nFrames-1);
+	if (magnitude) {
+		table.frames[i].magnitude[bin] = reset ? 0.0f : clamp(table.frames[i].magnitude[bin] + delta, 0.0f, 1.0f);
+	}
+	else {
+		table.frames[i].phase[bin] = reset ? 0.0f : clamp(table.frames[i].phase[bin] + delta, -1.0f*M_PI, M_PI);
+	}
+	table.frames[i].morphed = false;
 	table.frames[i].calcWav();
+	table.frames[i].calcMipMap();
 }
 
 void tSaveWaveTableAsWave(wtTable &table, int sampleRate, std::string path) {
@@ -108,6 +121,7 @@ void tLoadSample(wtTable &table, std::string path, size_t frameLen, bool interpo
 			table.loadSample(sc, frameLen, interpolate, sample);
 			free(sample);
 			table.calcFFT();
+			table.calcMipMaps();
 		}
 	}
 	else if (waveExtension == ".aiff") {
@@ -126,6 +140,7 @@ void tLoadSample(wtTable &table, std::string path, size_t frameLen, bool interpo
 			table.loadSample(audioFile.getNumSamplesPerChannel(), frameLen, interpolate, sample);
 			free(sample);
 			table.calcFFT();
+			table.calcMipMaps();
 		}
 	}
 }
@@ -133,17 +148,20 @@ void tLoadSample(wtTable &table, std::string path, size_t frameLen, bool interpo
 void tLoadISample(wtTable &table, float *iRec, size_t sc, size_t frameLen, bool interpolate) {
 	table.loadSample(sc, frameLen, interpolate, iRec);
 	table.calcFFT();
+	table.calcMipMaps();
 }
 
 void tLoadIFrame(wtTable &table, float *iRec, float index, size_t frameLen, bool interpolate) {
 	size_t i = index*(table.nFrames-1);
 	if (i<table.nFrames) {
 		table.frames[i].loadSample(frameLen, interpolate, iRec);
+		table.frames[i].calcMipMap();
 	}
 	else if (table.nFrames==0) {
 		table.addFrame(0);
 		table.frames[0].loadSample(frameLen, interpolate, iRec);
 		table.calcFFT();
+		table.calcMipMaps();
 	}
 }
 
@@ -174,6 +192,7 @@ void tLoadFrame(wtTable &table, std::string path, float index, bool interpolate)
 			}
 			free(sample);
 			table.calcFFT();
+			table.calcMipMaps();
 		}
 	}
 	else if (waveExtension == ".aiff") {
@@ -195,6 +214,7 @@ void tLoadFrame(wtTable &table, std::string path, float index, bool interpolate)
 				}
 				free(sample);
 				table.calcFFT();
+				table.calcMipMaps();
 			}
 	}
 }
@@ -221,6 +241,7 @@ void tLoadPNG(wtTable &table, std::string path) {
 		table.loadSample(sc, width, true, sample);
 		free(sample);
 		table.calcFFT();
+		table.calcMipMaps();
   }
 }
 
@@ -231,65 +252,66 @@ void tCalcFFT(wtTable &table) {
 void tWindowWt(wtTable &table) {
 	table.window();
 	table.calcFFT();
+	table.calcMipMaps();
 }
 
 void tSmoothWt(wtTable &table) {
 	table.smooth();
 	table.calcFFT();
+	table.calcMipMaps();
 }
 
 void tWindowFrame(wtTable &table, float index) {
 	size_t i = index*(table.nFrames-1);
 	table.windowFrame(i);
 	table.frames[i].calcFFT();
+	table.frames[i].calcMipMap();
 }
 
 void tSmoothFrame(wtTable &table, float index) {
 	size_t i = index*(table.nFrames-1);
 	table.smoothFrame(i);
 	table.frames[i].calcFFT();
+	table.frames[i].calcMipMap();
 }
 
 void tRemoveDCOffset(wtTable &table) {
 	table.removeDCOffset();
+	table.calcMipMaps();
 }
 
 void tNormalizeFrame(wtTable &table, float index) {
 	size_t i = index*(table.nFrames-1);
 	table.frames[i].normalize();
 	table.frames[i].calcFFT();
+	table.frames[i].calcMipMap();
 }
 
 void tNormalizeWt(wtTable &table) {
 	table.normalize();
 	table.calcFFT();
+	table.calcMipMaps();
 }
 
 void tNormalizeAllFrames(wtTable &table) {
 	table.normalizeAllFrames();
 	table.calcFFT();
-}
-
-void tFFTSample(wtTable &table, float index) {
-	size_t i = index*(table.nFrames-1);
-	table.frames[i].calcFFT();
-}
-
-void tIFFTSample(wtTable &table, float index) {
-	size_t i = index*(table.nFrames-1);
-	table.frames[i].calcIFFT();
+	table.calcMipMaps();
 }
 
 void tMorphWaveTable(wtTable &table) {
 	table.morphFrames();
+	table.calcMipMaps();
 }
 
 void tMorphSpectrum(wtTable &table) {
 	table.morphSpectrum();
+	table.calcMipMaps();
 }
 
 void tMorphSpectrumConstantPhase(wtTable &table) {
 	table.morphSpectrumConstantPhase();
+	table.calcMipMaps();
 }
 
 void tAddFrame(wtTable &table, float index) {
@@ -365,6 +387,35 @@ struct LIMONADE : BidooModule {
 		RECFRAME_LIGHT,
 		NUM_LIGHTS
 	};
+	enum EditIds {
+		MORPHWT_EDIT,
+		MORPHSPECTRUM_EDIT,
+		MORPHSPECTRUMCONSTANTPHASE_EDIT,
+		REMOVEMORPH_EDIT,
+		NORMALIZEWT_EDIT,
+		NORMALIZEFRAME_EDIT,
+		NORMALIZEALLFRAMES_EDIT,
+		REMOVEDC_EDIT,
+		WINDOWWT_EDIT,
+		WINDOWFRAME_EDIT,
+		SMOOTHWT_EDIT,
+		SMOOTHFRAME_EDIT,
+		ADDFRAME_EDIT,
+		REMOVEFRAME_EDIT,
+		RECWT_EDIT,
+		RECFRAME_EDIT
+	};
+	enum TableReaderIds {
+		AUDIO_READER,
+		UI_READER,
+		NUM_READERS
+	};
+
+	struct wtEdit {
+		int id;
+		float index;
+		size_t frameSize;
+	};
 
 	std::string lastPath;
 	size_t frameSize=FS;
@@ -382,7 +433,18 @@ struct LIMONADE : BidooModule {
 	size_t index = 0;
 	bool dirty = true;
 
-	wtTable table;
+	// The played table is never modified in place: the edit worker copies it,
+	// applies the pending edits and publishes the copy. process() only reads.
+	rcu::Pointer<wtTable, NUM_READERS> table{new wtTable()};
+	dsp::RingBuffer<wtEdit, 64> audioEdits;
+	std::deque<std::function<void(wtTable&)>> uiEdits;
+	std::mutex uiEditsLock;
+	std::mutex editLock;
+	std::condition_variable editCondition;
+	std::atomic<bool> recPending{false};
+	std::atomic<bool> running{true};
+	bool audioOnline = false;
+	std::thread worker;
 	wtOscillator<16, 16, float_4> oscillators[4];
 	wtOscillator<16, 16, float_4> oscillatorsUp[4];
 	wtOscillator<16, 16, float_4> oscillatorsDown[4];
@@ -426,19 +488,33 @@ struct LIMONADE : BidooModule {
 		configParam(ADDFRAME_PARAM, 0.0f, 1.0f, 0.0f, "Add frame");
 		configParam(REMOVEFRAME_PARAM, 0.0f, 1.0f, 0.0f, "Remove frame");
 
-		for(size_t i=0; i<4; i++) {
-			oscillators[i].table = &table;
-			oscillatorsUp[i].table = &table;
-			oscillatorsDown[i].table = &table;
-		}
 		iRec=(float*)calloc(4*NF*FS,sizeof(float));
+		// the UI reader goes online with the widget
+		table.offline(UI_READER);
+		worker = thread(&LIMONADE::runEdits, this);
 	}
 
   ~LIMONADE() {
+		running = false;
+		editCondition.notify_one();
+		worker.join();
 		free(iRec);
 	}
 
 	void process(const ProcessArgs &args) override;
+
+	// process() is not called while bypassed, so the audio reader leaves the
+	// table readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		table.offline(AUDIO_READER);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
+	void runEdits();
+	void applyEdit(wtTable &t, const wtEdit &e);
+	void postEdit(int id);
+	void postEdit(std::function<void(wtTable&)> edit);
 	void loadSample();
 	void loadSamplePath(char* path);
 	void loadFrame();
@@ -450,16 +526,12 @@ struct LIMONADE : BidooModule {
 	void windowFrame();
 	void smoothFrame();
 	void removeDCOffset();
-	void fftSample();
-	void ifftSample();
 	void morphWavetable();
 	void morphSpectrum();
 	void morphSpectrumConstantPhase();
 	void removeMorphing();
-	void updateWaveTable();
 	void addFrame();
 	void removeFrame();
-	void resetWaveTable();
 	void normalizeFrame();
 	void normalizeAllFrames();
 	void normalizeWt();
@@ -468,11 +540,14 @@ struct LIMONADE : BidooModule {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_t *framesJ = json_array();
 		size_t nFrames = 0;
-		for (size_t i=0; i<table.nFrames; i++) {
-			if (!table.frames[i].morphed) {
+		// may run without a UI, keep the writer from freeing the table meanwhile
+		std::lock_guard<std::mutex> lock(editLock);
+		wtTable *t = table.acquire();
+		for (size_t i=0; i<t->nFrames; i++) {
+			if (!t->frames[i].morphed) {
 				json_t *frameI = json_array();
 				for (size_t j=0; j<FS; j++) {
-					json_t *frameJ = json_real(table.frames[i].sample[j]);
+					json_t *frameJ = json_real(t->frames[i].sample[j]);
 					json_array_append_new(frameI, frameJ);
 				}
 				json_array_append_new(framesJ, frameI);
@@ -520,19 +595,23 @@ struct LIMONADE : BidooModule {
 					wav[i*FS+j] = json_number_value(json_array_get(frameJ, j));
 				}
 			}
-			table.loadSample(nFrames*FS, FS, false, wav);
+			wtTable *t = new wtTable();
+			t->loadSample(nFrames*FS, FS, false, wav);
 			if (morphType==0) {
-				morphWavetable();
+				t->morphFrames();
 			}
 			else if (morphType==1) {
-				morphSpectrum();
+				t->morphSpectrum();
 			}
 			else if (morphType==2) {
-				morphSpectrumConstantPhase();
+				t->morphSpectrumConstantPhase();
 			}
 			free(wav);
+			t->calcFFT();
+			t->calcMipMaps();
+			std::lock_guard<std::mutex> lock(editLock);
+			table.publish(t);
 		}
-		table.calcFFT();
 		dirty = true;
 	}
 
@@ -541,55 +620,112 @@ struct LIMONADE : BidooModule {
 	}
 
 	void onReset() override {
-		table.reset();
+		postEdit(tResetWaveTable);
 		lastPath = "";
 		dirty = true;
 	}
 };
 
-inline void LIMONADE::updateWaveTable() {
-	tUpdateWaveTable(table, params[INDEX_PARAM].getValue());
+void LIMONADE::runEdits() {
+	while (running) {
+		std::deque<std::function<void(wtTable&)>> edits;
+		{
+			std::unique_lock<std::mutex> lock(uiEditsLock);
+			editCondition.wait_for(lock, std::chrono::milliseconds(10));
+			edits.swap(uiEdits);
+		}
+
+		std::lock_guard<std::mutex> lock(editLock);
+		wtTable *t = NULL;
+		while (!audioEdits.empty()) {
+			if (!t) t = new wtTable(*table.acquire());
+			applyEdit(*t, audioEdits.shift());
+		}
+		for (auto &edit : edits) {
+			if (!t) t = new wtTable(*table.acquire());
+			edit(*t);
+		}
+		if (t) {
+			table.publish(t);
+		}
+		else {
+			table.collect();
+		}
+	}
+}
+
+void LIMONADE::applyEdit(wtTable &t, const wtEdit &e) {
+	switch (e.id) {
+		case MORPHWT_EDIT: tMorphWaveTable(t); break;
+		case MORPHSPECTRUM_EDIT: tMorphSpectrum(t); break;
+		case MORPHSPECTRUMCONSTANTPHASE_EDIT: tMorphSpectrumConstantPhase(t); break;
+		case REMOVEMORPH_EDIT: tDeleteMorphing(t); break;
+		case NORMALIZEWT_EDIT: tNormalizeWt(t); break;
+		case NORMALIZEFRAME_EDIT: tNormalizeFrame(t, e.index); break;
+		case NORMALIZEALLFRAMES_EDIT: tNormalizeAllFrames(t); break;
+		case REMOVEDC_EDIT: tRemoveDCOffset(t); break;
+		case WINDOWWT_EDIT: tWindowWt(t); break;
+		case WINDOWFRAME_EDIT: tWindowFrame(t, e.index); break;
+		case SMOOTHWT_EDIT: tSmoothWt(t); break;
+		case SMOOTHFRAME_EDIT: tSmoothFrame(t, e.index); break;
+		case ADDFRAME_EDIT: tAddFrame(t, e.index); break;
+		case REMOVEFRAME_EDIT: tRemoveFrame(t, e.index); break;
+		case RECWT_EDIT:
+			tLoadISample(t, iRec, e.frameSize*NF, e.frameSize, true);
+			recPending = false;
+			break;
+		case RECFRAME_EDIT:
+			tLoadIFrame(t, iRec, e.index, e.frameSize, true);
+			recPending = false;
+			break;
+	}
 }
 
-inline void LIMONADE::fftSample() {
-	tFFTSample(table, params[INDEX_PARAM].getValue());
+// audio thread, never blocks: the worker polls the ring buffer
+void LIMONADE::postEdit(int id) {
+	if (!audioEdits.full()) {
+		wtEdit e;
+		e.id = id;
+		e.index = params[INDEX_PARAM].getValue();
+		e.frameSize = frameSize;
+		audioEdits.push(e);
+	}
 }
 
-inline void LIMONADE::ifftSample() {
-	tIFFTSample(table, params[INDEX_PARAM].getValue());
+void LIMONADE::postEdit(std::function<void(wtTable&)> edit) {
+	{
+		std::lock_guard<std::mutex> lock(uiEditsLock);
+		uiEdits.push_back(edit);
+	}
+	editCondition.notify_one();
 }
 
 inline void LIMONADE::morphWavetable() {
 	morphType = 0;
-	tMorphWaveTable(table);
+	postEdit(MORPHWT_EDIT);
 }
 
 inline void LIMONADE::morphSpectrum() {
 	morphType = 1;
-	tMorphSpectrum(table);
+	postEdit(MORPHSPECTRUM_EDIT);
 }
 
 inline void LIMONADE::morphSpectrumConstantPhase() {
 	morphType = 2;
-	tMorphSpectrumConstantPhase(table);
+	postEdit(MORPHSPECTRUMCONSTANTPHASE_EDIT);
 }
 
 inline void LIMONADE::removeMorphing() {
 	morphType = -1;
-	tDeleteMorphing(table);
+	postEdit(REMOVEMORPH_EDIT);
 }
 
 void LIMONADE::addFrame() {
-	thread t = thread(tAddFrame, std::ref(table), params[INDEX_PARAM].getValue());
-	t.detach();
+	postEdit(ADDFRAME_EDIT);
 }
 
 void LIMONADE::removeFrame() {
-	tRemoveFrame(table, params[INDEX_PARAM].getValue());
-}
-
-void LIMONADE::resetWaveTable() {
-	tResetWaveTable(table);
+	postEdit(REMOVEFRAME_EDIT);
 }
 
 void LIMONADE::loadSample() {
@@ -608,7 +744,9 @@ void LIMONADE::loadSample() {
 void LIMONADE::loadSamplePath(char* path) {
 	if (path) {
 		lastPath=path;
-		tLoadSample(table, path, frameSize, true);
+		std::string p = lastPath;
+		size_t frameLen = frameSize;
+		postEdit([p, frameLen](wtTable &t) { tLoadSample(t, p, frameLen, true); });
 		free(path);
 		morphType = -1;
 	}
@@ -630,7 +768,9 @@ void LIMONADE::loadFrame() {
 void LIMONADE::loadFramePath(char* path) {
 	if (path) {
 		lastPath=path;
-		tLoadFrame(table, path, params[INDEX_PARAM].getValue(), true);
+		std::string p = lastPath;
+		float i = params[INDEX_PARAM].getValue();
+		postEdit([p, i](wtTable &t) { tLoadFrame(t, p, i, true); });
 		free(path);
 	}
 }
@@ -651,45 +791,51 @@ void LIMONADE::loadPNG() {
 void LIMONADE::loadPNGPath(char* path) {
 	if (path) {
 		lastPath=path;
-		tLoadPNG(table, path);
+		std::string p = lastPath;
+		postEdit([p](wtTable &t) { tLoadPNG(t, p); });
 		free(path);
 	}
 }
 
 void LIMONADE::windowWt() {
-	tWindowWt(table);
+	postEdit(WINDOWWT_EDIT);
 }
 
 void LIMONADE::smoothWt() {
-	tSmoothWt(table);
+	postEdit(SMOOTHWT_EDIT);
 }
 
 void LIMONADE::windowFrame() {
-	tWindowFrame(table, params[INDEX_PARAM].getValue());
+	postEdit(WINDOWFRAME_EDIT);
 }
 
 void LIMONADE::smoothFrame() {
-	tSmoothFrame(table, params[INDEX_PARAM].getValue());
+	postEdit(SMOOTHFRAME_EDIT);
 }
 
 void LIMONADE::removeDCOffset() {
-	tRemoveDCOffset(table);
+	postEdit(REMOVEDC_EDIT);
 }
 
 
 void LIMONADE::normalizeFrame() {
-	tNormalizeFrame(table, params[INDEX_PARAM].getValue());
+	postEdit(NORMALIZEFRAME_EDIT);
 }
 
 void LIMONADE::normalizeWt() {
-	tNormalizeWt(table);
+	postEdit(NORMALIZEWT_EDIT);
 }
 
 void LIMONADE::normalizeAllFrames() {
-	tNormalizeAllFrames(table);
+	postEdit(NORMALIZEALLFRAMES_EDIT);
 }
 
 void LIMONADE::process(const ProcessArgs &args) {
+	if (!audioOnline) {
+		table.online(AUDIO_READER);
+		audioOnline = true;
+	}
+	wtTable *wt = table.acquire();
 
 	if (displayModeTrigger.process(params[DISPLAYMODE_PARAM].getValue())) {
 		displayMode = (displayMode == 0) ? 1 : 0;
@@ -759,13 +905,13 @@ void LIMONADE::process(const ProcessArgs &args) {
 		removeFrame();
 	}
 
-	if (recTrigger.process(params[RECWT_PARAM].getValue()) && !recWt && !recFrame) {
+	if (recTrigger.process(params[RECWT_PARAM].getValue()) && !recWt && !recFrame && !recPending) {
 		recWt = true;
 		recIndex=0;
 		lights[RECWT_LIGHT].setBrightness(1.0f);
 	}
 
-	if (recTrigger.process(params[RECFRAME_PARAM].getValue()) && !recWt && !recFrame) {
+	if (recTrigger.process(params[RECFRAME_PARAM].getValue()) && !recWt && !recFrame && !recPending) {
 		recFrame = true;
 		recIndex=0;
 		lights[RECFRAME_LIGHT].setBrightness(1.0f);
@@ -776,15 +922,15 @@ void LIMONADE::process(const ProcessArgs &args) {
 		recIndex++;
 
 		if (recWt && (recIndex==frameSize*NF)) {
-			thread t = thread(tLoadISample, std::ref(table), std::ref(iRec), frameSize*NF, frameSize, true);
-			t.detach();
+			recPending = true;
+			postEdit(RECWT_EDIT);
 			recWt = false;
 			recIndex = 0;
 			lights[RECWT_LIGHT].setBrightness(0.0f);
 		}
 		else if (recFrame && (recIndex==frameSize)) {
-			thread t = thread(tLoadIFrame, std::ref(table), std::ref(iRec), params[INDEX_PARAM].getValue(), frameSize, true);
-			t.detach();
+			recPending = true;
+			postEdit(RECFRAME_EDIT);
 			recFrame = false;
 			recIndex = 0;
 			lights[RECFRAME_LIGHT].setBrightness(0.0f);
@@ -796,9 +942,15 @@ void LIMONADE::process(const ProcessArgs &args) {
 	float fmParam = dsp::quadraticBipolar(params[FM_PARAM].getValue());
 
 	int channels = std::max(inputs[PITCH_INPUT].getChannels(), 1);
-	index = clamp(params[WTINDEX_PARAM].getValue() + inputs[WTINDEX_INPUT].getVoltage() * 0.1f * params[WTINDEXATT_PARAM].getValue(),0.0f,1.0f)*(float)(table.nFrames == 0 ? 0 : table.nFrames - 1);
+	index = clamp(params[WTINDEX_PARAM].getValue() + inputs[WTINDEX_INPUT].getVoltage() * 0.1f * params[WTINDEXATT_PARAM].getValue(),0.0f,1.0f)*(float)(wt->nFrames == 0 ? 0 : wt->nFrames - 1);
 	float ur = clamp(params[UNISSONRANGE_PARAM].getValue() + rescale(inputs[UNISSONRANGE_INPUT].getVoltage(),0.0f,10.0f,0.0f,0.02f),0.0f,0.02f);
 
+	for(size_t i=0; i<4; i++) {
+		oscillators[i].table = wt;
+		oscillatorsUp[i].table = wt;
+		oscillatorsDown[i].table = wt;
+	}
+
 	for (int c = 0; c < channels; c += 4) {
 		if ((size_t)params[UNISSON_PARAM].getValue()==1) {
 			auto* oscillator = &oscillators[c / 4];
@@ -887,6 +1039,8 @@ void LIMONADE::process(const ProcessArgs &args) {
 	}
 
 	outputs[OUT].setChannels(channels);
+
+	table.quiescent(AUDIO_READER);
 }
 
 struct LIMONADEBinsDisplay : OpaqueWidget {
@@ -927,28 +1081,17 @@ struct LIMONADEBinsDisplay : OpaqueWidget {
 	}
 
 	void onDragMove(const event::DragMove &e) override {
-		if ((!scroll) && (module->table.nFrames>0)) {
-			size_t i = module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames-1);
+		if ((!scroll) && (module->table.acquire()->nFrames>0)) {
+			float index = module->params[LIMONADE::INDEX_PARAM].getValue();
+			size_t bin = refIdx;
+			bool reset = (APP->window->getMods() & RACK_MOD_MASK) == (GLFW_MOD_CONTROL);
+			float delta = -e.mouseDelta.y/(250/APP->scene->rackScroll->zoomWidget->zoom);
 			if (refY<=heightMagn) {
-				if ((APP->window->getMods() & RACK_MOD_MASK) == (GLFW_MOD_CONTROL)) {
-					module->table.frames[i].magnitude[refIdx] = 0.0f;
-				}
-				else {
-					module->table.frames[i].magnitude[refIdx] -= e.mouseDelta.y/(250/APP->scene->rackScroll->zoomWidget->zoom);
-					module->table.frames[i].magnitude[refIdx] = clamp(module->table.frames[i].magnitude[refIdx],0.0f, 1.0f);
-				}
+				module->postEdit([=](wtTable &t) { tEditBin(t, index, bin, true, reset, delta); });
 			}
 			else if (refY>=heightMagn+graphGap) {
-				if ((APP->window->getMods() & RACK_MOD_MASK) == (GLFW_MOD_CONTROL)) {
-					module->table.frames[i].phase[refIdx] = 0.0f;
-				}
-				else {
-					module->table.frames[i].phase[refIdx] -= e.mouseDelta.y / (250 / APP->scene->rackScroll->zoomWidget->zoom);
-					module->table.frames[i].phase[refIdx] = clamp(module->table.frames[i].phase[refIdx],-1.0f*M_PI, M_PI);
-				}
+				module->postEdit([=](wtTable &t) { tEditBin(t, index, bin, false, reset, delta); });
 			}
-			module->table.frames[i].morphed = false;
-			module->updateWaveTable();
 		}
 		else {
 				scrollLeftAnchor = clamp(scrollLeftAnchor + e.mouseDelta.x / APP->scene->rackScroll->zoomWidget->zoom, 0.0f,width-20.0f);
@@ -968,12 +1111,13 @@ struct LIMONADEBinsDisplay : OpaqueWidget {
 				nvgSave(args.vg);
 				wtFrame frame, playedFrame;
 				size_t tag=1;
+				wtTable *table = module->table.acquire();
 
-				if (module->table.nFrames>0) {
-					frame.magnitude = module->table.frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames - 1))].magnitude;
-					frame.phase = module->table.frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames - 1))].phase;
-					frame.sample = module->table.frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames - 1))].sample;
-					playedFrame.sample = module->table.frames[module->index].sample;
+				if (table->nFrames>0) {
+					frame.magnitude = table->frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames - 1))].magnitude;
+					frame.phase = table->frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames - 1))].phase;
+					frame.sample = table->frames[(size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames - 1))].sample;
+					playedFrame.sample = table->frames[module->index].sample;
 				}
 
 				Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, heightMagn + graphGap + heightPhas));
@@ -994,8 +1138,8 @@ struct LIMONADEBinsDisplay : OpaqueWidget {
 
 				nvgText(args.vg, 130.0f, heightMagn + graphGap * 0.5f + 4, "▲ Magnitude ▼ Phase", NULL);
 
-				if (module->table.nFrames>0) {
-					nvgText(args.vg, 0.0f, heightMagn + graphGap * 0.5f + 4, ("Frame " + to_string((int)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames-1) + 1)) + " / " + to_string(module->table.nFrames)).c_str(), NULL);
+				if (table->nFrames>0) {
+					nvgText(args.vg, 0.0f, heightMagn + graphGap * 0.5f + 4, ("Frame " + to_string((int)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames-1) + 1)) + " / " + to_string(table->nFrames)).c_str(), NULL);
 					for (size_t i = 0; i < FS2/2; i++) {
 						float x, y;
 						x = (float)i * IFS2;
@@ -1135,7 +1279,8 @@ struct LIMONADEWavDisplay : OpaqueWidget {
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
 			if (module && (module->displayMode == 0)) {
-				size_t fs = module->table.nFrames;
+				wtTable *table = module->table.acquire();
+				size_t fs = table->nFrames;
 				size_t idx = 0;
 				size_t wtidx = 0;
 				if (fs>0) {
@@ -1157,7 +1302,7 @@ struct LIMONADEWavDisplay : OpaqueWidget {
 					nvgBeginPath(args.vg);
 					for (size_t i=0; i<FS2; i+=2) {
 						x3D = 20.0f * i * IFS -5.0f;
-						z3D = (-1.f)*module->table.frames[fid].sample[2*i];
+						z3D = (-1.f)*table->frames[fid].sample[2*i];
 						y2D = z3D*ca1-(ca2*y3D-sa2*x3D)*sa1+5.0f;
 						x2D = ca2*x3D+sa2*y3D+7.5f;
 						if (i == 0) {
@@ -1168,7 +1313,7 @@ struct LIMONADEWavDisplay : OpaqueWidget {
 						}
 					}
 
-					nvgStrokeColor(args.vg, nvgRGBA(255, 233, 0, module->table.frames[fid].morphed ? 15 : 50));
+					nvgStrokeColor(args.vg, nvgRGBA(255, 233, 0, table->frames[fid].morphed ? 15 : 50));
 					nvgStroke(args.vg);
 				}
 
@@ -1177,7 +1322,7 @@ struct LIMONADEWavDisplay : OpaqueWidget {
 					y3D = 10.0f * idx/fs -5.0f;
 					for (size_t i=0; i<FS; i++) {
 						x3D = 10.0f * i * IFS -5.0f;
-						z3D = (-1.f)*module->table.frames[idx].sample[i];
+						z3D = (-1.f)*table->frames[idx].sample[i];
 						y2D = z3D*ca1-(ca2*y3D-sa2*x3D)*sa1+5.0f;
 						x2D = ca2*x3D+sa2*y3D+7.5f;
 						if (i == 0) {
@@ -1194,7 +1339,7 @@ struct LIMONADEWavDisplay : OpaqueWidget {
 					y3D = 10.0f * wtidx/fs -5.0f;
 					for (size_t i=0; i<FS; i++) {
 						x3D = 10.0f * i * IFS -5.0f;
-						z3D = (-1.f)*module->table.frames[wtidx].sample[i];
+						z3D = (-1.f)*table->frames[wtidx].sample[i];
 						y2D = z3D*ca1-(ca2*y3D-sa2*x3D)*sa1+5.0f;
 						x2D = ca2*x3D+sa2*y3D+7.5f;
 						if (i == 0) {
@@ -1278,7 +1423,7 @@ struct moduleSaveWavetableAsWavItem : MenuItem {
 		float sampleRate = APP->engine->getSampleRate();
 		async_dialog_filebrowser(true, "wavetable.wav", NULL, "Save wavetable", [module, sampleRate](char* path) {
 			if (path) {
-				tSaveWaveTableAsWave(module->table, sampleRate, path);
+				tSaveWaveTableAsWave(*module->table.acquire(), sampleRate, path);
 				free(path);
 			}
 		});
@@ -1286,7 +1431,7 @@ struct moduleSaveWavetableAsWavItem : MenuItem {
 		osdialog_filters* filters = osdialog_filters_parse(WAV_FILTERS);
 		char *path = osdialog_file(OSDIALOG_SAVE, dir.c_str(), "Untitled", filters);
 		if (path) {
-			tSaveWaveTableAsWave(module->table, APP->engine->getSampleRate(), path);
+			tSaveWaveTableAsWave(*module->table.acquire(), APP->engine->getSampleRate(), path);
 			free(path);
 		}
 		osdialog_filters_free(filters);
@@ -1303,7 +1448,8 @@ struct moduleSaveFrameAsWavItem : MenuItem {
 		float sampleRate = APP->engine->getSampleRate();
 		async_dialog_filebrowser(true, "frame.wav", NULL, "Save frame", [module, sampleRate](char* path) {
 			if (path) {
-				tSaveFrameAsWave(module->table, sampleRate, path, (size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames - 1)));
+				wtTable *table = module->table.acquire();
+				tSaveFrameAsWave(*table, sampleRate, path, (size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames - 1)));
 				free(path);
 			}
 		});
@@ -1311,7 +1457,8 @@ struct moduleSaveFrameAsWavItem : MenuItem {
 		osdialog_filters* filters = osdialog_filters_parse(WAV_FILTERS);
 		char *path = osdialog_file(OSDIALOG_SAVE, dir.c_str(), "Untitled", filters);
 		if (path) {
-			tSaveFrameAsWave(module->table, APP->engine->getSampleRate(), path, (size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(module->table.nFrames - 1)));
+			wtTable *table = module->table.acquire();
+			tSaveFrameAsWave(*table, APP->engine->getSampleRate(), path, (size_t)(module->params[LIMONADE::INDEX_PARAM].getValue()*(table->nFrames - 1)));
 			free(path);
 		}
 		osdialog_filters_free(filters);
@@ -1328,7 +1475,7 @@ struct moduleSaveWavetableAsPngItem : MenuItem {
 		float sampleRate = APP->engine->getSampleRate();
 		async_dialog_filebrowser(true, "wavetable.png", dir.c_str(), "Save PNG", [module, sampleRate](char* path) {
 			if (path) {
-				tSaveWaveTableAsPng(module->table, sampleRate, path);
+				tSaveWaveTableAsPng(*module->table.acquire(), sampleRate, path);
 				free(path);
 			}
 		});
@@ -1336,7 +1483,7 @@ struct moduleSaveWavetableAsPngItem : MenuItem {
 		osdialog_filters* filters = osdialog_filters_parse(PNG_FILTERS);
 		char *path = osdialog_file(OSDIALOG_SAVE, dir.c_str(), "Untitled", filters);
 		if (path) {
-			tSaveWaveTableAsPng(module->table, APP->engine->getSampleRate(), path);
+			tSaveWaveTableAsPng(*module->table.acquire(), APP->engine->getSampleRate(), path);
 			free(path);
 		}
 		osdialog_filters_free(filters);
@@ -1366,8 +1513,19 @@ struct LimonadeBlueBtnLoadFrame : BlueBtn {
 };
 
 struct LIMONADEWidget : BidooWidget {
+	// the UI only reads the table while this widget exists
+	~LIMONADEWidget() {
+		LIMONADE *module = dynamic_cast<LIMONADE*>(this->module);
+		if (module) {
+			module->table.offline(LIMONADE::UI_READER);
+		}
+	}
+
 	LIMONADEWidget(LIMONADE *module) {
 		setModule(module);
+		if (module) {
+			module->table.online(LIMONADE::UI_READER);
+		}
 		prepareThemes(asset::plugin(pluginInstance, "res/LIMONADE.svg"));
 
 		addChild(createWidget<ScrewSilver>(Vec(15, 0)));
@@ -1552,9 +1710,19 @@ struct LIMONADEWidget : BidooWidget {
 		Widget::onPathDrop(e);
 		LIMONADE *module = dynamic_cast<LIMONADE*>(this->module);
 		module->lastPath=e.paths[0];
-		tLoadSample(module->table, e.paths[0], module->frameSize, true);
+		std::string p = e.paths[0];
+		size_t frameLen = module->frameSize;
+		module->postEdit([p, frameLen](wtTable &t) { tLoadSample(t, p, frameLen, true); });
 		module->morphType = -1;
 	}
+
+	void step() override {
+		LIMONADE *module = dynamic_cast<LIMONADE*>(this->module);
+		if (module) {
+			module->table.quiescent(LIMONADE::UI_READER);
+		}
+		BidooWidget::step();
+	}
 };
 
 Model *modelLIMONADE = createModel<LIMONADE, LIMONADEWidget>("liMonADe");
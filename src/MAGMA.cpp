@@ -4,35 +4,12 @@
 #include <iomanip>
 #include "osdialog.h"
 #include "dep/waves.hpp"
-#include <mutex>
+#include "dep/rcu.hpp"
+#include "dep/loader.hpp"
+#include "dep/filters/svf.h"
 
 using namespace std;
 
-#define pi 3.14159265359
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi*freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
-
 struct channel {
 	float start=0.0f;
 	float len=1.0f;
@@ -43,7 +20,6 @@ struct channel {
 	int filterType=0;
 	float q=0.1f;
 	float freq=1.0f;
-	MultiFilter filter;
 	int kill=-1;
 	bool active=false;
 
@@ -113,17 +89,18 @@ struct MAGMA : BidooModule {
 	channel channels[16];
 	int currentChannel=0;
 	dsp::SchmittTrigger triggers[16];
-	bool loading=false;
 	int sampleChannels;
 	int sampleRate;
 	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
 	bool play = false;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
 	dsp::SchmittTrigger presetTriggers[4];
-	std::mutex mylock;
+	SVF<simd::float_4> filters[4];
+	rcu::Pointer<waves::Sample<1>> sample{new waves::Sample<1>()};
+	bool audioOnline = false;
+	loader::Worker loader{[this]() { sample.collect(); }};
 
 	MAGMA() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -141,11 +118,18 @@ struct MAGMA : BidooModule {
 		configParam(PRESET_PARAM+1, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+2, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+3, 0.0f, 1.0f, 0.0f);
-		playBuffer.resize(0);
 	}
 
 	void process(const ProcessArgs &args) override;
 
+	// process() is not called while bypassed, so the audio thread leaves the
+	// sample readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		sample.offline(0);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
 	void loadSample();
 	void saveSample();
 
@@ -262,17 +246,22 @@ struct MAGMA : BidooModule {
 };
 
 void MAGMA::loadSample() {
-	APP->engine->yieldWorkers();
-	playBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount);
-	loading = false;
+	std::string path = lastPath;
+	float engineSampleRate = APP->engine->getSampleRate();
+	waveFileName = rack::system::getFilename(path);
+	waveExtension = rack::system::getExtension(waveFileName);
+	loader.post([this, path, engineSampleRate]() {
+		std::string fileName, extension;
+		sample.publish(new waves::Sample<1>(waves::getSharedMonoWav(path, engineSampleRate, fileName, extension, sampleChannels, sampleRate, totalSampleCount)));
+	});
 }
 
 void MAGMA::process(const ProcessArgs &args) {
-	mylock.lock();
-	if (loading) {
-		loadSample();
+	if (!audioOnline) {
+		sample.online(0);
+		audioOnline = true;
 	}
-	mylock.unlock();
+	const waves::Sample<1> &playBuffer = *sample.acquire();
 	if (playBuffer.size()==0) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
@@ -371,6 +360,14 @@ void MAGMA::process(const ProcessArgs &args) {
 
 	outputs[POLY_OUTPUT].setChannels(c);
 
+	float filterIn[16] = {};
+	float filterFreq[16];
+	float filterQ[16];
+	int filterTypes[16] = {};
+	bool playing[16] = {};
+	std::fill(filterFreq, filterFreq + 16, 1000.0f);
+	std::fill(filterQ, filterQ + 16, 1.0f);
+
 	for (int i=0;i<c;i++) {
 		float start = clamp(channels[i].start + (inputs[START_INPUT].isConnected() ? rescale(inputs[START_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 		float len = clamp(channels[i].len + (inputs[LEN_INPUT].isConnected() ? rescale(inputs[LEN_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
@@ -397,24 +394,19 @@ void MAGMA::process(const ProcessArgs &args) {
 			}
 		}
 
+		if (channels[i].active && (channels[i].head + 1.0f >= playBuffer.size())) {
+			// a shorter sample was loaded under this voice
+			channels[i].active = false;
+		}
+
 		if (channels[i].active && (playBuffer.size()!=0)) {
 			int xi = channels[i].head;
 			float xf = channels[i].head - xi;
-			float crossfaded = crossfade(playBuffer[xi].samples[0], playBuffer[xi + 1].samples[0], xf);
-			channels[i].filter.setParams(freq, q, args.sampleRate);
-			channels[i].filter.calcOutput(crossfaded);
-			if (filterType == 0.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * crossfaded,i);
-			}
-			else if (filterType == 1.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.lp,i);
-			}
-			else if (filterType == 2.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.bp,i);
-			}
-			else {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.hp,i);
-			}
+			filterIn[i] = crossfade(playBuffer[xi].samples[0], playBuffer[xi + 1].samples[0], xf);
+			filterFreq[i] = freq;
+			filterQ[i] = q;
+			filterTypes[i] = filterType;
+			playing[i] = true;
 
 			channels[i].head += speed;
 			if ((channels[i].head >= (playBuffer.size()-1)) || (channels[i].head > ((start+len)*playBuffer.size()))) {
@@ -426,10 +418,32 @@ void MAGMA::process(const ProcessArgs &args) {
 				}
 			}
 		}
-		else {
-			outputs[POLY_OUTPUT].setVoltage(0.0f,i);
+	}
+
+	for (int i=0;i<c;i+=4) {
+		SVF<simd::float_4> &filter = filters[i/4];
+		filter.setParams(simd::float_4::load(filterFreq+i), simd::float_4::load(filterQ+i), args.sampleTime);
+		filter.process(simd::float_4::load(filterIn+i));
+		for (int j=i;j<std::min(i+4,c);j++) {
+			if (!playing[j]) {
+				outputs[POLY_OUTPUT].setVoltage(0.0f,j);
+			}
+			else if (filterTypes[j] == 0) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filterIn[j],j);
+			}
+			else if (filterTypes[j] == 1) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.lp[j-i],j);
+			}
+			else if (filterTypes[j] == 2) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.bp[j-i],j);
+			}
+			else {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.hp[j-i],j);
+			}
 		}
 	}
+
+	sample.quiescent(0);
 }
 
 struct MAGMAWidget : BidooWidget {
@@ -499,10 +513,8 @@ struct MAGMAWidget : BidooWidget {
 
 	static void pathSelected(MAGMA *module, char* path) {
   		if (path) {
-				module->mylock.lock();
 				module->lastPath = path;
-				module->loading = true;
-				module->mylock.unlock();
+				module->loadSample();
   			free(path);
   		}
   	}
@@ -511,10 +523,8 @@ struct MAGMAWidget : BidooWidget {
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		MAGMA *module = dynamic_cast<MAGMA*>(this->module);
-		module->mylock.lock();
 		module->lastPath = e.paths[0];
-		module->loading = true;
-		module->mylock.unlock();
+		module->loadSample();
 	}
 
   void appendContextMenu(ui::Menu *menu) override {
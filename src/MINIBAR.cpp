@@ -2,6 +2,7 @@
 #include "BidooComponents.hpp"
 #include "dsp/ringbuffer.hpp"
 #include "dsp/digital.hpp"
+#include "dep/meter.hpp"
 
 using namespace std;
 
@@ -32,20 +33,11 @@ struct MINIBAR : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float,16384> vu_L_Buffer;
-	dsp::DoubleRingBuffer<float,512> rms_L_Buffer;
-	float runningVU_L_Sum = 1e-6f, runningRMS_L_Sum = 1e-6f, rms_L = -96.3f, vu_L = -96.3f, peakL = -96.3f;
-	float in_L_dBFS = 1e-6f;
-
-	dsp::DoubleRingBuffer<float,16384> SC_vu_L_Buffer;
-	dsp::DoubleRingBuffer<float,512> SC_rms_L_Buffer;
-	float SC_runningVU_L_Sum = 1e-6f, SC_runningRMS_L_Sum = 1e-6f, SC_rms_L = -96.3f, SC_vu_L = -96.3f, SC_peakL = -96.3f;
-	float SC_in_L_dBFS = 1e-6f;
+	meter::Meter meterL, SC_meterL;
 
 	float dist = 0.0f, gain = 1.0f, gaindB = 1.0f, ratio = 1.0f, threshold = 1.0f, knee = 0.0f;
 	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, previousPostGain = 1.0f, mix = 1.0f, mixDisplay = 1.0f;
-	int indexVU = 0, indexRMS = 0, lookAheadWriteIndex=0;
-	int maxIndexVU = 0, maxIndexRMS = 0, maxLookAheadWriteIndex=0;
+	int lookAheadWriteIndex=0;
 	float lookAhead;
 	float buffL[20000] = {0.0f};
 	dsp::SchmittTrigger bypassTrigger;
@@ -74,58 +66,12 @@ void MINIBAR::process(const ProcessArgs &args) {
 	}
 	lights[BYPASS_LIGHT].setBrightness(bypass ? 1.0f : 0.0f);
 
-	if (indexVU>=16384) {
-		runningVU_L_Sum -= *vu_L_Buffer.startData();
-		vu_L_Buffer.startIncr(1);
-		SC_runningVU_L_Sum -= *SC_vu_L_Buffer.startData();
-		SC_vu_L_Buffer.startIncr(1);
-		indexVU--;
-	}
-
-	if (indexRMS>=512) {
-		runningRMS_L_Sum -= *rms_L_Buffer.startData();
-		rms_L_Buffer.startIncr(1);
-		SC_runningRMS_L_Sum -= *SC_rms_L_Buffer.startData();
-		SC_rms_L_Buffer.startIncr(1);
-		indexRMS--;
-	}
-
-	indexVU++;
-	indexRMS++;
-
-	buffL[lookAheadWriteIndex]=inputs[IN_L_INPUT].getVoltage();
-
-	if (inputs[IN_L_INPUT].isConnected())
-		in_L_dBFS = max(20.0f*log10((abs(inputs[IN_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_L_dBFS = -96.3f;
+	float inL = inputs[IN_L_INPUT].getVoltage();
 
-	if (inputs[SC_L_INPUT].isConnected())
-		SC_in_L_dBFS = max(20.0f*log10((abs(inputs[SC_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_L_dBFS = -96.3f;
+	buffL[lookAheadWriteIndex]=inL;
 
-	float data_L = in_L_dBFS*in_L_dBFS;
-	float SC_data_L = SC_in_L_dBFS*SC_in_L_dBFS;
-
-	if (!vu_L_Buffer.full()) {
-		vu_L_Buffer.push(data_L);
-		SC_vu_L_Buffer.push(SC_data_L);
-	}
-	if (!rms_L_Buffer.full()) {
-		rms_L_Buffer.push(data_L);
-		SC_rms_L_Buffer.push(SC_data_L);
-	}
-
-	runningVU_L_Sum += data_L;
-	runningRMS_L_Sum += data_L;
-	rms_L = clamp(-1 * sqrtf(runningRMS_L_Sum/512), -96.3f,0.0f);
-	vu_L = clamp(-1 * sqrtf(runningVU_L_Sum/16384), -96.3f,0.0f);
-
-	SC_runningVU_L_Sum += SC_data_L;
-	SC_runningRMS_L_Sum += SC_data_L;
-	SC_rms_L = clamp(-1 * sqrtf(SC_runningRMS_L_Sum/512), -96.3f,0.0f);
-	SC_vu_L = clamp(-1 * sqrtf(SC_runningVU_L_Sum/16384), -96.3f,0.0f);
+	meterL.process(inL, args.sampleTime);
+	SC_meterL.process(inputs[SC_L_INPUT].getVoltage(), args.sampleTime);
 
 	threshold = params[THRESHOLD_PARAM].getValue();
 	attackTime = params[ATTACK_PARAM].getValue();
@@ -134,18 +80,8 @@ void MINIBAR::process(const ProcessArgs &args) {
 	knee = params[KNEE_PARAM].getValue();
 	makeup = params[MAKEUP_PARAM].getValue();
 
-	if (in_L_dBFS>peakL)
-		peakL=in_L_dBFS;
-	else
-		peakL -= 50.0f / args.sampleRate;
-
-	if (SC_in_L_dBFS>SC_peakL)
-		SC_peakL=SC_in_L_dBFS;
-	else
-		SC_peakL -= 50.0f / args.sampleRate;
-
 	float slope = 1.0f/ratio-1.0f;
-	float maxIn = inputs[SC_L_INPUT].isConnected() ? SC_in_L_dBFS : in_L_dBFS;
+	float maxIn = meter::Meter::toDb(inputs[SC_L_INPUT].isConnected() ? SC_meterL.in : meterL.in);
 	float dist = maxIn-threshold;
 	float gcurve = 0.0f;
 
@@ -200,15 +136,15 @@ struct MINIBARDisplay : TransparentWidget {
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
-			float vuL = rescale(module->vu_L,-97.0f,0.0f,0.0f,height);
-			float rmsL = rescale(module->rms_L,-97.0f,0.0f,0.0f,height);
-			float peakL = clamp(rescale(module->peakL,0.0f,-97.0f,0.0f,height),0.f,height);
-			float inL = rescale(module->in_L_dBFS,-97.0f,0.0f,0.0f,height);
-
-			float SC_vuL = rescale(module->SC_vu_L,-97.0f,0.0f,0.0f,height);
-			float SC_rmsL = rescale(module->SC_rms_L,-97.0f,0.0f,0.0f,height);
-			float SC_peakL = clamp(rescale(module->SC_peakL,0.0f,-97.0f,0.0f,height),0.f,height);
-			float SC_inL = rescale(module->SC_in_L_dBFS,-97.0f,0.0f,0.0f,height);
+			float vuL = rescale(module->meterL.vuDb(),-97.0f,0.0f,0.0f,height);
+			float rmsL = rescale(module->meterL.rmsDb(),-97.0f,0.0f,0.0f,height);
+			float peakL = clamp(rescale(module->meterL.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float inL = rescale(module->meterL.inDb(),-97.0f,0.0f,0.0f,height);
+
+			float SC_vuL = rescale(module->SC_meterL.vuDb(),-97.0f,0.0f,0.0f,height);
+			float SC_rmsL = rescale(module->SC_meterL.rmsDb(),-97.0f,0.0f,0.0f,height);
+			float SC_peakL = clamp(rescale(module->SC_meterL.peakDb(),0.0f,-97.0f,0.0f,height),0.f,height);
+			float SC_inL = rescale(module->SC_meterL.inDb(),-97.0f,0.0f,0.0f,height);
 
 			float threshold = rescale(module->threshold,0.0f,-97.0f,0.0f,height);
 			float gain = rescale(1-(module->gaindB-module->makeup),-97.0f,0.0f,97.0f,0.0f);
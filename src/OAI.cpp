@@ -4,35 +4,12 @@
 #include <iomanip>
 #include "osdialog.h"
 #include "dep/waves.hpp"
-#include <mutex>
+#include "dep/rcu.hpp"
+#include "dep/loader.hpp"
+#include "dep/filters/svf.h"
 
 using namespace std;
 
-#define pi 3.14159265359
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi*freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
-
 struct channel {
 	float start=0.0f;
 	float len=1.0f;
@@ -43,14 +20,13 @@ struct channel {
 	int filterType=0;
 	float q=0.1f;
 	float freq=1.0f;
-	MultiFilter filter;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
-	int sampleChannels;
-	int sampleRate;
-	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
+	// written by the loader thread, read when the patch is saved
+	std::atomic<int> sampleChannels{0};
+	std::atomic<int> sampleRate{0};
+	std::atomic<int> totalSampleCount{0};
 	bool active=false;
 	int kill=-1;
 
@@ -118,9 +94,17 @@ struct OAI : BidooModule {
 	channel channels[16];
 	int currentChannel=0;
 	dsp::SchmittTrigger triggers[16];
-	bool loading=false;
 	bool play = false;
-	std::mutex mylock;
+
+	// one immutable set of channel samples, a load swaps in a new set
+	struct OAIBank {
+		waves::Sample<1> playBuffers[16];
+	};
+
+	rcu::Pointer<OAIBank> bank{new OAIBank()};
+	bool audioOnline = false;
+	SVF<simd::float_4> filters[4];
+	loader::Worker loader{[this]() { bank.collect(); }};
 
 	OAI() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -134,14 +118,18 @@ struct OAI : BidooModule {
 		configParam(FREQ_PARAM, 0.0f, 1.0f, 1.0f);
 		configParam(CHANNEL_PARAM, 0.0f, 15.0f, 0.0f);
 		configParam(KILL_PARAM, -1.0f, 15.0f, -1.0f);
-
-		for (int i=0; i<16; i++) {
-			channels[i].playBuffer.resize(0);
-		}
 	}
 
 	void process(const ProcessArgs &args) override;
 
+	// process() is not called while bypassed, so the audio thread leaves the
+	// bank readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		bank.offline(0);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
 	void loadSample();
 	void saveSample();
 
@@ -283,19 +271,31 @@ struct OAI : BidooModule {
 };
 
 void OAI::loadSample() {
-	APP->engine->yieldWorkers();
-	channels[currentChannel].playBuffer = waves::getMonoWav(channels[currentChannel].lastPath, APP->engine->getSampleRate(), channels[currentChannel].waveFileName, channels[currentChannel].waveExtension,
-	 channels[currentChannel].sampleChannels, channels[currentChannel].sampleRate, channels[currentChannel].totalSampleCount);
-	loading = false;
+	int index = currentChannel;
+	std::string path = channels[index].lastPath;
+	float engineSampleRate = APP->engine->getSampleRate();
+	channels[index].waveFileName = rack::system::getFilename(path);
+	channels[index].waveExtension = rack::system::getExtension(channels[index].waveFileName);
+	loader.post([this, index, path, engineSampleRate]() {
+		std::string fileName, extension;
+		int sampleChannels = 0, sampleRate = 0, totalSampleCount = 0;
+		OAIBank *b = new OAIBank(*bank.acquire());
+		b->playBuffers[index] = waves::getSharedMonoWav(path, engineSampleRate, fileName, extension,
+		 sampleChannels, sampleRate, totalSampleCount);
+		bank.publish(b);
+		channels[index].sampleChannels = sampleChannels;
+		channels[index].sampleRate = sampleRate;
+		channels[index].totalSampleCount = totalSampleCount;
+	});
 }
 
 void OAI::process(const ProcessArgs &args) {
-	mylock.lock();
-	if (loading) {
-		loadSample();
+	if (!audioOnline) {
+		bank.online(0);
+		audioOnline = true;
 	}
-	mylock.unlock();
-	if (channels[currentChannel].playBuffer.size()==0) {
+	const OAIBank &b = *bank.acquire();
+	if (b.playBuffers[currentChannel].size()==0) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
 		lights[SAMPLE_LIGHT+2].setBrightness(0.0f);
@@ -333,8 +333,17 @@ void OAI::process(const ProcessArgs &args) {
 
 	outputs[POLY_OUTPUT].setChannels(c);
 
+	float filterIn[16] = {};
+	float filterFreq[16];
+	float filterQ[16];
+	int filterTypes[16] = {};
+	bool playing[16] = {};
+	std::fill(filterFreq, filterFreq + 16, 1000.0f);
+	std::fill(filterQ, filterQ + 16, 1.0f);
+
 	for (int i=0;i<c;i++) {
-		if (channels[i].playBuffer.size()>0) {
+		const waves::Sample<1> &playBuffer = b.playBuffers[i];
+		if (playBuffer.size()>0) {
 			float start = clamp(channels[i].start + (inputs[START_INPUT].isConnected() ? rescale(inputs[START_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 			float len = clamp(channels[i].len + (inputs[LEN_INPUT].isConnected() ? rescale(inputs[LEN_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 			float speed = clamp(channels[i].speed + (inputs[SPEED_INPUT].isConnected() ? rescale(inputs[SPEED_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 10.0f);
@@ -346,7 +355,7 @@ void OAI::process(const ProcessArgs &args) {
 
 			if ((!channels[i].active || (gate==1.0f)) && (triggers[i].process(inputs[TRIG_INPUT].getVoltage(i)))) {
 				channels[i].active = true;
-				channels[i].head = start * channels[i].playBuffer.size();
+				channels[i].head = start * playBuffer.size();
 			}
 			else if ((gate==0.0f) && (inputs[TRIG_INPUT].getVoltage(i) == 0.0f)) {
 				channels[i].active = false;
@@ -360,40 +369,57 @@ void OAI::process(const ProcessArgs &args) {
 				}
 			}
 
+			if (channels[i].active && (channels[i].head + 1.0f >= playBuffer.size())) {
+				// a shorter sample was loaded under this voice
+				channels[i].active = false;
+			}
+
 			if (channels[i].active) {
 				int xi = channels[i].head;
 				float xf = channels[i].head - xi;
-				float crossfaded = crossfade(channels[i].playBuffer[xi].samples[0], channels[i].playBuffer[xi + 1].samples[0], xf);
-				channels[i].filter.setParams(freq, q, args.sampleRate);
-				channels[i].filter.calcOutput(crossfaded);
-				if (filterType == 0.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * crossfaded,i);
-				}
-				else if (filterType == 1.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.lp,i);
-				}
-				else if (filterType == 2.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.bp,i);
-				}
-				else {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.hp,i);
-				}
+				filterIn[i] = crossfade(playBuffer[xi].samples[0], playBuffer[xi + 1].samples[0], xf);
+				filterFreq[i] = freq;
+				filterQ[i] = q;
+				filterTypes[i] = filterType;
+				playing[i] = true;
 
 				channels[i].head += speed;
-				if ((channels[i].head >= (channels[i].playBuffer.size()-1)) || (channels[i].head > ((start+len)*channels[i].playBuffer.size()))) {
+				if ((channels[i].head >= (playBuffer.size()-1)) || (channels[i].head > ((start+len)*playBuffer.size()))) {
 					if (loop && (gate==0.0f)) {
-						channels[i].head = start*channels[i].playBuffer.size();
+						channels[i].head = start*playBuffer.size();
 					}
 					else {
 						channels[i].active=false;
 					}
 				}
 			}
+		}
+	}
+
+	for (int i=0;i<c;i+=4) {
+		SVF<simd::float_4> &filter = filters[i/4];
+		filter.setParams(simd::float_4::load(filterFreq+i), simd::float_4::load(filterQ+i), args.sampleTime);
+		filter.process(simd::float_4::load(filterIn+i));
+		for (int j=i;j<std::min(i+4,c);j++) {
+			if (!playing[j]) {
+				outputs[POLY_OUTPUT].setVoltage(0.0f,j);
+			}
+			else if (filterTypes[j] == 0) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filterIn[j],j);
+			}
+			else if (filterTypes[j] == 1) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.lp[j-i],j);
+			}
+			else if (filterTypes[j] == 2) {
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.bp[j-i],j);
+			}
 			else {
-				outputs[POLY_OUTPUT].setVoltage(0.0f,i);
+				outputs[POLY_OUTPUT].setVoltage(5.0f * filter.hp[j-i],j);
 			}
 		}
 	}
+
+	bank.quiescent(0);
 }
 
 struct OAIWidget : BidooWidget {
@@ -454,10 +480,8 @@ struct OAIWidget : BidooWidget {
 
 	static void pathSelected(OAI *module, char* path) {
   		if (path) {
-				module->mylock.lock();
 				module->channels[module->currentChannel].lastPath = path;
-  			module->loading=true;
-				module->mylock.unlock();
+				module->loadSample();
   			free(path);
   		}
   	}
@@ -466,10 +490,8 @@ struct OAIWidget : BidooWidget {
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		OAI *module = dynamic_cast<OAI*>(this->module);
-		module->mylock.lock();
 		module->channels[module->currentChannel].lastPath = e.paths[0];
-		module->loading = true;
-		module->mylock.unlock();
+		module->loadSample();
 	}
 
   void appendContextMenu(ui::Menu *menu) override {
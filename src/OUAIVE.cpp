@@ -45,7 +45,7 @@ struct OUAIVE : BidooModule {
   int sampleRate;
   int totalSampleCount=0;
 	float samplePos = 0.0f;
-	vector<dsp::Frame<2>> playBuffer;
+	waves::Sample<2> playBuffer;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
@@ -75,7 +75,6 @@ struct OUAIVE : BidooModule {
 		configParam(SPEED_PARAM, -0.05, 10, 1.0);
 		configParam(CVSPEED_PARAM, -1.0f, 1.0f, 0.0f);
 
-		playBuffer.resize(0);
 	}
 
 	void process(const ProcessArgs &args) override;
@@ -115,7 +114,7 @@ struct OUAIVE : BidooModule {
 void OUAIVE::loadSample() {
 	APP->engine->yieldWorkers();
 	mylock.lock();
-	playBuffer = waves::getStereoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
+	playBuffer = waves::getSharedStereoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
 	mylock.unlock();
 	loading = false;
 }
@@ -282,14 +281,9 @@ struct OUAIVEDisplay : OpaqueWidget {
 		if (layer == 1) {
 			if (module && (module->playBuffer.size()>0)) {
 				module->mylock.lock();
-				std::vector<float> vL;
-				std::vector<float> vR;
-				for (int i=0;i<module->totalSampleCount;i++) {
-					vL.push_back(module->playBuffer[i].samples[0]);
-					vR.push_back(module->playBuffer[i].samples[1]);
-				}
+				waves::Sample<2> sample = module->playBuffer;
 				module->mylock.unlock();
-				size_t nbSample = vL.size();
+				size_t nbSample = sample.size();
 
 				nvgFontSize(args.vg, 14);
 				nvgFillColor(args.vg, YELLOW_BIDOO);
@@ -375,13 +369,13 @@ struct OUAIVEDisplay : OpaqueWidget {
 					nvgStrokeColor(args.vg, PINK_BIDOO);
 					nvgSave(args.vg);
 					Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, height));
-					size_t inc = std::max(vL.size()/zoomWidth/4,1.f);
+					size_t inc = std::max(nbSample/zoomWidth/4,1.f);
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < vL.size(); i+=inc) {
+					for (size_t i = 0; i < nbSample; i+=inc) {
 						float x, y;
-						x = (float)i/vL.size();
-						y = (-1.f)*vL[i] / 2.0f + 0.5f;
+						x = (float)i/nbSample;
+						y = (-1.f)*sample[i].samples[0] / 2.0f + 0.5f;
 						Vec p;
 						p.x = b.pos.x + b.size.x * x;
 						p.y = b.pos.y + b.size.y * (1.0f - y);
@@ -400,10 +394,10 @@ struct OUAIVEDisplay : OpaqueWidget {
 					b = Rect(Vec(zoomLeftAnchor, height+10), Vec(zoomWidth, height));
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < vR.size(); i+=inc) {
+					for (size_t i = 0; i < nbSample; i+=inc) {
 						float x, y;
-						x = (float)i/vR.size();
-						y = (-1.f)*vR[i] / 2.0f + 0.5f;
+						x = (float)i/nbSample;
+						y = (-1.f)*sample[i].samples[1] / 2.0f + 0.5f;
 						Vec p;
 						p.x = b.pos.x + b.size.x * x;
 						p.y = b.pos.y + b.size.y * (1.0f - y);
@@ -4,7 +4,8 @@
 #include <iomanip>
 #include "osdialog.h"
 #include "dep/waves.hpp"
-#include <mutex>
+#include "dep/rcu.hpp"
+#include "dep/loader.hpp"
 
 using namespace std;
 
@@ -51,17 +52,17 @@ struct POUPRE : BidooModule {
 	int currentChannel=0;
 	dsp::SchmittTrigger triggers[16];
 	bool active[16]={false};
-	bool loading=false;
 	int sampleChannels;
 	int sampleRate;
 	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
 	bool play = false;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
 	dsp::SchmittTrigger presetTriggers[4];
-	std::mutex mylock;
+	rcu::Pointer<waves::Sample<1>> sample{new waves::Sample<1>()};
+	bool audioOnline = false;
+	loader::Worker loader{[this]() { sample.collect(); }};
 
 	POUPRE() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -76,11 +77,18 @@ struct POUPRE : BidooModule {
 		configParam(PRESET_PARAM+2, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+3, 0.0f, 1.0f, 0.0f);
 
-		playBuffer.resize(0);
 	}
 
 	void process(const ProcessArgs &args) override;
 
+	// process() is not called while bypassed, so the audio thread leaves the
+	// sample readers until it runs again
+	void onBypass(const BypassEvent& e) override {
+		sample.offline(0);
+		audioOnline = false;
+		BidooModule::onBypass(e);
+	}
+
 	void loadSample();
 	void saveSample();
 
@@ -146,17 +154,22 @@ struct POUPRE : BidooModule {
 };
 
 void POUPRE::loadSample() {
-	APP->engine->yieldWorkers();
-	playBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount);
-	loading = false;
+	std::string path = lastPath;
+	float engineSampleRate = APP->engine->getSampleRate();
+	waveFileName = rack::system::getFilename(path);
+	waveExtension = rack::system::getExtension(waveFileName);
+	loader.post([this, path, engineSampleRate]() {
+		std::string fileName, extension;
+		sample.publish(new waves::Sample<1>(waves::getSharedMonoWav(path, engineSampleRate, fileName, extension, sampleChannels, sampleRate, totalSampleCount)));
+	});
 }
 
 void POUPRE::process(const ProcessArgs &args) {
-	mylock.lock();
-	if (loading) {
-		loadSample();
+	if (!audioOnline) {
+		sample.online(0);
+		audioOnline = true;
 	}
-	mylock.unlock();
+	const waves::Sample<1> &playBuffer = *sample.acquire();
 	if (playBuffer.size()==0) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
@@ -257,6 +270,11 @@ void POUPRE::process(const ProcessArgs &args) {
 			active[i] = false;
 		}
 
+		if (active[i] && (channels[i].head + 1.0f >= playBuffer.size())) {
+			// a shorter sample was loaded under this voice
+			active[i] = false;
+		}
+
 		if (active[i] && (playBuffer.size()!=0)) {
 			int xi = channels[i].head;
 			float xf = channels[i].head - xi;
@@ -275,6 +293,8 @@ void POUPRE::process(const ProcessArgs &args) {
 			outputs[POLY_OUTPUT].setVoltage(0.0f,i);
 		}
 	}
+
+	sample.quiescent(0);
 }
 
 struct POUPREWidget : BidooWidget {
@@ -328,10 +348,8 @@ struct POUPREWidget : BidooWidget {
 
 	static void pathSelected(POUPRE *module, char* path) {
   		if (path) {
-				module->mylock.lock();
 				module->lastPath = path;
-				module->loading = true;
-				module->mylock.unlock();
+				module->loadSample();
   			free(path);
   		}
   	}
@@ -340,10 +358,8 @@ struct POUPREWidget : BidooWidget {
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		POUPRE *module = dynamic_cast<POUPRE*>(this->module);
-		module->mylock.lock();
 		module->lastPath = e.paths[0];
-		module->loading = true;
-		module->mylock.unlock();
+		module->loadSample();
 	}
 
   void appendContextMenu(ui::Menu *menu) override {
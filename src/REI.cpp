@@ -1,11 +1,12 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
-#include "dsp/ringbuffer.hpp"
 #include "dep/freeverb/revmodel.hpp"
 #include "dep/filters/pitchshifter.h"
 #include "dsp/digital.hpp"
 
 #define REIBUFF_SIZE 512
+// the shimmer used to come back through two blocks of buffering, keep that delay
+#define SHIMMER_DELAY (2 * REIBUFF_SIZE - REIBUFF_SIZE / 4)
 
 using namespace std;
 
@@ -45,12 +46,12 @@ struct REI : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float, REIBUFF_SIZE> in_Buffer;
-	dsp::DoubleRingBuffer<float, 2 * REIBUFF_SIZE> pin_Buffer;
 	revmodel revprocessor;
 	dsp::SchmittTrigger freezeTrigger;
 	bool freeze = false;
 	PitchShifter *pShifter = nullptr;
+	float shimmerDelay[SHIMMER_DELAY] = {0.0f};
+	int shimmerPos = 0;
 	int delay = 0;
 
 	REI() {
@@ -97,12 +98,7 @@ struct REI : BidooModule {
 
 		float fact = clamp(params[SHIMM_PARAM].getValue() + rescale(inputs[SHIMM_INPUT].getVoltage(), 0.0f, 10.0f, 0.0f, 1.0f), 0.0f, 1.0f)*3.0f;
 
-		if (pin_Buffer.size() > REIBUFF_SIZE) {
-			revprocessor.process(inL, inR, fact*(*pin_Buffer.startData()), outL, outR, wOutL, wOutR);
-			pin_Buffer.startIncr(1);
-		} else {
-			revprocessor.process(inL, inR, 0.0f, outL, outR, wOutL, wOutR);
-		}
+		revprocessor.process(inL, inR, fact*shimmerDelay[shimmerPos], outL, outR, wOutL, wOutR);
 
 		if (params[CLIPPING_PARAM].getValue() == 1.0f) {
 			outL = clamp(outL, -7.0f, 7.0f);
@@ -112,13 +108,8 @@ struct REI : BidooModule {
 			outR = tanh(outR / 5.0f)*7.0f;
 		}
 
-		in_Buffer.push((outL + outR)*0.05f);
-
-		if (in_Buffer.full()) {
-			pShifter->process(clamp(params[SHIMMPITCH_PARAM].getValue() + inputs[SHIMMPITCH_INPUT].getVoltage(), 0.5f, 4.0f), in_Buffer.startData(), pin_Buffer.endData());
-			pin_Buffer.endIncr(in_Buffer.size());
-			in_Buffer.clear();
-		}
+		shimmerDelay[shimmerPos] = pShifter->process(clamp(params[SHIMMPITCH_PARAM].getValue() + inputs[SHIMMPITCH_INPUT].getVoltage(), 0.5f, 4.0f), (outL + outR)*0.05f);
+		shimmerPos = (shimmerPos + 1) % SHIMMER_DELAY;
 
 		outputs[OUT_L_OUTPUT].setVoltage(outL);
 		outputs[OUT_R_OUTPUT].setVoltage(outR);
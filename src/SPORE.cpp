@@ -8,76 +8,78 @@
 
 using namespace std;
 
+using simd::float_4;
+
 const int NbGraines = 200;
 const int LongueurMax = 5000;
 
-inline void tukey (float alpha, float* x, int len) {
-  float s = 0.5f*alpha*(len-1);
-
-	for (int i = 0; i < len; i++) {
-		if( i <= s ) {
-	    x[i] *= 0.5f*(1+simd::cos(M_PI*(i/s - 1)));
-	  } else if ( i >= (len-1)*(1-0.5f*alpha) ) {
-	    x[i] *= 0.5f*(1+simd::cos(M_PI*(i/s - 2/alpha + 1)));
-	  }
-	}
-}
-
-inline void welch (float* x, int len) {
-  float s = 0.5f*(len-1);
-	for (int i = 0; i < len; i++) {
-		float f = (i - s)/s;
-		x[i] *= 1 - f*f;
-	}
-}
-
-inline float hermit(const float* p, float x, int size) {
-	int xi = x;
-	float xf = x - xi;
-	if ((xi<1) && (xi>size-4)) {
-		return crossfade(p[xi], p[xi + 1], xf);
-	}
-	else {
-		float c0 = p[xi];
-		float c1 = 0.5f*(p[xi+1]-p[xi-1]);
-		float c2 = p[xi-1] - 2.5f*p[xi] + 2*p[xi+1] - 0.5f*p[xi+2];
-		float c3 = 0.5f*(p[xi+2]-p[xi-1]) + 1.5f*(p[xi]-p[xi+1]);
-		return ((c3*xf+c2)*xf+c1)*xf+c0;
+// Grain envelopes sampled over the grain phase [0, 1] and shared by every
+// grain. Tukey and Blackman are rebuilt from the hann table: tukey reads it
+// through a remapped phase, blackman(alpha) = hann - alpha * sin^2(2 pi p).
+struct FENETRES {
+	static const int TAILLE = 1024;
+	float welch[TAILLE + 2];
+	float hann[TAILLE + 2];
+	float nuttall[TAILLE + 2];
+	float harris[TAILLE + 2];
+	float sinus[TAILLE + 2];
+
+	FENETRES() {
+		for (int i = 0; i < TAILLE + 2; i++) {
+			float p = min(i, TAILLE) / (float)TAILLE;
+			float f = 2.0f * p - 1.0f;
+			welch[i] = 1.0f - f * f;
+			hann[i] = rack::dsp::hann(p);
+			nuttall[i] = rack::dsp::blackmanNuttall(p);
+			harris[i] = rack::dsp::blackmanHarris(p);
+			float s = std::sin(2.0f * M_PI * p);
+			sinus[i] = s * s;
+		}
 	}
-}
-
+};
 
+static const FENETRES fenetres;
 
 struct GRAINE {
+	// one zero before and two after the grain for the interpolation
+	float donnees[LongueurMax + 3];
 	int status = 0;
-	float donnees[LongueurMax];
 	float teteLecture = 0;
 	int teteEcriture = 0;
-	float volume[LongueurMax];
 	int longueur = 0;
 	int dureeGermination = 0;
+	const float *fenetre = fenetres.hann;
+	float invFin = 0.0f;
+	float invAlpha = 1.0f;
+	float beta = 0.0f;
 
 	void init(int taille, int type, float attack, int duree) {
 		longueur = taille;
-		std::fill_n(donnees, longueur, 0);
-		std::fill_n(volume, longueur, 1);
+		donnees[0] = 0.0f;
+		donnees[longueur + 1] = 0.0f;
+		donnees[longueur + 2] = 0.0f;
+		invFin = 1.0f / max(longueur - 1, 1);
+		invAlpha = 1.0f;
+		beta = 0.0f;
 		if (type == 0) {
-			welch(volume,longueur);
+			fenetre = fenetres.welch;
 		}
 		else if (type == 1) {
-			tukey(attack,volume,longueur);
+			fenetre = fenetres.hann;
+			invAlpha = 1.0f / max(attack, 1e-3f);
 		}
 		else if (type == 2) {
-			rack::dsp::hannWindow(volume,longueur);
+			fenetre = fenetres.hann;
 		}
 		else if (type == 3) {
-			rack::dsp::blackmanWindow(attack,volume,longueur);
+			fenetre = fenetres.hann;
+			beta = attack;
 		}
 		else if (type == 4) {
-			rack::dsp::blackmanNuttallWindow(volume,longueur);
+			fenetre = fenetres.nuttall;
 		}
 		else {
-			rack::dsp::blackmanHarrisWindow(volume,longueur);
+			fenetre = fenetres.harris;
 		}
 		teteLecture = 0;
 		teteEcriture = 0;
@@ -87,74 +89,157 @@ struct GRAINE {
 
 	void ecrit(float valeur) {
 		if (teteEcriture<longueur) {
-			donnees[teteEcriture] = valeur;
+			donnees[teteEcriture + 1] = valeur;
 			teteEcriture++;
 		}
 		if (teteEcriture==longueur) {
 			status = 2;
 		}
 	}
-
-	float ecoute() {
-		if (status == 3) {
-			return hermit(donnees, teteLecture, longueur)*hermit(volume, teteLecture, longueur);
-		}
-		else {
-			return 0.0f;
-		}
-	}
-
 };
 
+// Grains come from a free list, the ones being recorded, waiting and playing
+// are kept in their own lists so that the cost follows the grain density.
+// Waiting grains are played in the order they were harvested.
 struct PAYSAN {
 	GRAINE graines[NbGraines];
+	int libres[NbGraines];
+	int nbLibres = NbGraines;
+	int enregistrees[NbGraines];
+	int nbEnregistrees = 0;
+	int attente[NbGraines];
+	int debutAttente = 0;
+	int nbAttente = 0;
+	int actives[NbGraines];
+	int nbActives = 0;
 	int pasRecolte = 0;
 	int pasSeme = 0;
-	int indexRecolte = 0;
-	int indexSeme = 0;
+
+	PAYSAN() {
+		for (int i = 0; i < NbGraines; i++) {
+			libres[i] = NbGraines - 1 - i;
+		}
+	}
 
 	void recolte(float valeur, int distance, int taille, int type, float attack, int dureeGermination) {
-		if ((pasRecolte <= 0) && (graines[indexRecolte].status == 0)) {
-			graines[indexRecolte].init(taille, type, attack, dureeGermination);
-			indexRecolte = (indexRecolte+1)%NbGraines;
+		if ((pasRecolte <= 0) && (nbLibres > 0)) {
+			int index = libres[--nbLibres];
+			graines[index].init(taille, type, attack, dureeGermination);
+			enregistrees[nbEnregistrees++] = index;
+			attente[(debutAttente + nbAttente) % NbGraines] = index;
+			nbAttente++;
 			pasRecolte = distance;
 		}
 
-		for (int i = 0; i < NbGraines; i++) {
-			if (graines[i].status == 1)	graines[i].ecrit(valeur);
+		for (int i = nbEnregistrees - 1; i >= 0; i--) {
+			GRAINE &graine = graines[enregistrees[i]];
+			graine.ecrit(valeur);
+			if (graine.status == 2) {
+				enregistrees[i] = enregistrees[--nbEnregistrees];
+			}
 		}
 		pasRecolte--;
 	}
 
 	void seme (int distance) {
-    pasSeme--;
-		if (pasSeme <= 0 && (graines[indexSeme].status == 2)) {
-			graines[indexSeme].status = 3;
-			indexSeme = (indexSeme+1)%NbGraines;
+		pasSeme--;
+		if ((pasSeme <= 0) && (nbAttente > 0) && (graines[attente[debutAttente]].status == 2)) {
+			int index = attente[debutAttente];
+			graines[index].status = 3;
+			actives[nbActives++] = index;
+			debutAttente = (debutAttente + 1) % NbGraines;
+			nbAttente--;
 			pasSeme = distance;
 		}
 	}
 
+	// four grains at a time, hermite interpolated samples times the envelope
 	float felibre(float vitesse) {
-		int count = 0;
-		float result = 0.0f;
-		for (int i = 0; i < NbGraines; i++) {
-			if (graines[i].status == 3) {
-				result += graines[i].ecoute();
-				graines[i].teteLecture+=vitesse;
-				graines[i].dureeGermination--;
-				if (graines[i].teteLecture>=graines[i].longueur-1) {
-					if (graines[i].dureeGermination<=0) {
-						graines[i].status = 0;
-					}
-					else {
-						graines[i].teteLecture=0;
-					}
+		static const float silence[4] = {};
+		const float taille = FENETRES::TAILLE;
+		float_4 somme = 0.0f;
+
+		for (int i = 0; i < nbActives; i += 4) {
+			float lectures[4] = {}, invFins[4] = {}, invAlphas[4] = {1.0f, 1.0f, 1.0f, 1.0f}, betas[4] = {};
+			const float *donnees[4] = {silence, silence, silence, silence};
+			const float *fenetre[4] = {fenetres.hann, fenetres.hann, fenetres.hann, fenetres.hann};
+			int n = min(4, nbActives - i);
+			for (int j = 0; j < n; j++) {
+				const GRAINE &graine = graines[actives[i + j]];
+				lectures[j] = graine.teteLecture;
+				invFins[j] = graine.invFin;
+				invAlphas[j] = graine.invAlpha;
+				betas[j] = graine.beta;
+				donnees[j] = graine.donnees;
+				fenetre[j] = graine.fenetre;
+			}
+
+			float_4 lecture = float_4::load(lectures);
+			float_4 xi = simd::floor(lecture);
+			float_4 xf = lecture - xi;
+			float_4 p = lecture * float_4::load(invFins);
+			float_4 invAlpha = float_4::load(invAlphas);
+			float_4 q = simd::ifelse(p < 0.5f, simd::fmin(p * invAlpha, 0.5f), simd::fmax(1.0f - (1.0f - p) * invAlpha, 0.5f));
+			float_4 qPos = q * taille;
+			float_4 qi = simd::floor(qPos);
+			float_4 qf = qPos - qi;
+			float_4 pPos = p * taille;
+			float_4 pi = simd::floor(pPos);
+			float_4 pf = pPos - pi;
+
+			float x[4], qIndex[4], pIndex[4];
+			xi.store(x);
+			qi.store(qIndex);
+			pi.store(pIndex);
+			float y0[4], y1[4], y2[4], y3[4], w0[4], w1[4], s0[4], s1[4];
+			for (int j = 0; j < 4; j++) {
+				const float *d = donnees[j] + (int)x[j];
+				y0[j] = d[0];
+				y1[j] = d[1];
+				y2[j] = d[2];
+				y3[j] = d[3];
+				const float *w = fenetre[j] + (int)qIndex[j];
+				w0[j] = w[0];
+				w1[j] = w[1];
+				const float *s = fenetres.sinus + (int)pIndex[j];
+				s0[j] = s[0];
+				s1[j] = s[1];
+			}
+
+			float_4 p0 = float_4::load(y0);
+			float_4 p1 = float_4::load(y1);
+			float_4 p2 = float_4::load(y2);
+			float_4 p3 = float_4::load(y3);
+			float_4 c1 = 0.5f * (p2 - p0);
+			float_4 c2 = p0 - 2.5f * p1 + 2.0f * p2 - 0.5f * p3;
+			float_4 c3 = 0.5f * (p3 - p0) + 1.5f * (p1 - p2);
+			float_4 echantillon = ((c3 * xf + c2) * xf + c1) * xf + p1;
+
+			float_4 a = float_4::load(w0);
+			float_4 b = float_4::load(s0);
+			float_4 volume = a + (float_4::load(w1) - a) * qf - float_4::load(betas) * (b + (float_4::load(s1) - b) * pf);
+
+			somme += echantillon * volume;
+		}
+
+		int count = nbActives;
+		for (int i = nbActives - 1; i >= 0; i--) {
+			GRAINE &graine = graines[actives[i]];
+			graine.teteLecture+=vitesse;
+			graine.dureeGermination--;
+			if (graine.teteLecture>=graine.longueur-1) {
+				if (graine.dureeGermination<=0) {
+					graine.status = 0;
+					libres[nbLibres++] = actives[i];
+					actives[i] = actives[--nbActives];
+				}
+				else {
+					graine.teteLecture=0;
 				}
-				count++;
 			}
 		}
-		return result/max(count,1);
+
+		return (somme[0] + somme[1] + somme[2] + somme[3])/max(count,1);
 	}
 };
 
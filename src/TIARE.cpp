@@ -2,342 +2,12 @@
 #include "BidooComponents.hpp"
 #include "dsp/resampler.hpp"
 #include "dsp/filter.hpp"
+#include "dep/osc/tiareOsc.h"
 
 using namespace std;
 
 using simd::float_4;
 
-
-// Accurate only on [0, 1]
-template <typename T>
-T sin2pi_pade_05_7_6(T x) {
-	x -= 0.5f;
-	return (T(-6.28319) * x + T(35.353) * simd::pow(x, 3) - T(44.9043) * simd::pow(x, 5) + T(16.0951) * simd::pow(x, 7))
-	       / (1 + T(0.953136) * simd::pow(x, 2) + T(0.430238) * simd::pow(x, 4) + T(0.0981408) * simd::pow(x, 6));
-}
-
-template <typename T>
-T sin2pi_pade_05_5_4(T x) {
-	x -= 0.5f;
-	return (T(-6.283185307) * x + T(33.19863968) * simd::pow(x, 3) - T(32.44191367) * simd::pow(x, 5))
-	       / (1 + T(1.296008659) * simd::pow(x, 2) + T(0.7028072946) * simd::pow(x, 4));
-}
-
-template <typename T>
-T expCurve(T x) {
-	return (3 + x * (-13 + 5 * x)) / (3 + 2 * x);
-}
-
-
-template <int OVERSAMPLE, int QUALITY, typename T>
-struct Oscillator {
-	bool analog = false;
-	bool soft = false;
-	bool syncEnabled = false;
-	// For optimizing in serial code
-	int channels = 0;
-
-	T lastSyncValue = 0.f;
-	T phase = 0.f;
-	T phaseDist = 0.f;
-	T freq;
-	T pulseWidth = 0.5f;
-	T syncDirection = 1.f;
-	int lfoFactor = 1;
-
-	dsp::TRCFilter<T> sqrFilter;
-
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sqrMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sawMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> triMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sinMinBlep;
-
-	T sqrValue = 0.f;
-	T lastSqrValue = 0.f;
-	T sawValue = 0.f;
-	T lastSawValue = 0.f;
-	T triValue = 0.f;
-	T lastTriValue = 0.f;
-	T sinValue = 0.f;
-	T lastSinValue = 0.f;
-
-	void setPitch(T pitch, int factor) {
-		lfoFactor = factor;
-		freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch + 30) / 1073741824 / factor;
-	}
-
-	void setPulseWidth(T pulseWidth) {
-		const float pwMin = 0.01f;
-		this->pulseWidth = simd::clamp(pulseWidth, pwMin, 1.f - pwMin);
-	}
-
-	void process(float deltaTime, T syncValue, float phaseDistX, float phaseDistY) {
-		// Advance phase
-		T deltaPhase = simd::clamp(freq * deltaTime, 1e-6f, 0.35f);
-
-		if (soft) {
-			// Reverse direction
-			deltaPhase *= syncDirection;
-		}
-		else {
-			// Reset back to forward
-			syncDirection = 1.f;
-		}
-
-		// Wrap phase
-		phase += deltaPhase;
-		phase -= simd::floor(phase);
-
-		for (int i=0; i<channels; i++) {
-			if (phase[i] <= phaseDistX)
-					phaseDist[i] = phase[i] * phaseDistY / phaseDistX;
-				else
-					phaseDist[i] = phaseDistY + (phase[i]-phaseDistX) * (1.0f - phaseDistY) / (1.0f - phaseDistX);
-		}
-
-		// Wrap phase
-		phaseDist -= simd::floor(phaseDist);
-
-
-		if (lfoFactor == 1) {
-
-		// 	T wrapPhase = (syncDirection == -1.f) & 1.f;
-		// 	T wrapCrossing = (wrapPhase - (phase - deltaPhase)) / deltaPhase;
-		// 	int wrapMask = simd::movemask((0 < wrapCrossing) & (wrapCrossing <= 1.f));
-		// 	if (wrapMask) {
-		// 		for (int i = 0; i < channels; i++) {
-		// 			if (wrapMask & (1 << i)) {
-		// 				T mask = simd::movemaskInverse<T>(1 << i);
-		// 				float p = wrapCrossing[i] - 1.0f;
-		// 				T x = mask & (2.f * syncDirection);
-		// 				sqrMinBlep.insertDiscontinuity(p, x);
-		// 			}
-		// 		}
-		// 	}
-		//
-		// 	T pulseCrossing = (0.5f - (phaseDist - deltaPhase)) / deltaPhase;
-		// 	int pulseMask = simd::movemask((0 < pulseCrossing) & (pulseCrossing <= 1.f));
-		// 	if (pulseMask) {
-		// 		for (int i = 0; i < channels; i++) {
-		// 			if (pulseMask & (1 << i)) {
-		// 				T mask = simd::movemaskInverse<T>(1 << i);
-		// 				float p = pulseCrossing[i] - 0.5f;
-		// 				T x = mask & (-2.f * syncDirection);
-		// 				sqrMinBlep.insertDiscontinuity(p, x);
-		// 			}
-		// 		}
-		// 	}
-		//
-		// 	T halfCrossing = (0.5f - (phaseDist - deltaPhase)) / deltaPhase;
-		// 	int halfMask = simd::movemask((0 < halfCrossing) & (halfCrossing <= 1.f));
-		// 	if (halfMask) {
-		// 		for (int i = 0; i < channels; i++) {
-		// 			if (halfMask & (1 << i)) {
-		// 				T mask = simd::movemaskInverse<T>(1 << i);
-		// 				float p = halfCrossing[i] - 0.5f;
-		// 				T x = mask & (-2.f * syncDirection);
-		// 				sawMinBlep.insertDiscontinuity(p, x);
-		// 			}
-		// 		}
-		// 	}
-		//
-			if (syncEnabled) {
-				T deltaSync = syncValue - lastSyncValue;
-				T syncCrossing = -lastSyncValue / deltaSync;
-				lastSyncValue = syncValue;
-				T sync = (0.f < syncCrossing) & (syncCrossing <= 1.f) & (syncValue >= 0.f);
-				int syncMask = simd::movemask(sync);
-				if (syncMask) {
-					if (soft) {
-						syncDirection = simd::ifelse(sync, -syncDirection, syncDirection);
-					}
-					else {
-						T newPhase = simd::ifelse(sync, (1.f - syncCrossing) * deltaPhase, phase);
-						// Insert minBLEP for sync
-						for (int i = 0; i < channels; i++) {
-							if (syncMask & (1 << i)) {
-								T mask = simd::movemaskInverse<T>(1 << i);
-								float p = syncCrossing[i] - 1.f;
-								T x;
-								x = mask & (sqr(newPhase) - sqr(phaseDist));
-								sqrMinBlep.insertDiscontinuity(p, x);
-								x = mask & (saw(newPhase) - saw(phaseDist));
-								sawMinBlep.insertDiscontinuity(p, x);
-								x = mask & (tri(newPhase) - tri(phaseDist));
-								triMinBlep.insertDiscontinuity(p, x);
-								x = mask & (sin(newPhase) - sin(phaseDist));
-								sinMinBlep.insertDiscontinuity(p, x);
-							}
-						}
-						phase = newPhase;
-					}
-				}
-			}
-		}
-
-		sqrValue = sqr(phaseDist);
-
-		if (lfoFactor == 1) {
-			T deltaOut = sqrValue - lastSqrValue;
-	    T outCrossing = -lastSqrValue / deltaOut;
-	    lastSqrValue = sqrValue;
-	    int outMask =  simd::movemask((0.f < outCrossing) & (outCrossing <= 1.f) & (sqrValue >= 0.f));
-	    if (outMask) {
-	      for (int i = 0; i < channels; i++) {
-	        if (outMask & (1 << i)) {
-	          T mask = simd::movemaskInverse<T>(1 << i);
-	          float p = outCrossing[i] - 1.f;
-	          T x;
-	          x = mask & (sqr(phaseDist+deltaPhase-simd::floor(phaseDist+deltaPhase)) - sqr(phaseDist));
-	          sqrMinBlep.insertDiscontinuity(p, x);
-	        }
-	      }
-	    }
-		}
-
-		sqrValue += sqrMinBlep.process();
-
-		if (analog) {
-			sqrFilter.setCutoffFreq(20.f * deltaTime);
-			sqrFilter.process(sqrValue);
-			sqrValue = sqrFilter.highpass() * 0.95f;
-		}
-
-		sawValue = saw(phaseDist);
-
-		if (lfoFactor == 1) {
-			T deltaOut = sawValue - lastSawValue;
-	    T outCrossing = -lastSawValue / deltaOut;
-	    lastSawValue = sawValue;
-	    int outMask =  simd::movemask((0.f < outCrossing) & (outCrossing <= 1.f) & (sawValue >= 0.f));
-	    if (outMask) {
-	      for (int i = 0; i < channels; i++) {
-	        if (outMask & (1 << i)) {
-	          T mask = simd::movemaskInverse<T>(1 << i);
-	          float p = outCrossing[i] - 1.f;
-	          T x;
-	          x = mask & (saw(phaseDist+deltaPhase-simd::floor(phaseDist+deltaPhase)) - saw(phaseDist));
-	          sawMinBlep.insertDiscontinuity(p, x);
-	        }
-	      }
-	    }
-		}
-
-		sawValue += sawMinBlep.process();
-
-		triValue = tri(phaseDist);
-
-		if (lfoFactor == 1) {
-			T deltaOut = triValue - lastTriValue;
-			T outCrossing = -lastTriValue / deltaOut;
-			lastTriValue = triValue;
-			int outMask =  simd::movemask((0.f < outCrossing) & (outCrossing <= 1.f) & (triValue >= 0.f));
-			if (outMask) {
-				for (int i = 0; i < channels; i++) {
-					if (outMask & (1 << i)) {
-						T mask = simd::movemaskInverse<T>(1 << i);
-						float p = outCrossing[i] - 1.f;
-						T x;
-						x = mask & (tri(phaseDist+deltaPhase-simd::floor(phaseDist+deltaPhase)) - tri(phaseDist));
-						triMinBlep.insertDiscontinuity(p, x);
-					}
-				}
-			}
-		}
-
-		triValue += triMinBlep.process();
-
-		sinValue = sin(phaseDist);
-
-		if (lfoFactor == 1) {
-			T deltaOut = sinValue - lastSinValue;
-			T outCrossing = -lastSinValue / deltaOut;
-			lastSinValue = sinValue;
-			int outMask =  simd::movemask((0.f < outCrossing) & (outCrossing <= 1.f) & (sinValue >= 0.f));
-			if (outMask) {
-				for (int i = 0; i < channels; i++) {
-					if (outMask & (1 << i)) {
-						T mask = simd::movemaskInverse<T>(1 << i);
-						float p = outCrossing[i] - 1.f;
-						T x;
-						x = mask & (sin(phaseDist+deltaPhase-simd::floor(phaseDist+deltaPhase)) - sin(phaseDist));
-						sinMinBlep.insertDiscontinuity(p, x);
-					}
-				}
-			}
-		}
-
-		sinValue += sinMinBlep.process();
-	}
-
-	T sin(T phase) {
-		T v;
-		if (analog) {
-			// Quadratic approximation of sine, slightly richer harmonics
-			T halfPhase = (phase < 0.5f);
-			T x = phase - simd::ifelse(halfPhase, 0.25f, 0.75f);
-			v = 1.f - 16.f * simd::pow(x, 2);
-			v *= simd::ifelse(halfPhase, 1.f, -1.f);
-		}
-		else {
-			v = sin2pi_pade_05_5_4(phase);
-			// v = sin2pi_pade_05_7_6(phase);
-			// v = simd::sin(2 * T(M_PI) * phase);
-		}
-		return v;
-	}
-	T sin() {
-		return sinValue;
-	}
-
-	T tri(T phase) {
-		T v;
-		if (analog) {
-			T x = phase + 0.25f;
-			x -= simd::trunc(x);
-			T halfX = (x >= 0.5f);
-			x *= 2;
-			x -= simd::trunc(x);
-			v = expCurve(x) * simd::ifelse(halfX, 1.f, -1.f);
-		}
-		else {
-			v = 1 - 4 * simd::fmin(simd::fabs(phase - 0.25f), simd::fabs(phase - 1.25f));
-		}
-		return v;
-	}
-	T tri() {
-		return triValue;
-	}
-
-	T saw(T phase) {
-		T v;
-		T x = phase + 0.5f;
-		x -= simd::trunc(x);
-		if (analog) {
-			v = -expCurve(x);
-		}
-		else {
-			v = 2 * x - 1;
-		}
-		return v;
-	}
-	T saw() {
-		return sawValue;
-	}
-
-	T sqr(T phase) {
-		T v = simd::ifelse(phase < pulseWidth, 1.f, -1.f);
-		return v;
-	}
-	T sqr() {
-		return sqrValue;
-	}
-
-	T light() {
-		return simd::sin(2 * T(M_PI) * phase);
-	}
-};
-
 struct TIARE : BidooModule {
 	enum ParamIds {
 		FREQ_PARAM,
@@ -372,7 +42,7 @@ struct TIARE : BidooModule {
 	float phaseDist = 0.0f;
 	float phaseDistX = 0.5f, phaseDistY = 0.5f;
 	int freqFactor = 1;
-	Oscillator<16, 16, float_4> oscillators[4];
+	tiare::Oscillator<16, 16, float_4> oscillators[4];
 
 	TIARE() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -453,6 +123,7 @@ struct TIARE : BidooModule {
 			oscillator->channels = std::min(channels - c, 4);
 			oscillator->analog = params[MODE_PARAM].getValue() > 0.f;
 			oscillator->soft = params[SYNC_PARAM].getValue() <= 0.f;
+			oscillator->setEnabled(outputs[SIN_OUTPUT].isConnected(), outputs[TRI_OUTPUT].isConnected(), outputs[SAW_OUTPUT].isConnected(), outputs[SQR_OUTPUT].isConnected());
 
 			float_4 pitch = freqParam;
 			pitch += inputs[PITCH_INPUT].getVoltageSimd<float_4>(c);
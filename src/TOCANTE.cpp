@@ -1,6 +1,7 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/digital.hpp"
+#include "dep/tickclock.hpp"
 
 using namespace std;
 
@@ -44,22 +45,20 @@ struct TOCANTE : BidooModule {
 		NUM_LIGHTS
 	};
 
+	// The clock counts ticks of a 96 PPQN grid, the smallest one holding
+	// every division output and all beat lengths (4/ref quarters).
+	static const int TICKS_PER_QUARTER = 96;
+
 	int ref = 2;
 	int beats = 1;
-	int currentStep = 0;
-	int stepsPerMeasure = 1;
-	int stepsPerBeat = 1;
-	int stepsPerOneHundredTwentyEighth = 1;
-	int stepsPerSixtyFourth = 1;
-	int stepsPerThirtySecond = 1;
-	int stepsPerSixteenth = 1;
-	int stepsPerEighth = 1;
-	int stepsPerQuarter = 1;
-	int stepsPerTriplet = 1;
+	tickclock::Clock clock;
+	int measureTicks = 1;
+	int divisionTicks[OUT_RESET] = {};
+	int ticksToEdge[OUT_RESET] = {};
+	float incrementBpm = 0.0f, incrementSampleRate = 0.0f;
+	int incrementRef = 0;
 
 	int count = 0;
-	dsp::PulseGenerator gatePulse;
-	dsp::PulseGenerator gatePulse_triplets;
 	dsp::PulseGenerator gatePulse_Measure;
 	dsp::PulseGenerator resetPulse;
 	dsp::PulseGenerator runPulse;
@@ -68,7 +67,7 @@ struct TOCANTE : BidooModule {
 	bool running = false;
 	bool reset = false;
 	float runningLight = 0.0f;
-	bool pulseEven = false, pulseTriplets = false, pulseMeasure = false, pulseReset = false, pulseRun = false;
+	bool pulseMeasure = false, pulseReset = false, pulseRun = false;
 	float bpm = 0.0f;
 
 	TOCANTE() {
@@ -77,6 +76,21 @@ struct TOCANTE : BidooModule {
 		configParam(BPMFINE_PARAM, 0.f, 0.99f, 0.f, "Fine");
 		configParam(BEATS_PARAM,  1.f, 32.f, 4.f, "Beats per measure");
 		configParam(REF_PARAM, 1.f, 4.f, 2.f, "Note value");
+
+		divisionTicks[OUT_TRIPLET] = TICKS_PER_QUARTER / 3;
+		divisionTicks[OUT_QUARTER] = TICKS_PER_QUARTER;
+		divisionTicks[OUT_EIGHTH] = TICKS_PER_QUARTER / 2;
+		divisionTicks[OUT_SIXTEENTH] = TICKS_PER_QUARTER / 4;
+		divisionTicks[OUT_THIRTYSECOND] = TICKS_PER_QUARTER / 8;
+		divisionTicks[OUT_SIXTYFOURTH] = TICKS_PER_QUARTER / 16;
+		divisionTicks[OUT_ONEHUNDREDTWENTYEIGHTH] = TICKS_PER_QUARTER / 32;
+	}
+
+	void restart() {
+		clock.restart();
+		count = beats;
+		resetPulse.trigger(1e-3f);
+		lights[RESET_LIGHT].setBrightness(1.0);
 	}
 
 	void process(const ProcessArgs &args) override;
@@ -87,79 +101,67 @@ void TOCANTE::process(const ProcessArgs &args) {
 	ref = clamp(powf(2.0f,params[REF_PARAM].getValue()+(int)rescale(clamp(inputs[REF_INPUT].getVoltage(),0.0f,10.0f),0.0f,10.0f,0.0f,3.0f)),2.0f,16.0f);
 	beats = clamp(params[BEATS_PARAM].getValue()+rescale(clamp(inputs[BEATS_INPUT].getVoltage(),0.0f,10.0f),0.0f,10.0f,0.0f,32.0f),1.0f,32.0f);
 	bpm = clamp(round(params[BPM_PARAM].getValue()+rescale(clamp(inputs[BPM_INPUT].getVoltage(),0.0f,10.0f),0.0f,10.0f,0.0f,350.0f)) + round(100*(params[BPMFINE_PARAM].getValue()+rescale(clamp(inputs[BPMFINE_INPUT].getVoltage(),0.0f,10.0f),0.0f,10.0f,0.0f,0.99f))) * 0.01f, 1.0f, 350.0f);
-	stepsPerOneHundredTwentyEighth = (ref/4.0f) * 60.0f * args.sampleRate / bpm / 128.0f;
-	stepsPerSixtyFourth = stepsPerOneHundredTwentyEighth * 8;
-	stepsPerThirtySecond = stepsPerSixtyFourth * 2;
-	stepsPerSixteenth =  stepsPerThirtySecond * 2;
-	stepsPerEighth = stepsPerSixteenth * 2;
-	stepsPerQuarter = stepsPerEighth * 2;
-	stepsPerTriplet = stepsPerQuarter / 3;
-	stepsPerBeat = stepsPerOneHundredTwentyEighth* 128 * 4 / ref;
-	stepsPerMeasure = beats*stepsPerBeat;
+
+	if ((bpm != incrementBpm) || (ref != incrementRef) || (args.sampleRate != incrementSampleRate)) {
+		double ticksPerSample = (double)TICKS_PER_QUARTER * 4.0 * bpm / (60.0 * ref * args.sampleRate);
+		clock.setRate(ticksPerSample);
+		incrementBpm = bpm;
+		incrementRef = ref;
+		incrementSampleRate = args.sampleRate;
+	}
+	divisionTicks[OUT_BEAT] = TICKS_PER_QUARTER * 4 / ref;
+	measureTicks = beats * divisionTicks[OUT_BEAT];
 
 	lights[RESET_LIGHT].setBrightness(lights[RESET_LIGHT].getBrightness()-0.0001f*lights[RESET_LIGHT].getBrightness());
 
 	if (runningTrigger.process(params[RUN_PARAM].getValue())) {
 		running = !running;
 		if (running) {
-			currentStep = 0;
-			count = beats;
-			resetPulse.trigger(1e-3f);
-			lights[RESET_LIGHT].setBrightness(1.0);
+			restart();
 		}
 		runPulse.trigger(1e-3f);
 	}
 
 	if (resetTrigger.process(params[RESET_PARAM].getValue())){
-		currentStep = 0;
-		count = beats;
-		resetPulse.trigger(1e-3f);
-		lights[RESET_LIGHT].setBrightness(1.0);
+		restart();
 	}
 
-	if ((stepsPerSixteenth>0) && ((currentStep % stepsPerOneHundredTwentyEighth) == 0)) {
-		gatePulse.trigger(1e-3f);
-	}
-
-	if ((stepsPerTriplet>0) && ((currentStep % stepsPerTriplet) == 0) && (currentStep <= (stepsPerMeasure-100))) {
-		gatePulse_triplets.trigger(1e-3f);
-	}
-
-	if (currentStep == 0) {
-		gatePulse_Measure.trigger(1e-3f);
+	// at most one tick per sample: 350 BPM on half notes is 0.14 tick per
+	// sample at 8 kHz
+	bool edges[OUT_RESET] = {};
+	int tick = running ? clock.process(measureTicks) : -1;
+	if (tick >= 0) {
+		for (int i = OUT_BEAT; i < OUT_RESET; i++) {
+			if ((tick == 0) || (ticksToEdge[i] <= 0)) {
+				edges[i] = true;
+				ticksToEdge[i] = divisionTicks[i];
+			}
+			ticksToEdge[i]--;
+		}
+		if (tick == 0) {
+			gatePulse_Measure.trigger(1e-3f);
+		}
+		if (edges[OUT_BEAT]) {
+			count--;
+		}
 	}
 
-	pulseEven = gatePulse.process(args.sampleTime);
-	pulseTriplets = gatePulse_triplets.process(args.sampleTime);
 	pulseMeasure = gatePulse_Measure.process(args.sampleTime);
 	pulseReset = resetPulse.process(args.sampleTime);
 	pulseRun = runPulse.process(args.sampleTime);
 
-	if (currentStep % stepsPerBeat == 0) {
-		count--;
-	}
-
 	if (pulseMeasure) {
 		count = beats;
 	}
 
 	outputs[OUT_MEASURE].setVoltage((running && pulseMeasure) ? 10.0f : 0.0f);
-	outputs[OUT_BEAT].setVoltage((running && (currentStep % stepsPerBeat == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_TRIPLET].setVoltage((running && pulseTriplets && (currentStep % stepsPerTriplet == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_QUARTER].setVoltage((running && pulseEven && (currentStep % stepsPerQuarter == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_EIGHTH].setVoltage((running && pulseEven && (currentStep % stepsPerEighth == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_SIXTEENTH].setVoltage((running && pulseEven && (currentStep % stepsPerSixteenth == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_THIRTYSECOND].setVoltage((running && pulseEven && (currentStep % stepsPerThirtySecond == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_SIXTYFOURTH].setVoltage((running && pulseEven && (currentStep % stepsPerSixtyFourth == 0)) ? 10.0f : 0.0f);
-	outputs[OUT_ONEHUNDREDTWENTYEIGHTH].setVoltage((running && pulseEven && (currentStep % stepsPerOneHundredTwentyEighth == 0)) ? 10.0f : 0.0f);
+	for (int i = OUT_BEAT; i < OUT_RESET; i++) {
+		outputs[i].setVoltage(edges[i] ? 10.0f : 0.0f);
+	}
 
 	outputs[OUT_RESET].setVoltage(pulseReset ? 10.0f : 0.0f);
 	outputs[OUT_RUN].setVoltage(pulseRun ? 10.0f : 0.0f);
 
-
-	if (running) {
-		currentStep = floor((currentStep + 1) % stepsPerMeasure);
-	}
 	lights[RUNNING_LIGHT].setBrightness(running ? 1.0 : 0.0);
 }
 
@@ -9,81 +9,32 @@ using namespace std;
 #define BANDS4 4
 using simd::float_4;
 
-class ZBiquad {
-public:
-    ZBiquad();
-    ZBiquad(float_4 Fc, float_4 Q, float_4 peakGainDB);
-    ~ZBiquad();
-    void setQ(float_4 Q);
-    void setFc(float_4 Fc);
-    void setPeakGain(float_4 peakGainDB);
-    void setBiquad(float_4 Fc, float_4 Q, float_4 peakGain);
-    float_4 process(float_4 in);
-
-protected:
-    void calcBiquad(void);
-
-    float_4 a0, a1, a2, b1, b2;
-    float_4 Fc, Q, peakGain;
-    float_4 z1, z2;
+// Bandpass biquads (0 dB peak) for four bands at once. The coefficients are
+// kept apart from the filter state so that both carrier channels share them,
+// and are only recomputed when Q or the sample rate change.
+struct ZBiquadCoefs {
+	float_4 a0 = 0.f, b1 = 0.f, b2 = 0.f;
+
+	void set(float_4 Fc, float Q) {
+		float_4 K = simd::tan(M_PI * Fc);
+		float_4 norm = 1.f / (1.f + K / Q + K * K);
+		a0 = K / Q * norm;
+		b1 = 2.f * (K * K - 1.f) * norm;
+		b2 = (1.f - K / Q + K * K) * norm;
+	}
 };
 
-inline float_4 ZBiquad::process(float_4 in) {
-    float_4 out = in * a0 + z1;
-    z1 = in * a1 + z2 - b1 * out;
-    z2 = in * a2 - b2 * out;
-    return out;
-}
+struct ZBiquad {
+	float_4 z1 = 0.f, z2 = 0.f;
 
-ZBiquad::ZBiquad() {
-    a0 = 1.0;
-    a1 = a2 = b1 = b2 = 0.0;
-    Fc = 0.50;
-    Q = 0.707;
-    peakGain = 0.0;
-    z1 = z2 = 0.0;
-}
-
-ZBiquad::ZBiquad(float_4 Fc, float_4 Q, float_4 peakGainDB) {
-    setBiquad(Fc, Q, peakGainDB);
-    z1 = z2 = 0.0;
-}
-
-ZBiquad::~ZBiquad() {
-}
-
-void ZBiquad::setQ(float_4 Q) {
-    this->Q = Q;
-    calcBiquad();
-}
-
-void ZBiquad::setFc(float_4 Fc) {
-    this->Fc = Fc;
-    calcBiquad();
-}
-
-void ZBiquad::setPeakGain(float_4 peakGainDB) {
-    this->peakGain = peakGainDB;
-    calcBiquad();
-}
-
-void ZBiquad::setBiquad(float_4 Fc, float_4 Q, float_4 peakGainDB) {
-    this->Q = Q;
-    this->Fc = Fc;
-    setPeakGain(peakGainDB);
-}
-
-void ZBiquad::calcBiquad(void) {
-    float_4 norm;
-    float_4 K = tan(M_PI * Fc);
-    norm = 1 / (1 + K / Q + K * K);
-    a0 = K / Q * norm;
-    a1 = 0;
-    a2 = -a0;
-    b1 = 2 * (K * K - 1) * norm;
-    b2 = (1 - K / Q + K * K) * norm;
-    return;
-}
+	// a1 is 0 and a2 is -a0 for the bandpass
+	inline float_4 process(float_4 in, const ZBiquadCoefs &c) {
+		float_4 out = in * c.a0 + z1;
+		z1 = z2 - c.b1 * out;
+		z2 = -(in * c.a0) - c.b2 * out;
+		return out;
+	}
+};
 
 struct ZINC : BidooModule {
 	enum ParamIds {
@@ -113,8 +64,14 @@ struct ZINC : BidooModule {
 		NUM_LIGHTS
 	};
 
-	ZBiquad* iFilter[BANDS2];
-	ZBiquad* cFilter[BANDS2];
+	// two stages for the modulator (Q1, Q2) and two for the carrier (Q3, Q4)
+	ZBiquadCoefs coefs[4][BANDS4];
+	ZBiquad modFilters[2][BANDS4];
+	ZBiquad carrFilters[2][2][BANDS4];
+	float lastQ[4] = { 0.0f };
+	// Patches saved before the Q knobs were split play every stage with Q1
+	bool linkedQ = false;
+	float lastSampleRate = 0.0f;
 	float_4 mem[BANDS4] = { 0.0f };
 	float_4 freq[BANDS4] = { {125.0f, 185.0f, 270.0f, 350.0f}, {430.0f, 530.0f, 630.0f, 780.0f},
 						  {950.0f, 1150.0f, 1380.0f, 1680.0f}, {2070.0f, 2780.0f, 3800.0f, 6400.0f} };
@@ -138,58 +95,67 @@ struct ZINC : BidooModule {
 		configParam(Q2_PARAM, 1.f, 10.f, 5.f, "Q", "dB", 0.f, 1.f);
 		configParam(Q3_PARAM, 1.f, 10.f, 5.f, "Q", "dB", 0.f, 1.f);
 		configParam(Q4_PARAM, 1.f, 10.f, 5.f, "Q", "dB", 0.f, 1.f);
+		configInput(IN_CARR, "Carrier, two channels for stereo");
+	}
 
-		for (int i = 0; i < BANDS2; i++) {
-			iFilter[i] = new ZBiquad(freq[i%4] / APP->engine->getSampleRate(), {5.0f}, {6.0f});
-			cFilter[i] = new ZBiquad(freq[i%4] / APP->engine->getSampleRate(), {5.0f}, {6.0f});
-		}
+	json_t *dataToJson() override {
+		json_t *rootJ = BidooModule::dataToJson();
+		json_object_set_new(rootJ, "linkedQ", json_boolean(linkedQ));
+		return rootJ;
 	}
 
-	~ZINC() override {
-		for (int i = 0; i < BANDS2; i++) {
-			delete iFilter[i];
-			delete cFilter[i];
+	void dataFromJson(json_t *rootJ) override {
+		BidooModule::dataFromJson(rootJ);
+		json_t *linkedQJ = json_object_get(rootJ, "linkedQ");
+		linkedQ = linkedQJ ? json_is_true(linkedQJ) : true;
+	}
+
+	void updateCoefs(float sampleRate) {
+		bool rateChanged = sampleRate != lastSampleRate;
+		for (int s = 0; s < 4; s++) {
+			float q = params[linkedQ ? Q1_PARAM : Q1_PARAM + s].getValue();
+			if (rateChanged || (q != lastQ[s])) {
+				for (int i = 0; i < BANDS4; i++) {
+					coefs[s][i].set(freq[i] / sampleRate, q);
+				}
+				lastQ[s] = q;
+			}
 		}
+		lastSampleRate = sampleRate;
 	}
 
 	void process(const ProcessArgs &args) override {
-		float inM = inputs[IN_MOD].getVoltage() / 5.0f;
-		float inC = inputs[IN_CARR].getVoltage() / 5.0f;
+		updateCoefs(args.sampleRate);
+
+		int channels = inputs[IN_CARR].getChannels() > 1 ? 2 : 1;
+		float inM = inputs[IN_MOD].getVoltage() / 5.0f * params[GMOD_PARAM].getValue();
+		float inC[2];
+		for (int c = 0; c < channels; c++) {
+			inC[c] = inputs[IN_CARR].getVoltage(c) / 5.0f * params[GCARR_PARAM].getValue();
+		}
 		float attack = params[ATTACK_PARAM].getValue();
 		float decay = params[DECAY_PARAM].getValue();
-		float slewAttack = slewMax * powf(slewMin / slewMax, attack);
-		float slewDecay = slewMax * powf(slewMin / slewMax, decay);
-		float_4 q1 = {params[Q1_PARAM].getValue()};
-		float_4 q2 = {params[Q1_PARAM].getValue()};
-		float_4 q3 = {params[Q1_PARAM].getValue()};
-		float_4 q4 = {params[Q1_PARAM].getValue()};
-		float out = 0.0f;
+		float slewAttack = slewMax * powf(slewMin / slewMax, attack) * shapeScale * args.sampleTime;
+		float slewDecay = slewMax * powf(slewMin / slewMax, decay) * shapeScale * args.sampleTime;
+		float_4 out[2] = { 0.0f, 0.0f };
 
 		for (int i = 0; i < BANDS4; i++) {
+			float_4 peak = simd::fabs(modFilters[1][i].process(modFilters[0][i].process(inM, coefs[0][i]), coefs[1][i]));
 			float_4 coeff = mem[i];
-			iFilter[i]->setQ(q1);
-			iFilter[i + BANDS4]->setQ(q2);
-			float_4 peak = abs(iFilter[i + BANDS4]->process(iFilter[i]->process(inM * params[GMOD_PARAM].getValue())));
-			for (int j=0; j<4; j++) {
-				if (peak[j] > coeff[j]) {
-					coeff[j] += slewAttack * shapeScale * (peak[j] - coeff[j]) / args.sampleRate;
-					if (coeff[j] > peak[j])
-						coeff[j] = peak[j];
-				} else if (peak[j] < coeff[j]) {
-					coeff[j] -= slewDecay * shapeScale * (coeff[j] - peak[j]) / args.sampleRate;
-					if (coeff[j] < peak[j])
-						coeff[j] = peak[j];
-				}
-			}
+			coeff = simd::ifelse(peak > coeff, simd::fmin(coeff + slewAttack * (peak - coeff), peak), simd::fmax(coeff + slewDecay * (peak - coeff), peak));
 			peaks[i] = peak;
 			mem[i] = coeff;
-			cFilter[i]->setQ(q3);
-			cFilter[i + BANDS4]->setQ(q4);
 			float_4 bg = {params[BG_PARAM + i*4].getValue(), params[BG_PARAM + i*4+1].getValue(), params[BG_PARAM + i*4+2].getValue(), params[BG_PARAM + i*4+3].getValue()};
-			float_4 corr = cFilter[i + BANDS4]->process(cFilter[i]->process(inC*params[GCARR_PARAM].getValue())) * coeff * bg;
-			out += corr[0]+corr[1]+corr[2]+corr[3];
+			float_4 gain = coeff * bg;
+			for (int c = 0; c < channels; c++) {
+				out[c] += carrFilters[c][1][i].process(carrFilters[c][0][i].process(inC[c], coefs[2][i]), coefs[3][i]) * gain;
+			}
+		}
+
+		outputs[OUT].setChannels(channels);
+		for (int c = 0; c < channels; c++) {
+			outputs[OUT].setVoltage((out[c][0] + out[c][1] + out[c][2] + out[c][3]) * 5.0f * params[G_PARAM].getValue(), c);
 		}
-		outputs[OUT].setVoltage(out * 5.0f * params[G_PARAM].getValue());
 	}
 };
 
@@ -313,6 +279,16 @@ struct ZINCWidget : BidooWidget {
 		addOutput(createOutput<PJ301MPort>(Vec(164.5f, 330), module, ZINC::OUT));
 	}
 
+	void appendContextMenu(Menu *menu) override {
+		BidooWidget::appendContextMenu(menu);
+		ZINC *module = dynamic_cast<ZINC*>(this->module);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createCheckMenuItem("Q1 drives every stage", "",
+			[=]() {return module->linkedQ;},
+			[=]() {module->linkedQ = !module->linkedQ;}
+		));
+	}
+
 	void step() override;
 };
 
@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <sstream>
 #include "dep/quantizer.hpp"
+#include "dep/slidecurve.hpp"
 
 using namespace std;
 
@@ -431,7 +432,7 @@ struct ZOUMAI : BidooModule {
 
 	bool solo = false;
 
-	float powTable[100][10000] = {{0.0f}};
+	const float (*powTable)[slidecurve::curveLength] = slidecurve::acquire()->values;
 
   std::string labels[8] = {"Track 1","Track 2","Track 3","Track 4","Track 5","Track 6","Track 7","Track 8"};
 
@@ -492,15 +493,13 @@ struct ZOUMAI : BidooModule {
 			}
   	}
 
-		for(int i=0; i<100;i++) {
-      for(int j=0; j<10000;j++) {
-				powTable[i][j] = powf(j*0.0001f,i*0.01f);
-			}
-		}
-
 		onReset();
 	}
 
+	~ZOUMAI() {
+		slidecurve::release();
+	}
+
   unsigned int calc_GCD(unsigned int a, unsigned int b)
   {
     unsigned int shift, tmp;
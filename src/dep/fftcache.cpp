@@ -0,0 +1,76 @@
+#include "fftcache.hpp"
+#include <map>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <cstring>
+
+namespace fftcache {
+
+  struct Cache {
+    std::mutex lock;
+    std::map<std::pair<int,int>, PFFFT_Setup*> setups;
+    std::map<int, std::vector<Buffers*>> freeBuffers;
+    std::vector<Buffers*> allBuffers;
+
+    ~Cache() {
+      for (auto &s : setups) {
+        pffft_destroy_setup(s.second);
+      }
+      for (Buffers *b : allBuffers) {
+        pffft_aligned_free(b->in);
+        pffft_aligned_free(b->out);
+        pffft_aligned_free(b->aux);
+        pffft_aligned_free(b->work);
+        delete b;
+      }
+    }
+  };
+
+  static Cache &cache() {
+    static Cache c;
+    return c;
+  }
+
+  PFFFT_Setup *getSetup(int size, pffft_transform_t transform) {
+    Cache &c = cache();
+    std::lock_guard<std::mutex> lock(c.lock);
+    PFFFT_Setup *&setup = c.setups[std::make_pair(size, (int)transform)];
+    if (!setup) {
+      setup = pffft_new_setup(size, transform);
+    }
+    return setup;
+  }
+
+  Buffers *acquireBuffers(int size) {
+    Cache &c = cache();
+    std::lock_guard<std::mutex> lock(c.lock);
+    std::vector<Buffers*> &pool = c.freeBuffers[size];
+    if (!pool.empty()) {
+      Buffers *b = pool.back();
+      pool.pop_back();
+      return b;
+    }
+    // complex transforms need 2*size floats, allocate for the worst case
+    Buffers *b = new Buffers;
+    b->size = size;
+    b->in = (float*)pffft_aligned_malloc(2*size*sizeof(float));
+    b->out = (float*)pffft_aligned_malloc(2*size*sizeof(float));
+    b->aux = (float*)pffft_aligned_malloc(2*size*sizeof(float));
+    b->work = (float*)pffft_aligned_malloc(2*size*sizeof(float));
+    memset(b->in, 0, 2*size*sizeof(float));
+    memset(b->out, 0, 2*size*sizeof(float));
+    memset(b->aux, 0, 2*size*sizeof(float));
+    memset(b->work, 0, 2*size*sizeof(float));
+    c.allBuffers.push_back(b);
+    c.freeBuffers[size].reserve(c.allBuffers.size());
+    return b;
+  }
+
+  void releaseBuffers(Buffers *buffers) {
+    Cache &c = cache();
+    std::lock_guard<std::mutex> lock(c.lock);
+    c.freeBuffers[buffers->size].push_back(buffers);
+  }
+
+}
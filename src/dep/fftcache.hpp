@@ -0,0 +1,46 @@
+#pragma once
+#include "pffft/pffft.h"
+
+namespace fftcache {
+
+  // pffft setups are read-only once built, so one setup per size and transform
+  // is shared by every module and thread for the lifetime of the plugin.
+  PFFFT_Setup *getSetup(int size, pffft_transform_t transform = PFFFT_REAL);
+
+  // Aligned scratch buffers of a given size, recycled through a pool so
+  // repeated transforms don't allocate once the pool is warm.
+  struct Buffers {
+    int size;
+    float *in;
+    float *out;
+    float *aux;
+    float *work;
+  };
+
+  Buffers *acquireBuffers(int size);
+  void releaseBuffers(Buffers *buffers);
+
+  struct Scratch {
+    Buffers *buffers;
+    float *in;
+    float *out;
+    float *aux;
+    float *work;
+
+    Scratch(int size) {
+      buffers = acquireBuffers(size);
+      in = buffers->in;
+      out = buffers->out;
+      aux = buffers->aux;
+      work = buffers->work;
+    }
+
+    ~Scratch() {
+      releaseBuffers(buffers);
+    }
+
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+  };
+
+}
@@ -1,26 +1,29 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "../pffft/pffft.h"
-#include <vector>
-#include <algorithm>
-#include <mutex>
+#include "../fftcache.hpp"
 
 using namespace std;
 
+// Sliding magnitude spectrum keeping the last depth frames in a preallocated
+// ring, row(0) being the newest, along with the sum of each frame over a bin
+// range. Nothing is allocated once constructed.
 struct FfftAnalysis {
 
 	float *gInFIFO;
 	float *gFFTworksp;
 	float *gFFTworkspOut;
-	float *gAnaMagn;
-	float gSum;
+	float *gFFTwork;
+	float *gWindow;
+	float *gHistory;
+	float *gSums;
 	float sampleRate;
 	PFFFT_Setup *pffftSetup;
 	long gRover = false;
-	double magn, window, real, imag;
-	double invFftFrameSize;
-	long fftFrameSize, osamp, i,k, qpd, index, inFifoLatency, stepSize, fftFrameSize2;
+	long head = 0;
+	long fftFrameSize, osamp, k, inFifoLatency, stepSize, fftFrameSize2;
 	long depth;
 
 	FfftAnalysis(long fftFrameSize, long depth, long osamp, float sampleRate) {
@@ -28,79 +31,82 @@ struct FfftAnalysis {
 		this->depth = depth;
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftcache::getSetup(fftFrameSize);
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
 		inFifoLatency = fftFrameSize-stepSize;
-		invFftFrameSize = 1.0f/fftFrameSize;
 
 		gInFIFO = (float*)calloc(fftFrameSize,sizeof(float));
 		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
 		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
-		gAnaMagn = (float*)calloc(fftFrameSize,sizeof(float));
+		gFFTwork =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gWindow = (float*)calloc(fftFrameSize,sizeof(float));
+		gHistory = (float*)calloc(depth*fftFrameSize2,sizeof(float));
+		gSums = (float*)calloc(depth,sizeof(float));
+
+		for (k = 0; k < fftFrameSize; k++) {
+			gWindow[k] = -0.5 * cos(2.0 * M_PI * (double)k / fftFrameSize) + 0.5;
+		}
 	}
 
 	~FfftAnalysis() {
-		pffft_destroy_setup(pffftSetup);
 		free(gInFIFO);
-		free(gAnaMagn);
+		free(gWindow);
+		free(gHistory);
+		free(gSums);
 		pffft_aligned_free(gFFTworksp);
 		pffft_aligned_free(gFFTworkspOut);
+		pffft_aligned_free(gFFTwork);
 	}
 
-	void process(const float *input, vector<vector<float>> *result, vector<float> *sum, int min, int max) {
-
-			for (i = 0; i < fftFrameSize; i++) {
-				gInFIFO[gRover] = input[i];
-				gRover++;
-
-				if (gRover >= fftFrameSize) {
-					gRover = inFifoLatency;
-					memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
-					memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
-
-					for (k = 0; k < fftFrameSize;k++) {
-						window = -0.5 * cos(2.0f * M_PI * (double)k * invFftFrameSize) + 0.5f;
-						gFFTworksp[k] = gInFIFO[k] * window;
-					}
-
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, NULL, PFFFT_FORWARD);
-					gSum = 0;
-
-					for (k = 0; k <= fftFrameSize2; k++) {
-						real = gFFTworkspOut[2*k];
-						imag = gFFTworkspOut[2*k+1];
-						magn = 2.*sqrt(real*real + imag*imag);
-						gAnaMagn[k] = magn;
-						if ((k>=min) && (k<=max)) gSum += magn;
-					}
-
-					std::vector<float> v(gAnaMagn, gAnaMagn + fftFrameSize2);
-
-					if (result->size() == 0) {
-						result->push_back(v);
-						sum->push_back(gSum);
-					}
-					else if (long(result->size()) >= depth) {
-						std::rotate(result->rbegin(), result->rbegin() + 1, result->rend());
-						vector<vector<float>>& resultRef = *result;
-						resultRef[0] = v;
-
-						std::rotate(sum->rbegin(), sum->rbegin() + 1, sum->rend());
-						vector<float>& sumRef = *sum;
-						sumRef[0] = gSum;
-					}
-					else {
-						result->push_back(v);
-						std::rotate(result->rbegin(), result->rbegin() + 1, result->rend());
-
-						sum->push_back(gSum);
-						std::rotate(sum->rbegin(), sum->rbegin() + 1, sum->rend());
-					}
-
-					/* move input FIFO */
-					for (k = 0; k < inFifoLatency; k++) gInFIFO[k] = gInFIFO[k+stepSize];
-				}
-			}
+	void clear() {
+		memset(gInFIFO, 0, fftFrameSize*sizeof(float));
+		memset(gHistory, 0, depth*fftFrameSize2*sizeof(float));
+		memset(gSums, 0, depth*sizeof(float));
+		gRover = false;
+		head = 0;
+	}
+
+	// magnitudes of the frame analysed age hops ago
+	const float *row(long age) const {
+		return gHistory + ((head + depth - age) % depth) * fftFrameSize2;
+	}
+
+	float sum(long age) const {
+		return gSums[(head + depth - age) % depth];
+	}
+
+	// feeds one sample, true when a new frame entered the history
+	bool process(const float input, long min, long max) {
+		gInFIFO[gRover] = input;
+		gRover++;
+
+		if (gRover < fftFrameSize) return false;
+
+		gRover = inFifoLatency;
+
+		for (k = 0; k < fftFrameSize;k++) {
+			gFFTworksp[k] = gInFIFO[k] * gWindow[k];
+		}
+
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTwork, PFFFT_FORWARD);
+
+		head = (head + 1) % depth;
+		float *magn = gHistory + head * fftFrameSize2;
+		float sum = 0.0f;
+
+		for (k = 0; k < fftFrameSize2; k++) {
+			float real = gFFTworkspOut[2*k];
+			float imag = gFFTworkspOut[2*k+1];
+			magn[k] = 2.0f*sqrtf(real*real + imag*imag);
+			if ((k>=min) && (k<=max)) sum += magn[k];
+		}
+
+		gSums[head] = sum;
+
+		/* move input FIFO */
+		for (k = 0; k < inFifoLatency; k++) gInFIFO[k] = gInFIFO[k+stepSize];
+
+		return true;
 	}
 };
@@ -0,0 +1,92 @@
+#pragma once
+#include <rack.hpp>
+
+// Polyphase IIR halfband: two chains of first order allpasses running at the
+// low rate. 8 coefficients give a 0.05 x sample rate transition band and more
+// than 100 dB of stopband rejection. T is float or simd::float_4.
+template <typename T>
+struct HalfBand {
+	static const int NUM_COEFS = 8;
+	T x[NUM_COEFS] = {};
+	T y[NUM_COEFS] = {};
+
+	static float coef(int i) {
+		static const float coefs[NUM_COEFS] = {
+			0.035832788f, 0.13409014f, 0.27204014f, 0.42432487f,
+			0.57205720f, 0.70629214f, 0.82712476f, 0.94150309f
+		};
+		return coefs[i];
+	}
+
+	T path(T in, int first) {
+		for (int i = first; i < NUM_COEFS; i += 2) {
+			T out = (in - y[i]) * coef(i) + x[i];
+			x[i] = in;
+			y[i] = out;
+			in = out;
+		}
+		return in;
+	}
+
+	// one sample in, two samples out at twice the rate
+	void upsample(T in, T *out) {
+		out[0] = path(in, 0);
+		out[1] = path(in, 1);
+	}
+
+	// two samples in, one sample out at half the rate
+	T downsample(const T *in) {
+		return 0.5f * (path(in[1], 0) + path(in[0], 1));
+	}
+
+	void reset() {
+		for (int i = 0; i < NUM_COEFS; i++) {
+			x[i] = 0.f;
+			y[i] = 0.f;
+		}
+	}
+};
+
+// 1x, 2x or 4x oversampling through cascaded halfbands.
+template <typename T>
+struct Oversampler {
+	HalfBand<T> up[2];
+	HalfBand<T> down[2];
+
+	// writes factor samples to out
+	void upsample(T in, T *out, int factor) {
+		if (factor == 4) {
+			T mid[2];
+			up[0].upsample(in, mid);
+			up[1].upsample(mid[0], out);
+			up[1].upsample(mid[1], out + 2);
+		}
+		else if (factor == 2) {
+			up[0].upsample(in, out);
+		}
+		else {
+			out[0] = in;
+		}
+	}
+
+	// reads factor samples from in
+	T downsample(const T *in, int factor) {
+		if (factor == 4) {
+			T mid[2];
+			mid[0] = down[1].downsample(in);
+			mid[1] = down[1].downsample(in + 2);
+			return down[0].downsample(mid);
+		}
+		else if (factor == 2) {
+			return down[0].downsample(in);
+		}
+		return in[0];
+	}
+
+	void reset() {
+		for (int i = 0; i < 2; i++) {
+			up[i].reset();
+			down[i].reset();
+		}
+	}
+};
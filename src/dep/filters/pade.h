@@ -0,0 +1,21 @@
+#pragma once
+#include <rack.hpp>
+
+// 7/6 Pade approximants shared by the filters and shapers. T is float or
+// simd::float_4.
+// fastTan: relative error below 1.2e-4 up to 1.5 (0.477 x sample rate once
+// scaled by pi x sampleTime, where cutoffs are clamped).
+// fastTanh: absolute error below 1e-4, the input is clamped to +-4.97 where
+// the approximant reaches 1.
+template <typename T>
+inline T fastTan(T x) {
+	T x2 = x * x;
+	return x * (135135.f - x2 * (17325.f - x2 * 378.f)) / (135135.f - x2 * (62370.f - x2 * (3150.f - x2 * 28.f)));
+}
+
+template <typename T>
+inline T fastTanh(T x) {
+	x = rack::simd::clamp(x, -4.97f, 4.97f);
+	T x2 = x * x;
+	return x * (135135.f + x2 * (17325.f + x2 * (378.f + x2))) / (135135.f + x2 * (62370.f + x2 * (3150.f + x2 * 28.f)));
+}
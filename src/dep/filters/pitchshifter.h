@@ -1,15 +1,46 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <algorithm>
+#include <rack.hpp>
 #include "../pffft/pffft.h"
+#include "../fftcache.hpp"
 
 using namespace std;
+using rack::simd::float_4;
 
+// Phase vocoder pitch shifter, one sample in and one sample out per call.
+// The frame captured at the end of a hop is processed in slices during the
+// following hop (window, forward FFT, analysis, bin shift, synthesis, inverse
+// FFT, overlap-add) instead of in one go, so the cost per sample stays flat.
+// This adds one hop of latency.
+// Analysis and synthesis run in single precision on four bins at a time. The
+// windows and the expected phase advance of each bin are tabulated, phases
+// are kept wrapped to [-pi, pi] and go through polynomial atan2 (error below
+// 1e-5 rad) and sin/cos (error below 4e-6).
 struct PitchShifter {
+	enum Stages {
+		WINDOW_STAGE,
+		FORWARD_STAGE,
+		ANALYSIS_STAGE,
+		SHIFT_STAGE,
+		SYNTHESIS_STAGE,
+		BACKWARD_STAGE,
+		OVERLAP_STAGE,
+		IDLE_STAGE
+	};
+
 	float *gInFIFO;
 	float *gOutFIFO;
+	float *gFrame;
 	float *gFFTworksp;
 	float *gFFTworkspOut;
+	float *gFFTwork;
+	float *gWindow;
+	float *gOutWindow;
+	float *gExpct;
+	float *gReal;
+	float *gImag;
 	float *gLastPhase;
 	float *gSumPhase;
 	float *gOutputAccum;
@@ -18,11 +49,15 @@ struct PitchShifter {
 	float *gSynFreq;
 	float *gSynMagn;
 	float sampleRate;
+	float framePitch = 1.0f;
 	PFFFT_Setup *pffftSetup;
 	long gRover = false;
-	double magn, phase, tmp, window, real, imag;
-	double freqPerBin, expct, invOsamp, invFftFrameSize, invFftFrameSize2, invPi;
-	long fftFrameSize, osamp, i,k, qpd, index, inFifoLatency, stepSize, fftFrameSize2;
+	bool framePending = false;
+	int stage = IDLE_STAGE;
+	long stagePos = 0;
+	long sampleChunk, binChunk;
+	float osampOver2Pi, twoPiOverOsamp;
+	long fftFrameSize, osamp, i,k, index, inFifoLatency, stepSize, fftFrameSize2;
 
 	PitchShifter() {
 
@@ -33,22 +68,31 @@ struct PitchShifter {
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
 
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftcache::getSetup(fftFrameSize);
 
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
-		freqPerBin = sampleRate/(double)fftFrameSize;
-		expct = 2.0f * M_PI * (double)stepSize/(double)fftFrameSize;
 		inFifoLatency = fftFrameSize-stepSize;
-		invOsamp = 1.0f/osamp;
-		invFftFrameSize = 1.0f/fftFrameSize;
-		invFftFrameSize2 = 1.0f/fftFrameSize2;
-		invPi = 1.0f/M_PI;
+		osampOver2Pi = osamp / (2.0 * M_PI);
+		twoPiOverOsamp = 2.0 * M_PI / osamp;
+
+		// the FFTs and the bin shift take one call each, the four other stages
+		// share what is left of the hop, bins go by groups of four
+		long slices = max(1L, (stepSize - 4) / 4);
+		sampleChunk = (fftFrameSize + slices - 1) / slices;
+		binChunk = ((fftFrameSize2 + slices - 1) / slices + 3) & ~3L;
 
 		gInFIFO = new float[fftFrameSize] {0.f};
 		gOutFIFO =  new float[fftFrameSize] {0.f};
+		gFrame = new float[fftFrameSize] {0.f};
 		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
 		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gFFTwork =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gWindow = new float[fftFrameSize];
+		gOutWindow = new float[fftFrameSize];
+		gExpct = new float[fftFrameSize2];
+		gReal = new float[fftFrameSize2] {0.f};
+		gImag = new float[fftFrameSize2] {0.f};
 		gLastPhase = new float[fftFrameSize2+1] {0.f};
 		gSumPhase = new float[fftFrameSize2+1] {0.f};
 		gOutputAccum = new float[2*fftFrameSize] {0.f};
@@ -56,12 +100,28 @@ struct PitchShifter {
 		gAnaMagn = new float[fftFrameSize] {0.f};
 		gSynFreq = new float[fftFrameSize] {0.f};
 		gSynMagn = new float[fftFrameSize] {0.f};
+
+		for (k = 0; k < fftFrameSize; k++) {
+			double window = -0.5 * cos(2.0 * M_PI * (double)k / fftFrameSize) + 0.5;
+			gWindow[k] = window;
+			gOutWindow[k] = 2.0 * window / (fftFrameSize2 * osamp);
+		}
+		// expected phase advance of bin k over a hop, wrapped
+		for (k = 0; k < fftFrameSize2; k++) {
+			double expct = 2.0 * M_PI * (double)((k * stepSize) % fftFrameSize) / fftFrameSize;
+			gExpct[k] = expct > M_PI ? expct - 2.0 * M_PI : expct;
+		}
 	}
 
 	~PitchShifter() {
-		pffft_destroy_setup(pffftSetup);
 		delete[] gInFIFO;
 		delete[] gOutFIFO;
+		delete[] gFrame;
+		delete[] gWindow;
+		delete[] gOutWindow;
+		delete[] gExpct;
+		delete[] gReal;
+		delete[] gImag;
 		delete[] gLastPhase;
 		delete[] gSumPhase;
 		delete[] gOutputAccum;
@@ -71,88 +131,164 @@ struct PitchShifter {
 		delete[] gSynMagn;
 		pffft_aligned_free(gFFTworksp);
 		pffft_aligned_free(gFFTworkspOut);
+		pffft_aligned_free(gFFTwork);
 	}
 
-	void process(const float pitchShift, const float *input, float *output) {
+	static float_4 wrapPhase(float_4 x) {
+		return x - float(2.0 * M_PI) * rack::simd::floor(x * float(0.5 / M_PI) + 0.5f);
+	}
 
-			for (i = 0; i < fftFrameSize; i++) {
-				gInFIFO[gRover] = input[i];
+	static float_4 fastAtan2(float_4 y, float_4 x) {
+		float_4 ax = rack::simd::fabs(x);
+		float_4 ay = rack::simd::fabs(y);
+		float_4 a = rack::simd::fmin(ax, ay) / rack::simd::fmax(rack::simd::fmax(ax, ay), float_4(1e-30f));
+		float_4 s = a * a;
+		float_4 r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f - s * 0.01172120f)))));
+		r = rack::simd::ifelse(ay > ax, float(M_PI / 2) - r, r);
+		r = rack::simd::ifelse(x < 0.f, float(M_PI) - r, r);
+		return rack::simd::ifelse(y < 0.f, 0.f - r, r);
+	}
 
-				if(gRover >= inFifoLatency)  // [bsp] 09Mar2019: this fixes the noise burst issue in REI
-					 output[i] = gOutFIFO[gRover-inFifoLatency];
-				else
-					 output[i] = 0.0f;
+	// x in [-pi/2, pi/2]
+	static float_4 sinPoly(float_4 x) {
+		float_4 x2 = x * x;
+		return x * (1.f + x2 * (-1.f/6.f + x2 * (1.f/120.f + x2 * (-1.f/5040.f + x2 * (1.f/362880.f)))));
+	}
 
-				gRover++;
+	// x in [-pi, pi]
+	static void fastSinCos(float_4 x, float_4 &s, float_4 &c) {
+		const float halfPi = M_PI / 2;
+		float_4 folded = rack::simd::ifelse(x > halfPi, float(M_PI) - x, rack::simd::ifelse(x < -halfPi, float(-M_PI) - x, x));
+		s = sinPoly(folded);
+		c = sinPoly(halfPi - rack::simd::fabs(x));
+	}
 
-				if (gRover >= fftFrameSize) {
-					gRover = inFifoLatency;
+	float process(const float pitchShift, const float input) {
+		float output = 0.0f;
+		gInFIFO[gRover] = input;
 
-					memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
-					memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
+		if(gRover >= inFifoLatency)  // [bsp] 09Mar2019: this fixes the noise burst issue in REI
+			 output = gOutFIFO[gRover-inFifoLatency];
 
-					for (k = 0; k < fftFrameSize;k++) {
-						window = -0.5 * cos(2.0f * M_PI * (double)k * invFftFrameSize) + 0.5f;
-						gFFTworksp[k] = gInFIFO[k] * window;
-					}
+		gRover++;
 
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, NULL, PFFFT_FORWARD);
-
-					for (k = 0; k < fftFrameSize2; k++) {
-						real = gFFTworkspOut[2*k];
-						imag = gFFTworkspOut[2*k+1];
-						magn = 2.*sqrt(real*real + imag*imag);
-						phase = atan2(imag,real);
-						tmp = phase - gLastPhase[k];
-						gLastPhase[k] = phase;
-						tmp -= (double)k*expct;
-						qpd = tmp * invPi;
-						if (qpd >= 0) qpd += qpd&1;
-						else qpd -= qpd&1;
-						tmp -= M_PI*(double)qpd;
-						tmp = osamp * tmp * invPi * 0.5f;
-						tmp = (double)k*freqPerBin + tmp*freqPerBin;
-						gAnaMagn[k] = magn;
-						gAnaFreq[k] = tmp;
-					}
+		work();
 
-					memset(gSynMagn, 0, fftFrameSize*sizeof(float));
-					memset(gSynFreq, 0, fftFrameSize*sizeof(float));
+		if (gRover >= fftFrameSize) {
+			gRover = inFifoLatency;
 
-					for (k = 0; k < fftFrameSize2; k++) {
-						index = k*pitchShift;
-						if (index < fftFrameSize2) {
-							gSynMagn[index] += gAnaMagn[k];
-							gSynFreq[index] = gAnaFreq[k] * pitchShift;
-						}
-					}
+			if (framePending) {
+				while (work()) {}
+				for (k = 0; k < stepSize; k++) gOutFIFO[k] = gOutputAccum[k];
+				memmove(gOutputAccum, gOutputAccum+stepSize, fftFrameSize*sizeof(float));
+			}
 
-					memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
-					memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
-
-					for (k = 0; k < fftFrameSize2; k++) {
-						magn = k==0 ? 0 : gSynMagn[k];
-						tmp = gSynFreq[k];
-						tmp -= (double)k*freqPerBin;
-						tmp /= freqPerBin;
-						tmp = 2.0f * M_PI * tmp * invOsamp;
-						tmp += (double)k*expct;
-						gSumPhase[k] += tmp;
-						phase = gSumPhase[k];
-						gFFTworksp[2*k] = magn*cos(phase);
-						gFFTworksp[2*k+1] = magn*sin(phase);
-					}
+			memcpy(gFrame, gInFIFO, fftFrameSize*sizeof(float));
+			for (k = 0; k < inFifoLatency; k++) gInFIFO[k] = gInFIFO[k+stepSize];
+			framePitch = pitchShift;
+			framePending = true;
+			stage = WINDOW_STAGE;
+			stagePos = 0;
+		}
+
+		return output;
+	}
+
+	void nextStage() {
+		stage++;
+		stagePos = 0;
+	}
+
+	// runs one slice of the pending frame, false once there is nothing left to do
+	bool work() {
+		long end;
+		switch (stage) {
+			case WINDOW_STAGE:
+				end = min(stagePos + sampleChunk, fftFrameSize);
+				for (k = stagePos; k < end; k++) {
+					gFFTworksp[k] = gFrame[k] * gWindow[k];
+				}
+				stagePos = end;
+				if (stagePos == fftFrameSize) nextStage();
+				return true;
+
+			case FORWARD_STAGE:
+				pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTwork, PFFFT_FORWARD);
+				nextStage();
+				return true;
+
+			case ANALYSIS_STAGE:
+				// magnitude and true frequency of each bin, the frequency in bins
+				end = min(stagePos + binChunk, fftFrameSize2);
+				for (k = stagePos; k < end; k++) {
+					gReal[k] = gFFTworkspOut[2*k];
+					gImag[k] = gFFTworkspOut[2*k+1];
+				}
+				for (k = stagePos; k < end; k += 4) {
+					float_4 real = float_4::load(gReal+k);
+					float_4 imag = float_4::load(gImag+k);
+					float_4 phase = fastAtan2(imag, real);
+					float_4 tmp = wrapPhase(phase - float_4::load(gLastPhase+k) - float_4::load(gExpct+k));
+					phase.store(gLastPhase+k);
+					(2.f * rack::simd::sqrt(real*real + imag*imag)).store(gAnaMagn+k);
+					(float_4(0.f, 1.f, 2.f, 3.f) + (float)k + tmp * osampOver2Pi).store(gAnaFreq+k);
+				}
+				stagePos = end;
+				if (stagePos == fftFrameSize2) nextStage();
+				return true;
+
+			case SHIFT_STAGE:
+				memset(gSynMagn, 0, fftFrameSize*sizeof(float));
+				memset(gSynFreq, 0, fftFrameSize*sizeof(float));
 
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , NULL, PFFFT_BACKWARD);
-					for(k=0; k < fftFrameSize; k++) {
-						window = -0.5f * cos(2.0f * M_PI *(double)k * invFftFrameSize) + 0.5f;
-						gOutputAccum[k] += 2.0f * window * gFFTworkspOut[k] * invFftFrameSize2 * invOsamp;
+				for (k = 0; k < fftFrameSize2; k++) {
+					index = k*framePitch;
+					if (index < fftFrameSize2) {
+						gSynMagn[index] += gAnaMagn[k];
+						gSynFreq[index] = gAnaFreq[k] * framePitch;
 					}
+				}
+				gSynMagn[0] = 0.f;
+				nextStage();
+				return true;
 
-					for (k = 0; k < stepSize; k++) gOutFIFO[k] = gOutputAccum[k];
-					memmove(gOutputAccum, gOutputAccum+stepSize, fftFrameSize*sizeof(float));
-					for (k = 0; k < inFifoLatency; k++) gInFIFO[k] = gInFIFO[k+stepSize];
+			case SYNTHESIS_STAGE:
+				// accumulate each bin's phase and go back to cartesian
+				end = min(stagePos + binChunk, fftFrameSize2);
+				for (k = stagePos; k < end; k += 4) {
+					float_4 tmp = float_4::load(gSynFreq+k) - (float_4(0.f, 1.f, 2.f, 3.f) + (float)k);
+					float_4 phase = wrapPhase(float_4::load(gSumPhase+k) + tmp * twoPiOverOsamp + float_4::load(gExpct+k));
+					phase.store(gSumPhase+k);
+					float_4 magn = float_4::load(gSynMagn+k);
+					float_4 s, c;
+					fastSinCos(phase, s, c);
+					(magn * c).store(gReal+k);
+					(magn * s).store(gImag+k);
 				}
-			}
+				for (k = stagePos; k < end; k++) {
+					gFFTworksp[2*k] = gReal[k];
+					gFFTworksp[2*k+1] = gImag[k];
+				}
+				stagePos = end;
+				if (stagePos == fftFrameSize2) nextStage();
+				return true;
+
+			case BACKWARD_STAGE:
+				pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTwork, PFFFT_BACKWARD);
+				nextStage();
+				return true;
+
+			case OVERLAP_STAGE:
+				end = min(stagePos + sampleChunk, fftFrameSize);
+				for (k = stagePos; k < end; k++) {
+					gOutputAccum[k] += gOutWindow[k] * gFFTworkspOut[k];
+				}
+				stagePos = end;
+				if (stagePos == fftFrameSize) nextStage();
+				return true;
+
+			default:
+				return false;
+		}
 	}
 };
@@ -0,0 +1,52 @@
+#pragma once
+#include <rack.hpp>
+#include "pade.h"
+
+// Trapezoidal state variable filter (Zavalishin), the MultiFilter topology of
+// the sampler modules. T is float or simd::float_4, the latter running four
+// voices at once.
+// The prewarped gain is only recomputed when a lane's cutoff or Q moved by
+// more than 0.1% since the last update, with the Pade approximant of tan
+// from pade.h.
+template <typename T>
+struct SVF {
+	T hp = 0.f, bp = 0.f, lp = 0.f;
+	T mem1 = 0.f, mem2 = 0.f;
+	T g = 0.f, R2 = 0.f, norm = 1.f;
+	T lastFreq = -1.f, lastQ = -1.f;
+	float lastSampleTime = 0.f;
+
+	static bool any(bool mask) {
+		return mask;
+	}
+
+	static bool any(rack::simd::float_4 mask) {
+		return rack::simd::movemask(mask) != 0;
+	}
+
+	void setParams(T freq, T q, float sampleTime) {
+		const float threshold = 1e-3f;
+		if (!any(rack::simd::fabs(freq - lastFreq) > rack::simd::fabs(lastFreq) * threshold)
+			&& !any(rack::simd::fabs(q - lastQ) > rack::simd::fabs(lastQ) * threshold)
+			&& (sampleTime == lastSampleTime)) return;
+
+		lastFreq = freq;
+		lastQ = q;
+		lastSampleTime = sampleTime;
+		g = fastTan(rack::simd::fmin(T(M_PI * sampleTime) * freq, T(1.5f)));
+		R2 = 1.f / q;
+		norm = 1.f / (1.f + R2 * g + g * g);
+	}
+
+	void process(T in) {
+		hp = (in - (R2 + g) * mem1 - mem2) * norm;
+		bp = g * hp + mem1;
+		lp = g * bp + mem2;
+		mem1 = g * hp + bp;
+		mem2 = g * bp + lp;
+	}
+
+	void reset() {
+		hp = bp = lp = mem1 = mem2 = 0.f;
+	}
+};
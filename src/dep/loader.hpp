@@ -0,0 +1,59 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+namespace loader {
+
+  // Background thread for module jobs that must stay off the audio thread,
+  // typically decoding a sample and publishing it through an rcu::Pointer.
+  // Jobs run in posting order. idle() runs after each batch and at least
+  // every 10 ms, the place to collect retired rcu objects.
+  struct Worker {
+    std::function<void()> idle;
+    std::deque<std::function<void()>> jobs;
+    std::mutex lock;
+    std::condition_variable condition;
+    std::atomic<bool> running{true};
+    std::thread thread;
+
+    Worker(std::function<void()> idle = nullptr) : idle(idle), thread(&Worker::run, this) {}
+
+    ~Worker() {
+      running = false;
+      condition.notify_one();
+      thread.join();
+    }
+
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+
+    void post(std::function<void()> job) {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(job);
+      }
+      condition.notify_one();
+    }
+
+    void run() {
+      while (running) {
+        std::deque<std::function<void()>> batch;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          if (jobs.empty()) condition.wait_for(guard, std::chrono::milliseconds(10));
+          batch.swap(jobs);
+        }
+        for (auto &job : batch) {
+          job();
+        }
+        if (idle) idle();
+      }
+    }
+  };
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+namespace meter {
+
+  // Mean of the squared signal over the last SIZE samples. The running sum
+  // is accumulated in double. Beside it a second sum only ever adds, one
+  // sample per push, so after a full lap it holds the exact sum of the
+  // window and replaces the running one: the rounding never builds up
+  // however long the module runs, and no push costs more than another.
+  template <int SIZE>
+  struct SlidingPower {
+    float window[SIZE] = {};
+    double sum = 0.0;
+    double lap = 0.0;
+    int index = 0;
+
+    void push(float x) {
+      float power = x * x;
+      sum += (double)power - window[index];
+      window[index] = power;
+      lap += power;
+      if (++index >= SIZE) {
+        index = 0;
+        sum = lap;
+        lap = 0.0;
+      }
+    }
+
+    float mean() const {
+      return std::max(sum, 0.0) / SIZE;
+    }
+  };
+
+  // Maximum of the last window samples (0 < window < SIZE, SIZE a power of two).
+  // The candidates are kept in a monotonic deque: a new sample drops every
+  // smaller value before it, the front leaves once it is older than the
+  // window, so each sample is pushed and popped at most once whatever the
+  // window length.
+  template <int SIZE>
+  struct SlidingMax {
+    float values[SIZE] = {};
+    uint32_t times[SIZE] = {};
+    uint32_t now = 0;
+    int front = 0;
+    int count = 0;
+
+    float process(float x, int window) {
+      while (count > 0 && values[(front + count - 1) & (SIZE - 1)] <= x) {
+        count--;
+      }
+      int back = (front + count) & (SIZE - 1);
+      values[back] = x;
+      times[back] = now;
+      count++;
+      while (now - times[front] >= (uint32_t)window) {
+        front = (front + 1) & (SIZE - 1);
+        count--;
+      }
+      now++;
+      return values[front];
+    }
+
+    void reset() {
+      now = 0;
+      front = 0;
+      count = 0;
+    }
+  };
+
+  // Linear levels of one channel, updated per sample. They are converted to
+  // dBFS (5V full scale, floored at -96.3 dB) only when they are displayed.
+  struct Meter {
+    SlidingPower<16384> vu;
+    SlidingPower<512> rms;
+    float in = 0.f;
+    float peak = 0.f;
+    float peakDecay = 1.f;
+    float sampleTime = 0.f;
+
+    static float toDb(float amplitude) {
+      return std::max(20.f * std::log10(amplitude * 0.2f + 1e-12f), -96.3f);
+    }
+
+    static float powerToDb(float power) {
+      return std::max(10.f * std::log10(power * 0.04f + 1e-24f), -96.3f);
+    }
+
+    // the peak hold falls by 50 dB per second
+    void process(float x, float sampleTime) {
+      if (sampleTime != this->sampleTime) {
+        this->sampleTime = sampleTime;
+        peakDecay = std::pow(10.f, -2.5f * sampleTime);
+      }
+      in = std::fabs(x);
+      peak = std::max(in, peak * peakDecay);
+      vu.push(x);
+      rms.push(x);
+    }
+
+    float inDb() const {
+      return toDb(in);
+    }
+
+    float peakDb() const {
+      return toDb(peak);
+    }
+
+    float vuDb() const {
+      return std::min(powerToDb(vu.mean()), 0.f);
+    }
+
+    float rmsDb() const {
+      return std::min(powerToDb(rms.mean()), 0.f);
+    }
+  };
+
+}
@@ -1,6 +1,7 @@
 #include "dsp/resampler.hpp"
 #include "dsp/fir.hpp"
 #include "../pffft/pffft.h"
+#include "../fftcache.hpp"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
@@ -13,15 +14,38 @@
 #define IFS 1.0f/FS
 #define IFS2 1.0f/FS2
 #define IM_PI 1.0f/M_PI
+#define NMIP 10
+#define MIPMINLEN 64
 
 using namespace std;
 
 using simd::float_4;
 
+// One band-limited copy of a frame per octave: level l keeps the harmonics
+// below FS2>>l, down to the fundamental alone on the last level. Level 0 is
+// stored at FS samples, the others with twice the samples they need (at least
+// MIPMINLEN), each plus a wrap-around guard sample for the interpolation.
+struct wtMipMapLayout {
+  size_t length[NMIP];
+  size_t offset[NMIP];
+  size_t size = 0;
+
+  wtMipMapLayout() {
+    for(size_t l=0; l<NMIP; l++) {
+      length[l] = l==0 ? FS : std::max((size_t)FS>>(l-1), (size_t)MIPMINLEN);
+      offset[l] = size;
+      size += length[l]+1;
+    }
+  }
+};
+
+static const wtMipMapLayout mipLayout;
+
 struct wtFrame {
   vector<float> sample;
   vector<float> magnitude;
   vector<float> phase;
+  vector<float> mipmap;
   bool morphed=false;
   bool used=false;
 
@@ -29,11 +53,13 @@ struct wtFrame {
     sample.resize(FS,0);
     magnitude.resize(FS2,0);
     phase.resize(FS2,0);
+    mipmap.resize(mipLayout.size,0);
   }
 
   void calcFFT();
   void calcIFFT();
   void calcWav();
+  void calcMipMap();
   void normalize();
   void smooth();
   void window();
@@ -54,25 +80,21 @@ inline void wtFrame::reset() {
   for(size_t i=FS2; i<FS; i++) {
     sample[i]=0.0f;
   }
+  std::fill(mipmap.begin(), mipmap.end(), 0.0f);
   used=false;
   morphed=false;
 }
 
 void wtFrame::calcFFT() {
-  PFFFT_Setup *pffftSetup;
-	pffftSetup = pffft_new_setup(FS, PFFFT_REAL);
-	float *fftIn;
-	float *fftOut;
-	fftIn = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	fftOut = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	memset(fftIn, 0, FS*sizeof(float));
-	memset(fftOut, 0, FS*sizeof(float));
+	fftcache::Scratch scratch(FS);
+	float *fftIn = scratch.in;
+	float *fftOut = scratch.out;
 
 	for (size_t k = 0; k < FS; k++) {
 		fftIn[k] = sample[k];
 	}
 
-	pffft_transform_ordered(pffftSetup, fftIn, fftOut, 0, PFFFT_FORWARD);
+	pffft_transform_ordered(fftcache::getSetup(FS), fftIn, fftOut, scratch.work, PFFFT_FORWARD);
 
 	for (size_t k = 0; k < FS2; k++) {
 		if ((abs(fftOut[2*k])>1e-2f) || (abs(fftOut[2*k+1])>1e-2f)) {
@@ -86,46 +108,74 @@ void wtFrame::calcFFT() {
 			magnitude[k] = 0.0f;
     }
 	}
-
-	pffft_destroy_setup(pffftSetup);
-	pffft_aligned_free(fftIn);
-	pffft_aligned_free(fftOut);
 }
 
 void wtFrame::calcIFFT() {
-  PFFFT_Setup *pffftSetup;
-	pffftSetup = pffft_new_setup(FS, PFFFT_REAL);
-	float *fftIn;
-	float *fftOut;
-	fftIn = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	fftOut =  (float*)pffft_aligned_malloc(FS*sizeof(float));
-	memset(fftIn, 0, FS*sizeof(float));
-	memset(fftOut, 0, FS*sizeof(float));
+	fftcache::Scratch scratch(FS);
+	float *fftIn = scratch.in;
+	float *fftOut = scratch.out;
 
 	for (size_t i = 0; i < FS2; i++) {
 		fftIn[2*i] = magnitude[i]*cos(phase[i]);
 		fftIn[2*i+1] = magnitude[i]*sin(phase[i]);
 	}
 
-	pffft_transform_ordered(pffftSetup, fftIn, fftOut, 0, PFFFT_BACKWARD);
+	pffft_transform_ordered(fftcache::getSetup(FS), fftIn, fftOut, scratch.work, PFFFT_BACKWARD);
 
 	for (size_t i = 0; i < FS; i++) {
 		sample[i]=fftOut[i]*0.5f;
 	}
-
-	pffft_destroy_setup(pffftSetup);
-	pffft_aligned_free(fftIn);
-	pffft_aligned_free(fftOut);
 }
 
+// sum of magnitude[j]*cos(2*pi*i*j/FS + phase[j]) over the positive bins,
+// the DC term goes into the real slot alone so the nyquist slot stays empty
 void wtFrame::calcWav() {
-  for(size_t i = 0 ; i < FS; i++) {
-    sample[i] = 0;
-		for(size_t j = 0; j < FS2; j++) {
-			if (magnitude[j]>0) {
-        sample[i] += magnitude[j] * cos(i*j*AC + phase[j]);
-      }
-		}
+	fftcache::Scratch scratch(FS);
+	float *fftIn = scratch.in;
+	float *fftOut = scratch.out;
+
+	fftIn[0] = magnitude[0]>0 ? 2.0f*magnitude[0]*cos(phase[0]) : 0.0f;
+	fftIn[1] = 0.0f;
+	for (size_t j = 1; j < FS2; j++) {
+		float m = magnitude[j]>0 ? magnitude[j] : 0.0f;
+		fftIn[2*j] = m*cos(phase[j]);
+		fftIn[2*j+1] = m*sin(phase[j]);
+	}
+
+	pffft_transform_ordered(fftcache::getSetup(FS), fftIn, fftOut, scratch.work, PFFFT_BACKWARD);
+
+	for (size_t i = 0; i < FS; i++) {
+		sample[i]=fftOut[i]*0.5f;
+	}
+}
+
+void wtFrame::calcMipMap() {
+  fftcache::Scratch scratch(FS);
+  float *spectrum = scratch.aux;
+
+  for (size_t k = 0; k < FS; k++) {
+    scratch.in[k] = sample[k];
+  }
+
+  pffft_transform_ordered(fftcache::getSetup(FS), scratch.in, spectrum, scratch.work, PFFFT_FORWARD);
+
+  for (size_t l = 0; l < NMIP; l++) {
+    size_t len = mipLayout.length[l];
+    size_t harmonics = std::min((size_t)FS2>>l, len/2);
+    memset(scratch.in, 0, len*sizeof(float));
+    scratch.in[0] = spectrum[0];
+    for (size_t k = 1; k < harmonics; k++) {
+      scratch.in[2*k] = spectrum[2*k];
+      scratch.in[2*k+1] = spectrum[2*k+1];
+    }
+
+    pffft_transform_ordered(fftcache::getSetup(len), scratch.in, scratch.out, scratch.work, PFFFT_BACKWARD);
+
+    float *level = mipmap.data() + mipLayout.offset[l];
+    for (size_t i = 0; i < len; i++) {
+      level[i] = scratch.out[i]*IFS;
+    }
+    level[len] = level[0];
   }
 }
 
@@ -222,6 +272,7 @@ struct wtTable {
   void deleteMorphing();
   void init();
   void copyFrame(size_t from, size_t to);
+  void calcMipMaps();
 };
 
 void wtTable::copyFrame(size_t from, size_t to) {
@@ -233,6 +284,7 @@ void wtTable::copyFrame(size_t from, size_t to) {
   for(size_t i=FS2; i<FS; i++) {
     frames[to].sample[i]=frames[from].sample[i];
   }
+  frames[to].mipmap=frames[from].mipmap;
 }
 
 void wtTable::loadSample(size_t sCount, size_t frameSize, bool interpolate, float *sample) {
@@ -299,6 +351,12 @@ inline void wtTable::calcFFT() {
   }
 }
 
+inline void wtTable::calcMipMaps() {
+  for(size_t i=0; i<nFrames;i++) {
+    frames[i].calcMipMap();
+  }
+}
+
 inline void wtTable::removeFrameDCOffset(size_t index) {
   frames[index].removeDCOffset();
 }
@@ -475,6 +533,7 @@ struct wtOscillator {
 	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> minBLEP;
 
 	T outValue = 0.f;
+	T level = 0.f;
 
 	void setPitch(T pitch) {
 		freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch + 30) / 1073741824;
@@ -491,6 +550,12 @@ struct wtOscillator {
 		phase += deltaPhase;
 		phase -= simd::floor(phase);
 
+		// level l is alias free from log2(|dPhase|*FS) up. Both crossfaded levels,
+		// ceil(log2) and the next one, sit at or above it, and the fraction moves
+		// the mix to the next level as the pitch rises so a glide never switches
+		// an octave of harmonics at once. The last level keeps the fundamental up
+		// to the 0.35 phase increment clamp.
+		level = simd::clamp(simd::log2(simd::fabs(deltaPhase) * FS) + 1.f, 0.f, (float)(NMIP-1));
 
 		if (syncEnabled) {
 			T deltaSync = syncValue - lastSyncValue;
@@ -540,12 +605,25 @@ struct wtOscillator {
     outValue = clamp(outValue,-10.0f,10.0f);
 	}
 
-  T interpolate(const float* p, T x) {
-  	T xi = floor(x);
-  	T xf = x - xi;
-    T pI = {p[(int)xi[0]],p[(int)xi[1]],p[(int)xi[2]],p[(int)xi[3]]};
-    T pII = {p[(int)xi[0]+1],p[(int)xi[1]+1],p[(int)xi[2]+1],p[(int)xi[3]+1]};
-  	return crossfade(pI, pII, xf);
+  float interpolate(const float* p, size_t len, float x) {
+    float pos = x * len;
+    size_t xi = std::min((size_t)pos, len-1);
+    return crossfade(p[xi], p[xi+1], pos - xi);
+  }
+
+  T interpolate(const wtFrame &frame, T x) {
+    T v;
+    for (int i = 0; i < 4; i++) {
+      size_t l = level[i];
+      float lf = level[i] - l;
+      float v0 = interpolate(frame.mipmap.data() + mipLayout.offset[l], mipLayout.length[l], x[i]);
+      if ((lf > 0.f) && (l < NMIP-1)) {
+        float v1 = interpolate(frame.mipmap.data() + mipLayout.offset[l+1], mipLayout.length[l+1], x[i]);
+        v0 = crossfade(v0, v1, lf);
+      }
+      v[i] = v0;
+    }
+    return v;
   }
 
 	T out(float deltaTime, T phase, size_t index) {
@@ -562,11 +640,11 @@ struct wtOscillator {
     }
 
     if (playedIndex==targetIndex) {
-      v = interpolate(table->frames[playedIndex].sample.data(), phase * 2047.f);
+      v = interpolate(table->frames[playedIndex], phase);
     }
     else {
-      T pVal = interpolate(table->frames[playedIndex].sample.data(), phase * 2047.f);
-      T tVal = interpolate(table->frames[targetIndex].sample.data(), phase * 2047.f);
+      T pVal = interpolate(table->frames[playedIndex], phase);
+      T tVal = interpolate(table->frames[targetIndex], phase);
       v = rescale(morph,minMorph,maxMorph,pVal,tVal);
     }
 
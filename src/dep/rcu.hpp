@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace rcu {
+
+  // Read-copy-update handle around a heap object.
+  // Readers (the audio thread, the UI thread...) use the current object
+  // without any lock and call quiescent() once they no longer hold it,
+  // typically at the end of process() or at the start of a widget step().
+  // Every reader starts online. One that stops running (bypassed module,
+  // closed UI) goes offline() so it does not hold back reclamation, and
+  // online() again before its next acquire(). A single writer at a time
+  // publishes fresh objects; replaced ones are deleted on the writer side
+  // once every online reader went through a quiescent point, so readers never
+  // block and never see a freed object.
+  // The epoch and pointer operations are sequentially consistent: a release
+  // increment alone would let the reader's next load of current move above
+  // it on weakly ordered CPUs.
+  template <typename T, size_t READERS = 1>
+  struct Pointer {
+    struct Retired {
+      T *object;
+      uint64_t epochs[READERS];
+      bool waiting[READERS];
+    };
+
+    std::atomic<T*> current;
+    std::atomic<uint64_t> epochs[READERS];
+    std::atomic<bool> readers[READERS];
+    std::vector<Retired> retired;
+
+    Pointer(T *object = nullptr) : current(object) {
+      for (size_t i = 0; i < READERS; i++) {
+        epochs[i] = 0;
+        readers[i] = true;
+      }
+    }
+
+    ~Pointer() {
+      for (auto &r : retired) {
+        delete r.object;
+      }
+      delete current.load();
+    }
+
+    Pointer(const Pointer&) = delete;
+    Pointer& operator=(const Pointer&) = delete;
+
+    T *acquire() const {
+      return current.load(std::memory_order_seq_cst);
+    }
+
+    void quiescent(size_t reader) {
+      epochs[reader].fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    // reader side, before the first acquire() after offline()
+    void online(size_t reader) {
+      readers[reader].store(true, std::memory_order_seq_cst);
+    }
+
+    // reader side, once it holds nothing and may stop calling quiescent()
+    void offline(size_t reader) {
+      epochs[reader].fetch_add(1, std::memory_order_seq_cst);
+      readers[reader].store(false, std::memory_order_seq_cst);
+    }
+
+    // writer side
+    void publish(T *object) {
+      T *old = current.exchange(object, std::memory_order_seq_cst);
+      if (old) {
+        Retired r;
+        r.object = old;
+        for (size_t i = 0; i < READERS; i++) {
+          r.waiting[i] = readers[i].load(std::memory_order_seq_cst);
+          r.epochs[i] = epochs[i].load(std::memory_order_seq_cst);
+        }
+        retired.push_back(r);
+      }
+      collect();
+    }
+
+    // writer side, frees what no reader can still hold
+    void collect() {
+      size_t kept = 0;
+      for (size_t j = 0; j < retired.size(); j++) {
+        bool released = true;
+        for (size_t i = 0; i < READERS; i++) {
+          released = released && (!retired[j].waiting[i] || (epochs[i].load(std::memory_order_seq_cst) > retired[j].epochs[i]));
+        }
+        if (released) {
+          delete retired[j].object;
+        }
+        else {
+          retired[kept++] = retired[j];
+        }
+      }
+      retired.resize(kept);
+    }
+  };
+
+}
@@ -0,0 +1,34 @@
+#include "slidecurve.hpp"
+#include <cmath>
+#include <mutex>
+
+namespace slidecurve {
+
+  static std::mutex lock;
+  static Table *table = nullptr;
+  static int users = 0;
+
+  const Table *acquire() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!table) {
+      table = new Table;
+      for (int i = 0; i < numCurves; i++) {
+        for (int j = 0; j < curveLength; j++) {
+          table->values[i][j] = powf(j*0.0001f,i*0.01f);
+        }
+      }
+      table->guard = 0.0f;
+    }
+    users++;
+    return table;
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (--users == 0) {
+      delete table;
+      table = nullptr;
+    }
+  }
+
+}
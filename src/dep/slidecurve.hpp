@@ -0,0 +1,20 @@
+#pragma once
+
+namespace slidecurve {
+
+  static constexpr int numCurves = 100;
+  static constexpr int curveLength = 10000;
+
+  // values[i][j] = powf(j*0.0001f, i*0.01f), read with interpolateLinear.
+  // The trailing guard keeps the read of values[i][curveLength] defined.
+  struct Table {
+    float values[numCurves][curveLength];
+    float guard;
+  };
+
+  // Process-wide table shared by every ZOUMAI and ENCORE instance, built by
+  // the first acquire and freed when the last user releases it.
+  const Table *acquire();
+  void release();
+
+}
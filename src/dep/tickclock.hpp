@@ -0,0 +1,46 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+namespace tickclock {
+
+  // Counts the ticks of a grid running at a fractional number of ticks per
+  // sample. The phase is a 64 bit fixed point tick position in the measure
+  // (up to 2^16 ticks long), so rounding the increment costs at most 2^-49
+  // tick per sample: under a sample per hour even at one tick every 480000
+  // samples. A tick lands on the first sample at or after its exact grid
+  // time, at most one tick per sample.
+  struct Clock {
+    static const int PHASE_BITS = 48;
+
+    uint64_t phase = 0;
+    uint64_t increment = 0;
+    int tick = 0;
+
+    void setRate(double ticksPerSample) {
+      increment = (uint64_t)std::llround(std::ldexp(ticksPerSample, PHASE_BITS));
+    }
+
+    void restart() {
+      phase = 0;
+      tick = 0;
+    }
+
+    // Advances one sample. Returns the position in the measure of the tick
+    // due on this sample, or -1. The measure wraps on the tick following its
+    // last one.
+    int process(int measureTicks) {
+      int due = -1;
+      if (phase >= ((uint64_t)tick << PHASE_BITS)) {
+        if (tick >= measureTicks) {
+          phase -= (uint64_t)tick << PHASE_BITS;
+          tick = 0;
+        }
+        due = tick++;
+      }
+      phase += increment;
+      return due;
+    }
+  };
+
+}
@@ -3,139 +3,271 @@
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav/dr_wav.h"
 #include <dsp/resampler.hpp>
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
 
 namespace waves {
 
-  std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
-    waveFileName = rack::system::getFilename(path);
-    waveExtension = rack::system::getExtension(waveFileName);
-    std::vector<rack::dsp::Frame<1>> result;
-    if (rack::string::uppercase(waveExtension) == ".WAV") {
-      unsigned int c;
-      unsigned int sr;
-      drwav_uint64 sc;
-      float* pSampleData;
-      pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &c, &sr, &sc, NULL);
-      if (pSampleData != NULL)  {
-        sampleChannels = c;
-        sampleRate = sr;
-        for (long long unsigned int i=0; i < sc; i = i + c) {
-          rack::dsp::Frame<1> frame;
-          if (sampleChannels == 2) {
-            frame.samples[0] = (pSampleData[i] + pSampleData[i+1])/2.0f;
-          }
-          else {
-            frame.samples[0] = pSampleData[i];
-          }
-          result.push_back(frame);
-        }
-        sampleCount = sc/c;
-        drwav_free(pSampleData, NULL);
-      }
+  namespace {
+
+    // frames decoded per read, the only working memory besides the destination
+    const int decodeChunk = 4096;
+
+    inline void toFrame(float first, float second, int channels, rack::dsp::Frame<1> &frame) {
+      frame.samples[0] = (channels == 2) ? (first + second)/2.0f : first;
+    }
+
+    inline void toFrame(float first, float second, int channels, rack::dsp::Frame<2> &frame) {
+      frame.samples[0] = first;
+      frame.samples[1] = (channels == 2) ? second : first;
     }
-    else if (rack::string::uppercase(waveExtension) == ".AIFF") {
-      AudioFile<float> audioFile;
-      if (audioFile.load (path.c_str()))  {
-        sampleChannels = audioFile.getNumChannels();
-        sampleRate = audioFile.getSampleRate();
-        sampleCount = audioFile.getNumSamplesPerChannel();
-        for (int i=0; i < sampleCount; i++) {
-          rack::dsp::Frame<1> frame;
-          if (sampleChannels == 2) {
-            frame.samples[0] = (audioFile.samples[0][i] + audioFile.samples[1][i])/2.0f;
-          }
-          else {
-            frame.samples[0] = audioFile.samples[0][i];
-          }
-          result.push_back(frame);
+
+    // Pulls frames chunk by chunk from read(frames, count) straight into a
+    // destination sized once from the file length, resampling on the fly when
+    // the file rate differs from the engine rate.
+    template <size_t CHANNELS, typename READ>
+    std::vector<rack::dsp::Frame<CHANNELS>> readFrames(int64_t frameCount, int sampleRate, const float currentSampleRate, READ read) {
+      std::vector<rack::dsp::Frame<CHANNELS>> result;
+      if ((frameCount <= 0) || (sampleRate <= 0)) return result;
+
+      if (sampleRate == currentSampleRate) {
+        result.resize(frameCount);
+        int64_t pos = 0;
+        while (pos < frameCount) {
+          int n = read(&result[pos], (int)std::min<int64_t>(decodeChunk, frameCount - pos));
+          if (n <= 0) break;
+          pos += n;
         }
+        result.resize(pos);
+        return result;
       }
-    }
 
-    if ((sampleRate != currentSampleRate) && (sampleCount>0)) {
-      rack::dsp::SampleRateConverter<1> conv;
+      rack::dsp::SampleRateConverter<CHANNELS> conv;
       conv.setRates(sampleRate, currentSampleRate);
       conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
-      int outCount = sampleCount;
-      std::vector<rack::dsp::Frame<1>> subResult;
-      for (int i=0;i<sampleCount;i++) {
-        rack::dsp::Frame<1> frame;
-        frame.samples[0]=0.0f;
-        subResult.push_back(frame);
+      result.resize(std::ceil(frameCount * (double)currentSampleRate / sampleRate) + 1);
+      std::vector<rack::dsp::Frame<CHANNELS>> chunk(decodeChunk);
+      int64_t outPos = 0;
+      int n;
+      while ((outPos < (int64_t)result.size()) && ((n = read(&chunk[0], decodeChunk)) > 0)) {
+        int inPos = 0;
+        while ((inPos < n) && (outPos < (int64_t)result.size())) {
+          int inFrames = n - inPos;
+          int outFrames = result.size() - outPos;
+          conv.process(&chunk[inPos], &inFrames, &result[outPos], &outFrames);
+          if ((inFrames == 0) && (outFrames == 0)) break;
+          inPos += inFrames;
+          outPos += outFrames;
+        }
       }
-      conv.process(&result[0], &sampleCount, &subResult[0], &outCount);
-      sampleCount = outCount;
-      return subResult;
+      result.resize(outPos);
+      return result;
     }
 
-    return result;
-  }
-
-  std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
-    waveFileName = rack::system::getFilename(path);
-    waveExtension = rack::system::getExtension(waveFileName);
-    std::vector<rack::dsp::Frame<2>> result;
-    if (rack::string::uppercase(waveExtension) == ".WAV") {
-      unsigned int c;
-      unsigned int sr;
-      drwav_uint64 sc;
-      float* pSampleData;
-      pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &c, &sr, &sc, NULL);
-      if (pSampleData != NULL)  {
-        sampleChannels = c;
-        sampleRate = sr;
-        for (long long unsigned int i=0; i < sc; i = i + c) {
-          rack::dsp::Frame<2> frame;
-          frame.samples[0] = pSampleData[i];
-  				if (sampleChannels == 2)
-  					frame.samples[1] = (float)pSampleData[i+1];
-  				else
-  					frame.samples[1] = (float)pSampleData[i];
-          result.push_back(frame);
+    template <size_t CHANNELS>
+    std::vector<rack::dsp::Frame<CHANNELS>> getWav(const std::string &path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+      waveFileName = rack::system::getFilename(path);
+      waveExtension = rack::system::getExtension(waveFileName);
+      std::vector<rack::dsp::Frame<CHANNELS>> result;
+      if (rack::string::uppercase(waveExtension) == ".WAV") {
+        drwav wav;
+        if (drwav_init_file(&wav, path.c_str(), NULL)) {
+          int c = wav.channels;
+          sampleChannels = c;
+          sampleRate = wav.sampleRate;
+          std::vector<float> raw(decodeChunk * c);
+          result = readFrames<CHANNELS>(wav.totalPCMFrameCount, sampleRate, currentSampleRate, [&](rack::dsp::Frame<CHANNELS> *frames, int count) {
+            int n = drwav_read_pcm_frames_f32(&wav, count, &raw[0]);
+            for (int i = 0; i < n; i++) {
+              const float *in = &raw[i * c];
+              toFrame(in[0], (c > 1) ? in[1] : in[0], c, frames[i]);
+            }
+            return n;
+          });
+          drwav_uninit(&wav);
         }
-        sampleCount = sc/c;
-        drwav_free(pSampleData, NULL);
       }
+      else if (rack::string::uppercase(waveExtension) == ".AIFF") {
+        AudioFile<float> audioFile;
+        if (audioFile.load (path.c_str()))  {
+          int c = audioFile.getNumChannels();
+          sampleChannels = c;
+          sampleRate = audioFile.getSampleRate();
+          int frameCount = audioFile.getNumSamplesPerChannel();
+          int pos = 0;
+          result = readFrames<CHANNELS>(frameCount, sampleRate, currentSampleRate, [&](rack::dsp::Frame<CHANNELS> *frames, int count) {
+            int n = std::min(count, frameCount - pos);
+            for (int i = 0; i < n; i++) {
+              float first = audioFile.samples[0][pos + i];
+              toFrame(first, (c > 1) ? audioFile.samples[1][pos + i] : first, c, frames[i]);
+            }
+            pos += n;
+            return n;
+          });
+        }
+      }
+      sampleCount = result.size();
+      return result;
     }
-    else if (rack::string::uppercase(waveExtension) == ".AIFF") {
-      AudioFile<float> audioFile;
-      if (audioFile.load (path.c_str()))  {
-        sampleChannels = audioFile.getNumChannels();
-        sampleRate = audioFile.getSampleRate();
-        sampleCount = audioFile.getNumSamplesPerChannel();
-        for (int i=0; i < sampleCount; i++) {
-          rack::dsp::Frame<2> frame;
-          frame.samples[0] = audioFile.samples[0][i];
-  				if (sampleChannels == 2)
-  					frame.samples[1] = audioFile.samples[1][i];
-  				else
-  					frame.samples[1] = audioFile.samples[0][i];
-          result.push_back(frame);
+
+    // samples nobody uses anymore are kept up to this size, reloading a patch
+    // then finds them in memory
+    const size_t idleCacheBytes = 64 << 20;
+
+    struct CacheKey {
+      std::string path;
+      int64_t mtime;
+      int64_t fileSize;
+      float sampleRate;
+
+      bool operator<(const CacheKey &k) const {
+        if (path != k.path) return path < k.path;
+        if (mtime != k.mtime) return mtime < k.mtime;
+        if (fileSize != k.fileSize) return fileSize < k.fileSize;
+        return sampleRate < k.sampleRate;
+      }
+    };
+
+    // frames owns the decoded buffer, handle is what the modules hold: it
+    // expires with the last of their copies, and the entry is idle from then
+    template <size_t CHANNELS>
+    struct CacheEntry {
+      std::shared_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> frames;
+      std::weak_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> handle;
+      int sampleChannels;
+      int sampleRate;
+      uint64_t lastUse;
+    };
+
+    template <size_t CHANNELS>
+    using Cache = std::map<CacheKey, CacheEntry<CHANNELS>>;
+
+    std::mutex cacheLock;
+    uint64_t cacheTick = 0;
+    Cache<1> monoCache;
+    Cache<2> stereoCache;
+
+    bool getCacheKey(const std::string &path, const float sampleRate, CacheKey &key) {
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0) return false;
+      key.path = path;
+      key.mtime = st.st_mtime;
+      key.fileSize = st.st_size;
+      key.sampleRate = sampleRate;
+      return true;
+    }
+
+    template <size_t CHANNELS>
+    void findIdle(Cache<CHANNELS> &cache, size_t &idleBytes, typename Cache<CHANNELS>::iterator &oldest) {
+      for (auto it = cache.begin(); it != cache.end(); it++) {
+        if (it->second.handle.expired()) {
+          idleBytes += it->second.frames->size() * sizeof(rack::dsp::Frame<CHANNELS>);
+          if ((oldest == cache.end()) || (it->second.lastUse < oldest->second.lastUse)) oldest = it;
         }
       }
     }
 
-    if ((sampleRate != currentSampleRate) && (sampleCount>0)) {
-      rack::dsp::SampleRateConverter<2> conv;
-      conv.setRates(sampleRate, currentSampleRate);
-      conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
-      int outCount = 16*sampleCount;
-      std::vector<rack::dsp::Frame<2>> subResult;
-      for (int i=0;i<outCount;i++) {
-        rack::dsp::Frame<2> frame;
-        frame.samples[0]=0.0f;
-        frame.samples[1]=0.0f;
-        subResult.push_back(frame);
+    // drops the least recently used idle samples, cacheLock held
+    void trimCache() {
+      while (true) {
+        size_t idleBytes = 0;
+        Cache<1>::iterator monoOldest = monoCache.end();
+        Cache<2>::iterator stereoOldest = stereoCache.end();
+        findIdle(monoCache, idleBytes, monoOldest);
+        findIdle(stereoCache, idleBytes, stereoOldest);
+        if (idleBytes <= idleCacheBytes) return;
+        if ((stereoOldest == stereoCache.end()) || ((monoOldest != monoCache.end()) && (monoOldest->second.lastUse < stereoOldest->second.lastUse)))
+          monoCache.erase(monoOldest);
+        else
+          stereoCache.erase(stereoOldest);
+      }
+    }
+
+    // runs when the last module copy of a cached sample is released, which
+    // happens on loader and UI threads, never in process()
+    template <size_t CHANNELS>
+    struct Release {
+      std::shared_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> frames;
+
+      void operator()(const std::vector<rack::dsp::Frame<CHANNELS>> *) {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        trimCache();
+      }
+    };
+
+    // cacheLock held
+    template <size_t CHANNELS>
+    std::shared_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> share(CacheEntry<CHANNELS> &entry) {
+      std::shared_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> frames = entry.handle.lock();
+      if (!frames) {
+        frames.reset(entry.frames.get(), Release<CHANNELS>{entry.frames});
+        entry.handle = frames;
       }
-      conv.process(&result[0], &sampleCount, &subResult[0], &outCount);
-      sampleCount = outCount;
-      return subResult;
+      return frames;
     }
 
-    return result;
+    template <size_t CHANNELS, typename DECODE>
+    Sample<CHANNELS> getShared(Cache<CHANNELS> &cache, const std::string &path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, DECODE decode) {
+      waveFileName = rack::system::getFilename(path);
+      waveExtension = rack::system::getExtension(waveFileName);
+      Sample<CHANNELS> sample;
+      CacheKey key;
+      bool cacheable = getCacheKey(path, currentSampleRate, key);
+
+      if (cacheable) {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+          it->second.lastUse = ++cacheTick;
+          sample.frames = share(it->second);
+          sampleChannels = it->second.sampleChannels;
+          sampleRate = it->second.sampleRate;
+          sampleCount = sample.size();
+          return sample;
+        }
+      }
+
+      // decode outside of the lock, other modules keep loading meanwhile
+      std::vector<rack::dsp::Frame<CHANNELS>> frames = decode(path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount);
+      sample.frames = std::make_shared<const std::vector<rack::dsp::Frame<CHANNELS>>>(std::move(frames));
+
+      if (cacheable && (sampleCount > 0)) {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        CacheEntry<CHANNELS> &entry = cache[key];
+        // someone else may have decoded the same file meanwhile
+        if (!entry.frames) {
+          entry.frames = sample.frames;
+          entry.sampleChannels = sampleChannels;
+          entry.sampleRate = sampleRate;
+        }
+        entry.lastUse = ++cacheTick;
+        sample.frames = share(entry);
+        trimCache();
+      }
+
+      return sample;
+    }
+
+  }
+
+  std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return getWav<1>(path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount);
+  }
+
+  std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return getWav<2>(path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount);
+  }
+
+  Sample<1> getSharedMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return getShared(monoCache, path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount, getMonoWav);
+  }
+
+  Sample<2> getSharedStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return getShared(stereoCache, path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount, getStereoWav);
   }
 
-  void saveWave(std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path) {
+  void saveWave(const std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path) {
     drwav_data_format format;
     format.container = drwav_container_riff;
     format.format = DR_WAVE_FORMAT_PCM;
@@ -152,7 +284,7 @@ namespace waves {
 
     drwav wav;
     drwav_init_file_write(&wav, path.c_str(), &format, NULL);
-    drwav_uint64 framesWritten = drwav_write_pcm_frames(&wav, 2*sample.size(), pSamples);
+    drwav_uint64 framesWritten = drwav_write_pcm_frames(&wav, sample.size(), pSamples);
     drwav_uninit(&wav);
 
     free(pSamples);
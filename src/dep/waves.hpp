@@ -3,10 +3,34 @@
 
 namespace waves {
 
+// Decoded sample handed out by the plugin-wide cache. Buffers are immutable
+// and reference counted, modules loading the same file at the same rate
+// share a single copy.
+template <size_t CHANNELS>
+struct Sample {
+  std::shared_ptr<const std::vector<rack::dsp::Frame<CHANNELS>>> frames;
+
+  size_t size() const {
+    return frames ? frames->size() : 0;
+  }
+
+  const rack::dsp::Frame<CHANNELS>& operator[](size_t i) const {
+    return (*frames)[i];
+  }
+
+  void clear() {
+    frames.reset();
+  }
+};
+
 std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
 
 std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
 
-void saveWave(std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path);
+Sample<1> getSharedMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
+
+Sample<2> getSharedStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
+
+void saveWave(const std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path);
 
 }
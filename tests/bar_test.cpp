@@ -0,0 +1,101 @@
+// Checks of BAR from the built plugin: a polyphonic channel that stops and
+// comes back must start from silence, not replay its old delay line or
+// compress on the peaks its detector held when it stopped.
+// Needs the Rack SDK and the plugin built on it: `make -C tests
+// RACK_DIR=<Rack SDK>` after `make` (or `make test` from a plugin build).
+#include <rack.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include "check.hpp"
+
+// BAR::ParamIds, BAR::InputIds and BAR::OutputIds
+enum {
+  THRESHOLD_PARAM = 0,
+  RATIO_PARAM = 1,
+  ATTACK_PARAM = 2,
+  RELEASE_PARAM = 3,
+  LOOKAHEAD_PARAM = 7,
+  IN_L_INPUT = 0,
+  IN_R_INPUT = 1,
+  OUT_L_OUTPUT = 0
+};
+
+static const float sampleRate = 44100.f;
+
+int main() {
+  rack::Context *context = new rack::Context;
+  context->engine = new rack::engine::Engine;
+  rack::contextSet(context);
+
+  void *library = dlopen(PLUGIN_PATH, RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    printf("FAIL: %s\n", dlerror());
+    return EXIT_FAILURE;
+  }
+  typedef void (*InitCallback)(rack::plugin::Plugin*);
+  InitCallback init = (InitCallback)dlsym(library, "init");
+  rack::plugin::Plugin *plugin = new rack::plugin::Plugin;
+  init(plugin);
+  rack::plugin::Model *model = plugin->getModel("baR");
+  if (!model) {
+    printf("FAIL: no BAR in %s\n", PLUGIN_PATH);
+    return EXIT_FAILURE;
+  }
+  rack::engine::Module *module = model->createModule();
+  json_t *rootJ = module->dataToJson();
+  json_object_set_new(rootJ, "polyphonic", json_true());
+  module->dataFromJson(rootJ);
+  json_decref(rootJ);
+
+  // -20 dB threshold at 20:1, a 200% lookahead of a 100 ms attack
+  module->params[THRESHOLD_PARAM].setValue(-20.f);
+  module->params[RATIO_PARAM].setValue(20.f);
+  module->params[ATTACK_PARAM].setValue(100.f);
+  module->params[RELEASE_PARAM].setValue(10.f);
+  module->params[LOOKAHEAD_PARAM].setValue(200.f);
+  int lookahead = (int)(200.f * 100.f * sampleRate * 0.000001f);
+
+  rack::engine::Module::ProcessArgs args;
+  args.sampleRate = sampleRate;
+  args.sampleTime = 1.f / sampleRate;
+  long frame = 0;
+  auto run = [&](int channels, float level, long frames, float *worst, float *settled) {
+    module->inputs[IN_L_INPUT].setChannels(channels);
+    module->inputs[IN_R_INPUT].setChannels(channels);
+    for (long n = 0; n < frames; n++, frame++) {
+      for (int c = 0; c < channels; c++) {
+        module->inputs[IN_L_INPUT].setVoltage(level, c);
+        module->inputs[IN_R_INPUT].setVoltage(level, c);
+      }
+      args.frame = frame;
+      module->process(args);
+      if (channels > 1) {
+        float out = module->outputs[OUT_L_OUTPUT].getVoltage(1);
+        *worst = std::max(*worst, std::fabs(out));
+        if (n >= 4 * lookahead) {
+          *settled = std::min(*settled, std::fabs(out));
+        }
+      }
+    }
+  };
+
+  // channel 1 compresses a 5V signal, stops halfway through its lookahead,
+  // then comes back with a -40 dB one, well under the threshold
+  float worst = 0.f, settled = 10.f;
+  run(2, 5.f, 10 * lookahead, &worst, &settled);
+  run(2, 5.f, lookahead / 2, &worst, &settled);
+  float unused = 0.f;
+  run(1, 0.05f, lookahead, &unused, &unused);
+  worst = 0.f;
+  settled = 10.f;
+  run(2, 0.05f, 8 * lookahead, &worst, &settled);
+  delete module;
+
+  printf("bar: a returning channel peaks at %.3f V and settles at %.3f V for a 0.05 V input\n", worst, settled);
+  check(worst < 0.06f, "a returning channel replayed its old delay line");
+  check(settled > 0.045f, "a returning channel compressed on its old peaks");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
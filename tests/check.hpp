@@ -0,0 +1,13 @@
+// Failure count shared by the standalone tests, main() returns
+// EXIT_FAILURE when a check failed.
+#pragma once
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
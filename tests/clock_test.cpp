@@ -0,0 +1,62 @@
+// Long-run checks of the TOCANTE tick clock in src/dep/tickclock.hpp.
+// Build and run with `make -C tests` (or `make test` from a plugin build).
+#include "tickclock.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "check.hpp"
+
+// Runs the clock like TOCANTE does (96 PPQN, 4 beats of 4/ref quarters) and
+// checks that tick k lands on sample ceil(k * samplesPerTick) of the exact
+// grid, give or take one sample plus the drift allowed by the rounding of the
+// increment (half a phase unit per sample), over the whole run.
+static void clockDrift(float bpm, int ref, float sampleRate, double hours) {
+  const int ticksPerQuarter = 96;
+  int measureTicks = 4 * ticksPerQuarter * 4 / ref;
+  long double samplesPerTick = 60.0L * ref * sampleRate / (ticksPerQuarter * 4.0L * bpm);
+
+  tickclock::Clock clock;
+  clock.setRate((double)ticksPerQuarter * 4.0 * bpm / (60.0 * ref * sampleRate));
+
+  long long samples = (long long)(hours * 3600.0 * sampleRate);
+  long long ticks = 0;
+  long long worst = 0;
+  long long last = 0;
+  int expectedPosition = 0;
+  bool wrongPosition = false;
+
+  for (long long n = 0; n < samples; n++) {
+    int position = clock.process(measureTicks);
+    if (position < 0) {
+      continue;
+    }
+    long long due = (long long)ceill(ticks * samplesPerTick);
+    last = n - due;
+    worst = std::max(worst, std::abs(last));
+    if (position != expectedPosition) {
+      wrongPosition = true;
+    }
+    expectedPosition = (position + 1) % measureTicks;
+    ticks++;
+  }
+
+  // an integer sample period, as the divisions used to be counted, loses
+  // the fractional part of the period on every tick
+  long double truncatedDrift = ticks * (samplesPerTick - (long long)samplesPerTick);
+  long long bound = 1 + (long long)ceill(samples * ldexpl(samplesPerTick, -tickclock::Clock::PHASE_BITS - 1));
+  printf("%.2f BPM 4/%d at %.0f Hz, %.1f h: %lld ticks, last tick off by %lld samples, worst %lld, bound %lld"
+    " (a truncated period would be %.0Lf samples late)\n",
+    bpm, ref, sampleRate, hours, ticks, last, worst, bound, truncatedDrift);
+  check(worst <= bound, "the clock drifted from the grid");
+  check(!wrongPosition, "the ticks skipped a position in the measure");
+}
+
+int main(int argc, char **argv) {
+  double hours = (argc > 1) ? atof(argv[1]) : 4.0;
+  clockDrift(123.45f, 4, 44100.f, hours);
+  clockDrift(97.f, 4, 48000.f, hours);
+  clockDrift(174.f, 8, 96000.f, hours);
+  clockDrift(350.f, 2, 44100.f, hours);
+  clockDrift(1.f, 16, 192000.f, hours);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
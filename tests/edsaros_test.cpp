@@ -0,0 +1,220 @@
+// Soak test of EDSAROS from the built plugin: four voices play for ten
+// minutes of audio per hour argument while another thread loads a sample
+// through dataFromJson every tenth of a second of audio, as a patch load or
+// the sample menu do. The
+// resident memory must stay flat once warmed up, and process() must never
+// allocate.
+// Needs the Rack SDK and the plugin built on it: `make -C tests
+// RACK_DIR=<Rack SDK>` after `make` (or `make test` from a plugin build).
+#include <rack.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <unistd.h>
+#include "check.hpp"
+
+// Allocations are counted while the audio thread is inside process(). The
+// plugin resolves operator new to this one, the test is linked with
+// -rdynamic. Newer GCC warns that the replacement new and delete below go
+// through malloc and free, which is what they are meant to do.
+#if defined(__GNUC__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static thread_local bool inProcess = false;
+static std::atomic<long> processAllocations{0};
+
+void *operator new(size_t size) {
+  if (inProcess) {
+    processAllocations++;
+  }
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+// EDSAROS::InputIds and EDSAROS::OutputIds
+enum {
+  TRIG_INPUT = 0,
+  PITCH_INPUT = 1,
+  OUT = 0
+};
+
+static const float sampleRate = 44100.f;
+
+static double residentMB() {
+  long pages = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// 16 bit mono PCM, a decaying saw so that the loops have something to play
+static bool writeWav(const std::string &path, int frames) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  auto u32 = [f](uint32_t v) { fwrite(&v, 4, 1, f); };
+  auto u16 = [f](uint16_t v) { fwrite(&v, 2, 1, f); };
+  fwrite("RIFF", 1, 4, f);
+  u32(36 + 2 * frames);
+  fwrite("WAVEfmt ", 1, 8, f);
+  u32(16);
+  u16(1);
+  u16(1);
+  u32((uint32_t)sampleRate);
+  u32((uint32_t)sampleRate * 2);
+  u16(2);
+  u16(16);
+  fwrite("data", 1, 4, f);
+  u32(2 * frames);
+  for (int n = 0; n < frames; n++) {
+    float saw = 2.f * std::fmod(n * 220.f / sampleRate, 1.f) - 1.f;
+    int16_t v = (int16_t)(20000.f * saw * std::exp(-2.f * n / frames));
+    fwrite(&v, 2, 1, f);
+  }
+  fclose(f);
+  return true;
+}
+
+static void loadSample(rack::engine::Module *module, const std::string &path) {
+  json_t *rootJ = module->dataToJson();
+  if (!rootJ) {
+    rootJ = json_object();
+  }
+  json_object_set_new(rootJ, "lastPath", json_string(path.c_str()));
+  module->dataFromJson(rootJ);
+  json_decref(rootJ);
+}
+
+int main(int argc, char **argv) {
+  double hours = (argc > 1) ? atof(argv[1]) : 1.0;
+  long frames = (long)(hours * 600.0 * sampleRate);
+  long warmUp = frames / 10;
+
+  char dir[] = "/tmp/edsaros_testXXXXXX";
+  if (!mkdtemp(dir)) {
+    printf("FAIL: no temporary directory\n");
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> paths;
+  for (int seconds = 1; seconds <= 3; seconds++) {
+    paths.push_back(std::string(dir) + "/" + std::to_string(seconds) + "s.wav");
+    if (!writeWav(paths.back(), seconds * (int)sampleRate)) {
+      printf("FAIL: cannot write %s\n", paths.back().c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  // APP->engine gives loadSample its sample rate, the context is per thread
+  rack::Context *context = new rack::Context;
+  context->engine = new rack::engine::Engine;
+  rack::contextSet(context);
+
+  void *library = dlopen(PLUGIN_PATH, RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    printf("FAIL: %s\n", dlerror());
+    return EXIT_FAILURE;
+  }
+  typedef void (*InitCallback)(rack::plugin::Plugin*);
+  InitCallback init = (InitCallback)dlsym(library, "init");
+  rack::plugin::Plugin *plugin = new rack::plugin::Plugin;
+  init(plugin);
+  rack::plugin::Model *model = plugin->getModel("eDsaroS");
+  if (!model) {
+    printf("FAIL: no EDSAROS in %s\n", PLUGIN_PATH);
+    return EXIT_FAILURE;
+  }
+  rack::engine::Module *module = model->createModule();
+  module->inputs[TRIG_INPUT].setChannels(4);
+  module->inputs[PITCH_INPUT].setChannels(4);
+  loadSample(module, paths[0]);
+
+  std::atomic<bool> playing{true};
+  std::atomic<long> requests{0};
+  std::atomic<long> loads{0};
+  std::thread loader([&]() {
+    rack::contextSet(context);
+    while (playing) {
+      if (loads < requests) {
+        loadSample(module, paths[loads % paths.size()]);
+        loads++;
+      }
+      else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+
+  rack::engine::Module::ProcessArgs args;
+  args.sampleRate = sampleRate;
+  args.sampleTime = 1.f / sampleRate;
+  double warmMB = 0.0, peakMB = 0.0, energy = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  for (long n = 0; n < frames; n++) {
+    // voices a fifth apart, retriggered every quarter of a second in turn
+    for (int c = 0; c < 4; c++) {
+      long t = n + c * (long)sampleRate / 16;
+      module->inputs[TRIG_INPUT].setVoltage(((t / (long)(sampleRate / 8)) % 2) ? 0.f : 10.f, c);
+      module->inputs[PITCH_INPUT].setVoltage((c - 2) * 7.f / 12.f, c);
+    }
+    args.frame = n;
+    inProcess = true;
+    module->process(args);
+    inProcess = false;
+    for (int c = 0; c < 4; c++) {
+      float out = module->outputs[OUT].getVoltage(c);
+      energy += out * out;
+    }
+    if (n % (long)(sampleRate / 10) == 0) {
+      requests++;
+      double mb = residentMB();
+      if (n <= warmUp) {
+        warmMB = std::max(warmMB, mb);
+      }
+      else {
+        peakMB = std::max(peakMB, mb);
+      }
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  playing = false;
+  loader.join();
+  delete module;
+
+  for (const std::string &path : paths) {
+    remove(path.c_str());
+  }
+  rmdir(dir);
+
+  printf("edsaros: %.0f s of audio in %.1f s with %ld loads, resident %.1f MB after warm-up, %.1f MB peak, %ld allocations in process()\n",
+    frames / sampleRate, seconds, loads.load(), warmMB, peakMB, processAllocations.load());
+  check(energy > 0.0, "the voices never played");
+  check(loads > 10, "the samples were not reloaded while playing");
+  check(peakMB < warmMB + 32.0, "the resident memory grows while playing");
+  check(processAllocations == 0, "process() allocated");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+// Load-while-playing check of the sample swap used by MAGMA, OAI and POUPRE:
+// a loader::Worker decodes and publishes through an rcu::Pointer while an
+// audio thread plays. The audio side must never see a torn or freed sample,
+// and must neither lock nor allocate.
+// Build and run with `make -C tests` (or `make test` from a plugin build).
+#include "rcu.hpp"
+#include "loader.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "check.hpp"
+
+// Allocations and mutex locks are counted while the audio thread is inside
+// its process() stand-in. Newer GCC warns that the replacement new and
+// delete below go through malloc and free, which is what they are meant to do.
+#if defined(__GNUC__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static thread_local bool inProcess = false;
+static std::atomic<long> processAllocations{0};
+static std::atomic<long> processLocks{0};
+
+void *operator new(size_t size) {
+  if (inProcess) {
+    processAllocations++;
+  }
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  typedef int (*Lock)(pthread_mutex_t*);
+  static Lock lock = (Lock)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+  if (inProcess) {
+    processLocks++;
+  }
+  return lock(mutex);
+}
+
+// Same shape as waves::Sample: decoded frames shared by pointer. Every frame
+// of a load holds its serial and the size is derived from it, so a sample
+// mixing two loads is detected.
+struct Sample {
+  std::shared_ptr<const std::vector<float>> frames;
+  float serial = 0.f;
+  static std::atomic<int> live;
+
+  Sample() {
+    live++;
+  }
+
+  Sample(const Sample &other) : frames(other.frames), serial(other.serial) {
+    live++;
+  }
+
+  ~Sample() {
+    serial = -1.f;
+    live--;
+  }
+
+  static size_t sizeOf(int serial) {
+    return 256 + (serial * 97) % 4096;
+  }
+};
+
+std::atomic<int> Sample::live{0};
+
+struct Player {
+  rcu::Pointer<Sample> sample{new Sample()};
+  loader::Worker loader{[this]() { sample.collect(); }};
+  bool audioOnline = false;
+  size_t head = 0;
+  long badReads = 0;
+  long reads = 0;
+
+  void load(int serial) {
+    loader.post([this, serial]() {
+      Sample *s = new Sample();
+      s->frames = std::make_shared<const std::vector<float>>(Sample::sizeOf(serial), (float)serial);
+      s->serial = (float)serial;
+      sample.publish(s);
+    });
+  }
+
+  void process() {
+    inProcess = true;
+    if (!audioOnline) {
+      sample.online(0);
+      audioOnline = true;
+    }
+    const Sample &s = *sample.acquire();
+    if (s.frames) {
+      const std::vector<float> &frames = *s.frames;
+      int serial = (int)s.serial;
+      head = (head + 1) % frames.size();
+      if ((serial < 0) || (frames.size() != Sample::sizeOf(serial)) || (frames[head] != s.serial) || (frames[0] != frames[frames.size() - 1])) {
+        badReads++;
+      }
+      reads++;
+    }
+    sample.quiescent(0);
+    inProcess = false;
+  }
+
+  void bypass() {
+    sample.offline(0);
+    audioOnline = false;
+  }
+};
+
+int main() {
+  int loads = 0;
+  long reads = 0;
+  long badReads = 0;
+  {
+    Player player;
+    std::atomic<bool> playing{true};
+    std::thread audio([&]() {
+      for (long n = 0; playing; n++) {
+        player.process();
+        if (n % 250000 == 0) {
+          player.bypass();
+          std::this_thread::yield();
+        }
+      }
+      player.bypass();
+    });
+    for (loads = 1; loads <= 20000; loads++) {
+      player.load(loads);
+      if (loads % 64 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    playing = false;
+    audio.join();
+    reads = player.reads;
+    badReads = player.badReads;
+  }
+  printf("loader: %d loads while playing, %ld reads, %ld torn or freed, %ld allocations and %ld locks in process()\n",
+    loads - 1, reads, badReads, processAllocations.load(), processLocks.load());
+  check(reads > 0, "the audio thread never played a loaded sample");
+  check(badReads == 0, "the audio thread read a torn or freed sample");
+  check(processAllocations == 0, "process() allocated");
+  check(processLocks == 0, "process() took a lock");
+  check(Sample::live == 0, "samples leaked");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
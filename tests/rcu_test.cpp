@@ -0,0 +1,119 @@
+// Checks of the reclamation rules of src/dep/rcu.hpp.
+// Build and run with `make -C tests` (or `make test` from a plugin build).
+#include "rcu.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "check.hpp"
+
+// Counts the live objects and poisons the freed ones.
+struct Object {
+  static std::atomic<int> live;
+  std::atomic<int> value;
+
+  Object(int value) : value(value) {
+    live++;
+  }
+
+  ~Object() {
+    value = -1;
+    live--;
+  }
+};
+
+std::atomic<int> Object::live{0};
+
+enum { AUDIO, UI, READERS };
+
+// A retired object stays alive until every reader, online from the start,
+// went through a quiescent point.
+static void retiredWaitsForEveryReader() {
+  rcu::Pointer<Object, READERS> pointer(new Object(0));
+  Object *first = pointer.acquire();
+  pointer.publish(new Object(1));
+  check(Object::live == 2, "an object was freed before any reader was quiescent");
+  pointer.quiescent(AUDIO);
+  pointer.collect();
+  check(Object::live == 2 && first->value == 0, "an object was freed while the UI reader could hold it");
+  pointer.quiescent(UI);
+  pointer.collect();
+  check(Object::live == 1, "an object outlived the quiescent points of every reader");
+}
+
+// A quiescent point taken before the publish does not release the object.
+static void quiescentBeforePublishDoesNotCount() {
+  rcu::Pointer<Object, READERS> pointer(new Object(0));
+  pointer.quiescent(AUDIO);
+  pointer.quiescent(UI);
+  pointer.publish(new Object(1));
+  check(Object::live == 2, "an earlier quiescent point released a new retiree");
+  pointer.quiescent(AUDIO);
+  pointer.quiescent(UI);
+  pointer.collect();
+  check(Object::live == 1, "the retired object was not freed");
+}
+
+// An offline reader does not hold anything back, and once back online it is
+// waited for again.
+static void offlineReaders() {
+  rcu::Pointer<Object, READERS> pointer(new Object(0));
+  pointer.offline(UI);
+  pointer.publish(new Object(1));
+  pointer.quiescent(AUDIO);
+  pointer.collect();
+  check(Object::live == 1, "an offline reader held back reclamation");
+
+  pointer.online(UI);
+  pointer.publish(new Object(2));
+  pointer.quiescent(AUDIO);
+  pointer.collect();
+  check(Object::live == 2, "a reader back online was not waited for");
+  pointer.offline(UI);
+  pointer.collect();
+  check(Object::live == 1, "going offline did not release the reader");
+}
+
+// An audio thread reads without pause while the writer publishes as fast as
+// it can: no read may ever see a freed object.
+static void concurrentReadsNeverSeeFreedObjects() {
+  long published = 0;
+  long badReads = 0;
+  {
+    rcu::Pointer<Object, READERS> pointer(new Object(0));
+    pointer.offline(UI);
+    std::atomic<bool> done{false};
+    std::thread audio([&]() {
+      for (int n = 0; n < 2000000; n++) {
+        Object *object = pointer.acquire();
+        if (object->value < 0) {
+          badReads++;
+        }
+        pointer.quiescent(AUDIO);
+        if (n % 100000 == 0) {
+          pointer.offline(AUDIO);
+          std::this_thread::yield();
+          pointer.online(AUDIO);
+        }
+      }
+      pointer.offline(AUDIO);
+      done = true;
+    });
+    while (!done) {
+      pointer.publish(new Object(++published));
+    }
+    audio.join();
+    pointer.collect();
+    check(pointer.retired.empty(), "retired objects left once every reader is offline");
+  }
+  printf("rcu: %ld objects published under concurrent reads, %ld reads of freed objects\n", published, badReads);
+  check(badReads == 0, "a reader saw a freed object");
+}
+
+int main() {
+  retiredWaitsForEveryReader();
+  quiescentBeforePublishDoesNotCount();
+  offlineReaders();
+  concurrentReadsNeverSeeFreedObjects();
+  check(Object::live == 0, "objects leaked");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+// Checks that the shared slide curve table of src/dep/slidecurve.cpp plays
+// slides bit for bit like the table each ZOUMAI and ENCORE used to own.
+// Build and run with `make -C tests` (or `make test` from a plugin build).
+#include "slidecurve.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "check.hpp"
+
+// the former per-instance member and its constructor loop
+static float powTable[100][10000] = {{0.0f}};
+
+static void fillOldTable() {
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 10000; j++) {
+      powTable[i][j] = powf(j*0.0001f,i*0.01f);
+    }
+  }
+}
+
+// rack::math::interpolateLinear, as the sequencers call it
+static float interpolateLinear(const float *p, float x) {
+  int xi = x;
+  float xf = x - xi;
+  return p[xi] + (p[xi + 1] - p[xi]) * xf;
+}
+
+static bool sameBits(float a, float b) {
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+int main() {
+  fillOldTable();
+  const slidecurve::Table *table = slidecurve::acquire();
+  check(slidecurve::acquire() == table, "a second user got its own table");
+
+  static_assert(sizeof(table->values) == sizeof(powTable), "the table layout changed");
+  check(memcmp(table->values, powTable, sizeof(powTable)) == 0, "the shared table differs from the per-instance one");
+
+  // the reads the sequencers make: a curve picked from the slide amount and
+  // a position 9999*subPhase (or subPhase/fullLength) in [0, 9999]
+  std::mt19937 rng(4);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  long differences = 0;
+  for (int n = 0; n < 2000000; n++) {
+    int curve = (int)(unit(rng) * 99.0f);
+    float x = 9999.0f * ((n % 1000 == 0) ? 1.0f : unit(rng));
+    if (!sameBits(interpolateLinear(table->values[curve], x), interpolateLinear(powTable[curve], x))) {
+      differences++;
+    }
+  }
+  printf("slidecurve: %ld differences in 2000000 slide reads\n", differences);
+  check(differences == 0, "slide playback is not bit compatible");
+
+  // the last user frees it, the next one gets a fresh identical table
+  slidecurve::release();
+  slidecurve::release();
+  table = slidecurve::acquire();
+  check(memcmp(table->values, powTable, sizeof(powTable)) == 0, "a rebuilt table differs from the per-instance one");
+  slidecurve::release();
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
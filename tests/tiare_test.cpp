@@ -0,0 +1,110 @@
+// Benchmark of the TIARE oscillator of src/dep/osc/tiareOsc.h with 16 voices
+// for each set of patched outputs, and check that an output patched again
+// restarts without a spurious discontinuity.
+// Needs the Rack SDK: `make -C tests RACK_DIR=<Rack SDK>` (or `make test` from
+// a plugin build).
+#include "osc/tiareOsc.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "check.hpp"
+
+typedef tiare::Oscillator<16, 16, rack::simd::float_4> Oscillator;
+
+static const float sampleTime = 1.f / 48000.f;
+
+static void setUp(Oscillator &oscillator, rack::simd::float_4 pitch) {
+  oscillator.channels = 4;
+  oscillator.setPitch(pitch, 1);
+  oscillator.setPulseWidth(0.4f);
+}
+
+// Nanoseconds per sample for 16 voices with the given outputs patched, best
+// of three runs of one second of audio.
+static double nsPerSample(bool sin, bool tri, bool saw, bool sqr, float &sink) {
+  const int frames = 48000;
+  double best = 1e9;
+  for (int run = 0; run < 3; run++) {
+    Oscillator *oscillators = new Oscillator[4];
+    for (int g = 0; g < 4; g++) {
+      setUp(oscillators[g], rack::simd::float_4(0.f, 0.25f, 0.5f, 0.75f) + 0.1f * g);
+      oscillators[g].setEnabled(sin, tri, saw, sqr);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < frames; n++) {
+      for (int g = 0; g < 4; g++) {
+        Oscillator &o = oscillators[g];
+        o.process(sampleTime, 0.f, 0.3f, 0.6f);
+        if (sin)
+          sink += o.sin()[0];
+        if (tri)
+          sink += o.tri()[1];
+        if (saw)
+          sink += o.saw()[2];
+        if (sqr)
+          sink += o.sqr()[3];
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, seconds * 1e9 / frames);
+    delete[] oscillators;
+  }
+  return best;
+}
+
+// An oscillator whose outputs are unpatched while its waveforms are negative
+// and patched again once they are positive plays like one that was never
+// unpatched. Before, the stale last values made the first sample after the
+// re-patch look like a zero crossing.
+static void repatchedOutputsRestartCleanly() {
+  Oscillator *playing = new Oscillator();
+  Oscillator *repatched = new Oscillator();
+  setUp(*playing, -3.f);
+  setUp(*repatched, -3.f);
+  bool patched = true;
+  int repatches = 0;
+  float maxError = 0.f;
+  for (int n = 0; n < 48000; n++) {
+    float phase = playing->phase[0];
+    if (patched && (phase >= 0.55f) && (phase < 0.6f)) {
+      patched = false;
+    }
+    else if (!patched && (phase >= 0.2f) && (phase < 0.25f)) {
+      patched = true;
+      repatches++;
+    }
+    repatched->setEnabled(patched, patched, patched, patched);
+    playing->process(sampleTime, 0.f, 0.5f, 0.5f);
+    repatched->process(sampleTime, 0.f, 0.5f, 0.5f);
+    if (patched) {
+      for (int i = 0; i < 4; i++) {
+        maxError = std::max(maxError, std::fabs(playing->sin()[i] - repatched->sin()[i]));
+        maxError = std::max(maxError, std::fabs(playing->tri()[i] - repatched->tri()[i]));
+        maxError = std::max(maxError, std::fabs(playing->saw()[i] - repatched->saw()[i]));
+        maxError = std::max(maxError, std::fabs(playing->sqr()[i] - repatched->sqr()[i]));
+      }
+    }
+  }
+  printf("tiare: %d re-patches, %g largest difference with an output never unpatched\n", repatches, maxError);
+  check(repatches > 10, "the outputs were not re-patched");
+  check(maxError < 1e-4f, "a re-patched output restarted with a discontinuity");
+  delete playing;
+  delete repatched;
+}
+
+int main() {
+  float sink = 0.f;
+  double all = nsPerSample(true, true, true, true, sink);
+  double sin = nsPerSample(true, false, false, false, sink);
+  double tri = nsPerSample(false, true, false, false, sink);
+  double saw = nsPerSample(false, false, true, false, sink);
+  double sqr = nsPerSample(false, false, false, true, sink);
+  double none = nsPerSample(false, false, false, false, sink);
+  printf("tiare: ns per sample for 16 voices, all outputs %.0f, sin %.0f, tri %.0f, saw %.0f, sqr %.0f, none %.0f (%g)\n",
+    all, sin, tri, saw, sqr, none, sink);
+
+  repatchedOutputsRestartCleanly();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+// Benchmark of the sample decoding of src/dep/waves.cpp against the decoder
+// it replaced: wall time and peak resident memory of loading a generated
+// five minute stereo WAV, at the file rate and resampled to 48 kHz. Each load
+// runs in a child process of its own so that the peak is its own. The times
+// are a report, the frame counts and the memory are checked.
+// Needs the Rack SDK: `make -C tests RACK_DIR=<Rack SDK>` (or `make test` from
+// a plugin build).
+#include "waves.hpp"
+#include "dr_wav/dr_wav.h"
+#include <dsp/resampler.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "check.hpp"
+
+namespace before {
+
+// the former getStereoWav, WAV branch, and the trim getShared made after it
+static std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate) {
+  std::vector<rack::dsp::Frame<2>> result;
+  int sampleRate = 0;
+  int sampleCount = 0;
+  unsigned int c;
+  unsigned int sr;
+  drwav_uint64 sc;
+  float* pSampleData;
+  pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &c, &sr, &sc, NULL);
+  if (pSampleData != NULL)  {
+    sampleRate = sr;
+    for (long long unsigned int i=0; i < sc; i = i + c) {
+      rack::dsp::Frame<2> frame;
+      frame.samples[0] = pSampleData[i];
+      if (c == 2)
+        frame.samples[1] = (float)pSampleData[i+1];
+      else
+        frame.samples[1] = (float)pSampleData[i];
+      result.push_back(frame);
+    }
+    sampleCount = sc/c;
+    drwav_free(pSampleData, NULL);
+  }
+
+  if ((sampleRate != currentSampleRate) && (sampleCount>0)) {
+    rack::dsp::SampleRateConverter<2> conv;
+    conv.setRates(sampleRate, currentSampleRate);
+    conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
+    int outCount = 16*sampleCount;
+    std::vector<rack::dsp::Frame<2>> subResult;
+    for (int i=0;i<outCount;i++) {
+      rack::dsp::Frame<2> frame;
+      frame.samples[0]=0.0f;
+      frame.samples[1]=0.0f;
+      subResult.push_back(frame);
+    }
+    conv.process(&result[0], &sampleCount, &subResult[0], &outCount);
+    sampleCount = outCount;
+    result.swap(subResult);
+  }
+
+  result.resize(std::max(std::min(sampleCount, (int)result.size()), 0));
+  result.shrink_to_fit();
+  return result;
+}
+
+}
+
+static const int fileRate = 44100;
+static const int fileFrames = 5 * 60 * fileRate;
+
+// 16 bit stereo PCM, two detuned saws
+static bool writeWav(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  auto u32 = [f](uint32_t v) { fwrite(&v, 4, 1, f); };
+  auto u16 = [f](uint16_t v) { fwrite(&v, 2, 1, f); };
+  fwrite("RIFF", 1, 4, f);
+  u32(36 + 4 * fileFrames);
+  fwrite("WAVEfmt ", 1, 8, f);
+  u32(16);
+  u16(1);
+  u16(2);
+  u32(fileRate);
+  u32(fileRate * 4);
+  u16(4);
+  u16(16);
+  fwrite("data", 1, 4, f);
+  u32(4 * fileFrames);
+  std::vector<int16_t> block(2 * fileRate);
+  for (int n = 0; n < fileFrames; n += fileRate) {
+    for (int i = 0; i < fileRate; i++) {
+      block[2 * i] = (int16_t)(20000.f * (2.f * std::fmod((n + i) * 110.f / fileRate, 1.f) - 1.f));
+      block[2 * i + 1] = (int16_t)(20000.f * (2.f * std::fmod((n + i) * 110.5f / fileRate, 1.f) - 1.f));
+    }
+    fwrite(block.data(), sizeof(int16_t), block.size(), f);
+  }
+  fclose(f);
+  return true;
+}
+
+struct Load {
+  double seconds = 0.0;
+  double peakMB = 0.0;
+  long frames = 0;
+};
+
+// Runs decode() in a child process, its peak resident memory is reported
+// by wait4()
+static Load measure(std::function<long()> decode) {
+  Load load;
+  int results[2];
+  if (pipe(results) != 0) {
+    return load;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(results[0]);
+    auto start = std::chrono::steady_clock::now();
+    Load child;
+    child.frames = decode();
+    child.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ssize_t written = write(results[1], &child, sizeof(child));
+    _exit(written == sizeof(child) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  close(results[1]);
+  if (read(results[0], &load, sizeof(load)) != sizeof(load)) {
+    load = Load();
+  }
+  close(results[0]);
+  int status = 0;
+  struct rusage usage;
+  if ((pid > 0) && (wait4(pid, &status, 0, &usage) == pid)) {
+    load.peakMB = usage.ru_maxrss / 1024.0;
+  }
+  return load;
+}
+
+int main() {
+  char dir[] = "/tmp/waves_testXXXXXX";
+  if (!mkdtemp(dir)) {
+    printf("FAIL: no temporary directory\n");
+    return EXIT_FAILURE;
+  }
+  std::string path = std::string(dir) + "/stereo.wav";
+  if (!writeWav(path)) {
+    printf("FAIL: cannot write %s\n", path.c_str());
+    return EXIT_FAILURE;
+  }
+
+  double idleMB = measure([]() { return 0L; }).peakMB;
+  const float engineRates[] = { 44100.f, 48000.f };
+  for (float engineRate : engineRates) {
+    Load old = measure([&]() {
+      return (long)before::getStereoWav(path, engineRate).size();
+    });
+    Load now = measure([&]() {
+      std::string waveFileName, waveExtension;
+      int sampleChannels = 0, sampleRate = 0, sampleCount = 0;
+      return (long)waves::getStereoWav(path, engineRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount).size();
+    });
+    long expected = std::lround(fileFrames * (double)engineRate / fileRate);
+    double decodedMB = expected * sizeof(rack::dsp::Frame<2>) / (1024.0 * 1024.0);
+    printf("waves: 5 min stereo WAV loaded at %.0f Hz: before %.2f s, %.0f MB peak, %ld frames; after %.2f s, %.0f MB peak, %ld frames (%.0f MB decoded)\n",
+      engineRate, old.seconds, old.peakMB - idleMB, old.frames, now.seconds, now.peakMB - idleMB, now.frames, decodedMB);
+    check(std::labs(now.frames - expected) <= expected / 100, "the whole file was not loaded");
+    check(now.peakMB < old.peakMB, "loading takes more memory than before");
+    check(now.peakMB - idleMB < decodedMB + 16.0, "loading takes more memory than the decoded sample");
+  }
+
+  remove(path.c_str());
+  rmdir(dir);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}